@@ -9,11 +9,16 @@
 #include <set>
 
 Agent::Agent(const Profile& profile, Simulation* sim) :
-    parent(nullptr),
     profile(profile),
     simulation(sim),
     mergedOrPruned(false),
-    target(nullptr) {}
+    history(sim && sim->config.contains("battle_config") ? sim->config["battle_config"].value("history_capacity", 10)
+                                                         : 10) {
+    if (sim) {
+        this->profile.actionId    = sim->modifiers.actionId(this->profile.currentAction);
+        this->profile.troopTypeId = sim->modifiers.troopTypeId(this->profile.troopType);
+    }
+}
 
 Agent::~Agent() {}
 
@@ -46,6 +51,30 @@ Agent* Agent::findChildByName(const std::string& name) {
     return nullptr;
 }
 
+Agent* Agent::getParent() const {
+    return simulation ? simulation->agentPool.get(parent) : nullptr;
+}
+
+Agent* Agent::getRootParent() {
+    Agent* current = this;
+    while (Agent* p = current->getParent()) {
+        current = p;
+    }
+    return current;
+}
+
+bool Agent::setParent(Agent* p) {
+    if (p) {
+        parent = p->self;
+        return true;
+    }
+    return false;
+}
+
+Agent* Agent::getTarget() const {
+    return simulation ? simulation->agentPool.get(target) : nullptr;
+}
+
 std::string Agent::getFaction() {
     Agent* root = getRootParent();
     if (root == simulation->countryA) {
@@ -57,37 +86,50 @@ std::string Agent::getFaction() {
     return "Unknown";
 }
 
+bool Agent::setTarget(Agent * t) {
+    if (!t) {
+        return false;
+    }
+    target                    = t->self;
+    profile.targetedAgentName = t->profile.name;
+    profile.targetPosition    = t->profile.position;
+    if (simulation) {
+        simulation->engagements.link(this, t);
+    }
+    return true;
+}
+
+void Agent::clearTarget() {
+    target                    = AgentHandle();
+    profile.targetedAgentName = "";
+    if (simulation) {
+        simulation->engagements.unlink(this);
+    }
+}
+
 bool Agent::isCountryA() {
     Agent* root = getRootParent();
     return root == simulation->countryA;
 }
 
 std::vector<nlohmann::json> Agent::constructPrompt() {
+    ScopedTimer timer("prompt.build");
     std::vector<nlohmann::json> prompts;
-    std::stringstream           system_ss, user_ss;
-
-    // === SYSTEM PROMPT ===
-    system_ss << "### SYSTEM INSTRUCTION & GLOBAL CONTEXT ###\n\n";
-    system_ss << "--- GLOBAL SETTINGS ---\n";
-    system_ss << "SystemPrompt: " << simulation->config["prompt"].get<std::string>() << "\n";
-    system_ss << "HistorySetting: " << profile.historySetting << "\n";
-    system_ss << "ArmySetting: " << profile.armySetting << "\n";
-    system_ss << "RoleSetting: " << profile.roleSetting << "\n";
-
-    system_ss << "\n--- ACTION & STAGE DEFINITIONS ---\n";
-    system_ss << "actionList:\n" << simulation->config["actionList"].dump(2) << "\n";
-    system_ss << "actionPropertyDefinition:\n" << simulation->config["actionPropertyDefinition"].dump(2) << "\n";
-    system_ss << "stagePropertyDefinition:\n" << simulation->config["stagePropertyDefinition"].dump(2) << "\n";
-
-    system_ss << "\n!!! CRITICAL: FOLLOW ALL RULES IN definitionOfJsonKeys !!!\n";
-    system_ss << "definitionOfJsonKeys:\n" << simulation->config["definitionOfJsonKeys"].dump(2) << "\n";
-
-    system_ss << "\n--- ACTION INSTRUCTION BLOCK ---\n";
-    system_ss << "actionInstructionBlock:\n" << simulation->config["actionInstructionBlock"].dump(2) << "\n";
+    std::vector<PromptSection>  sections;
+    std::stringstream           user_ss;
+
+    // Đẩy nội dung user_ss hiện tại thành một section rồi xoá buffer.
+    // priority: 0 = bắt buộc, số lớn hơn bị cắt trước khi vượt prompt_token_budget
+    auto flush = [&](int priority) {
+        sections.push_back({ priority, priority == 0, user_ss.str() });
+        user_ss.str("");
+        user_ss.clear();
+    };
 
+    // === SYSTEM PROMPT === (compact, dựng một lần cho mỗi bộ setting)
     prompts.push_back({
-        {"role",     "system"       },
-        { "content", system_ss.str()}
+        {"role",     "system"                                                                                      },
+        { "content", simulation->prompts.systemBlock(profile.historySetting, profile.armySetting, profile.roleSetting)}
     });
 
     // === USER PROMPT ===
@@ -131,6 +173,7 @@ std::vector<nlohmann::json> Agent::constructPrompt() {
         }
     }
     user_ss << "\n\n";
+    flush(0);
 
     // === COMMAND HIERARCHY ===
     user_ss << "=== COMMAND HIERARCHY ===\n";
@@ -173,6 +216,7 @@ std::vector<nlohmann::json> Agent::constructPrompt() {
     if (!has_self_created) {
         user_ss << "• None\n";
     }
+    flush(1);
 
     // === ORIGINAL SUB-AGENTS ===
     user_ss << "\n=== ORIGINAL SUB-AGENTS (DO NOT CONTROL) ===\n";
@@ -194,26 +238,40 @@ std::vector<nlohmann::json> Agent::constructPrompt() {
     if (!has_original) {
         user_ss << "• None\n";
     }
+    flush(5);
 
-    // === HISTORICAL BATTLEFIELD SUMMARY ===
-    if (!profile.currentBattlefieldSituation.empty()) {
-        user_ss << "\n=== HISTORICAL BATTLEFIELD SUMMARY (FROM PREVIOUS ROUNDS) ===\n";
-        user_ss << profile.currentBattlefieldSituation << "\n";
+    // === DECISION HISTORY === (bộ nhớ dài hạn, giới hạn bởi history_token_cap)
+    if (!history.empty()) {
+        const nlohmann::json & bc = simulation->config["battle_config"];
+        user_ss << "\n" << summarizeHistory(bc.value("history_recent_rounds", 5), bc.value("history_token_cap", 400));
+        flush(3);
     }
 
     // === CURRENT BATTLEFIELD SITUATION ===
+    std::string current_situation;
     try {
-        user_ss << "\n=== CURRENT BATTLEFIELD SITUATION ===\n";
-        user_ss << simulation->field.generateBattlefieldSituation(this) << "\n";
+        current_situation = simulation->field.generateBattlefieldSituation(this);
     } catch (const std::exception & e) {
-        user_ss << "\n=== CURRENT BATTLEFIELD SITUATION ===\n[PARSE ERROR]: " << e.what() << "\n";
+        current_situation = std::string("[PARSE ERROR]: ") + e.what();
     }
 
+    // === HISTORICAL BATTLEFIELD SUMMARY === (bỏ qua nếu trùng với tình hình hiện tại)
+    if (!profile.currentBattlefieldSituation.empty() && profile.currentBattlefieldSituation != current_situation) {
+        user_ss << "\n=== HISTORICAL BATTLEFIELD SUMMARY (FROM PREVIOUS ROUNDS) ===\n";
+        user_ss << profile.currentBattlefieldSituation << "\n";
+        flush(4);
+    }
+
+    user_ss << "\n=== CURRENT BATTLEFIELD SITUATION ===\n";
+    user_ss << current_situation << "\n";
+    flush(2);
+
     // ✅ THÊM: SOLDIER MORALE REPORT
     if (simulation->config.contains("soldier_summary_config")) {
         std::string soldier_report = generateSoldierSummary();
         if (!soldier_report.empty() && soldier_report.find("No soldiers") == std::string::npos) {
             user_ss << "\n" << soldier_report;
+            flush(3);
         }
     }
 
@@ -229,6 +287,7 @@ std::vector<nlohmann::json> Agent::constructPrompt() {
                 }
             }
         }
+        flush(6);
     }
 
     // === ACTION REQUEST ===
@@ -240,80 +299,44 @@ std::vector<nlohmann::json> Agent::constructPrompt() {
     user_ss << "• Recall ONLY when mission complete OR <30% troops\n";
     user_ss << "• Sub-agents DO NOT have targetedAgentName\n";
     user_ss << "• Output **VALID JSON ONLY**\n";
+    flush(0);
+
+    int         used_tokens = 0;
+    const int   budget      = simulation->config["battle_config"].value("prompt_token_budget", 0);
+    std::string user_prompt = simulation->prompts.assemble(sections, budget, &used_tokens);
+    LOG_DEBUG(simulation->logger, profile.roundNb)
+        << "Agent " << profile.name << " prompt: user " << used_tokens << " tokens (budget " << budget << ")";
 
     prompts.push_back({
-        {"role",     "user"       },
-        { "content", user_ss.str()}
+        {"role",     "user"     },
+        { "content", user_prompt}
     });
 
     return prompts;
 }
 
-std::string Agent::summarizeHistory(int max_len) const {
+// Tóm tắt dài hạn + các lượt gần nhất (mới nhất trước), cắt bớt lượt cũ để vừa token_cap
+std::string Agent::summarizeHistory(int max_len, int token_cap) const {
     if (history.empty()) {
         return "";
     }
 
-    nlohmann::json history_array = nlohmann::json::array();
-
-    int history_limit = std::min(max_len, static_cast<int>(history.size()));
-    size_t start_index = std::max(0, static_cast<int>(history.size()) - history_limit);
-
-    for (size_t i = start_index; i < history.size(); ++i) {
-        const auto& turn = history[i];
+    std::string summary = "=== DECISION HISTORY ===\n" + history.summaryLine() + "\n";
 
-        int own_loss_total = 0, enemy_loss_total = 0;
-
-        nlohmann::json sub_actions_summary = nlohmann::json::array();
-        if (turn.contains("actions") && turn["actions"].is_array()) {
-            for (const auto& action : turn["actions"]) {
-                own_loss_total += action.value("ownLoss", 0);
-                enemy_loss_total += action.value("enemyLoss", 0);
-
-                sub_actions_summary.push_back({
-                    {"agentName", action.value("agentName", "N/A")},
-                    {"action", action.value("actionType", "None")},
-                    {"deployedNum", action.value("deployedNum", 0)},
-                    {"ownLoss", action.value("ownLoss", 0)},
-                    {"enemyLoss", action.value("enemyLoss", 0)}
-                    });
-            }
-        }
-        nlohmann::json recall_summary = nlohmann::json::array();
-        if (turn.contains("SubAgentsRecall") && turn["SubAgentsRecall"].is_array()) {
-            recall_summary = turn["SubAgentsRecall"];
-        }
-
-        nlohmann::json turn_summary = {
-            { "turn", static_cast<int>(i + 1) },
-            { "agentNextActionType", turn.value("agentNextActionType", "Wait without Action") },
-            { "agentStage", turn.value("agentStage", "In Battle") },
-            { "targetedAgentName", turn.value("targetedAgentName", "None") },
-            { "agentMoral", turn.value("agentMoral", "Unknown") },
-            { "Recent history Battlefield Situation", turn.value("remarks", "No tactical notes provided") },          
-            { "final_position", turn.value("agentNextPosition", nlohmann::json::array({0.0, 0.0})) },
-            { "total_casualties", {
-                { "own_lost", own_loss_total },
-                { "enemy_lost", enemy_loss_total }
-            },
-            { "sub_units_actions", sub_actions_summary.empty() ? nlohmann::json::array() : sub_actions_summary },
-            { "sub_units_recalled", recall_summary.empty() ? nlohmann::json::array() : recall_summary }
+    const auto & records = history.records();
+    const size_t limit   = std::min(static_cast<size_t>(std::max(0, max_len)), records.size());
+    for (size_t i = 0; i < limit; ++i) {
+        std::string line = "- " + history.recordLine(records[records.size() - 1 - i]) + "\n";
+        if (token_cap > 0 && simulation->prompts.countTokens(summary + line) > token_cap) {
+            break;
         }
-        };
-
-        history_array.push_back(turn_summary);
+        summary += line;
     }
-
-    std::stringstream summary;
-    summary << "### HISTORY SUMMARY (Last " << history_limit << " Rounds - Structured JSON) ###\n";
-    summary << "This summary details past actions, outcomes, and the LLM's decision logic (Remarks), including the most recent round's logic.\n";
-    summary << "The JSON structure directly reflects the output requirements for optimal context.\n";
-    summary << history_array.dump(2);
-    return summary.str();
+    return summary;
 }
 
-
 nlohmann::json Agent::execute() {
+    ScopedTimer execute_timer("agent.execute");
     // Khởi tạo JSON kết quả
     nlohmann::json result = {
         { "agentName", profile.name },
@@ -345,27 +368,46 @@ nlohmann::json Agent::execute() {
     try {
         // === 1. GỌI LLM ===
         std::vector<nlohmann::json> prompts = constructPrompt();
-        std::string    llm_response = simulation->llm->infer(prompts, simulation->config["jsonConstraintVariable"]);
-        nlohmann::json llm_json     = nlohmann::json::parse(llm_response);
-        simulation->logger.debug(profile.roundNb) << "Agent " << profile.name << " LLM: " << llm_json.dump(2);
+        std::string    llm_response = simulation->llm->infer(prompts, simulation->config["jsonConstraintVariable"],
+                                                             { profile.name, profile.roundNb });
+        nlohmann::json llm_json;
+        {
+            ScopedTimer parse_timer("agent.parse");
+            llm_json = nlohmann::json::parse(llm_response);
+        }
+        LOG_DEBUG(simulation->logger, profile.roundNb) << "Agent " << profile.name << " LLM: " << llm_json.dump(2);
+
+        // LLM lỡ deadline / endpoint bị ngắt → dùng hành động mặc định trong battle_config, giữ nguyên vị trí
+        if (llm_json.is_object() && llm_json.contains("error") && !llm_json.contains("agentNextActionType")) {
+            const nlohmann::json & bc = simulation->config["battle_config"];
+            simulation->logger.warn(profile.roundNb) << "Agent " << profile.name << ": LLM decision unavailable ("
+                                                     << llm_json["error"].dump() << ") → fallback action";
+            llm_json = {
+                { "agentNextActionType", bc.value("fallback_action", "Wait without Action") },
+                { "agentStage", bc.value("fallback_stage", "Holding Position") },
+                { "targetedAgentName", profile.targetedAgentName.empty() ? "None" : profile.targetedAgentName },
+                { "agentMoral", profile.getMoralString() },
+                { "agentNextPosition", { profile.position.x, profile.position.y } },
+                { "remarks", "Fallback: LLM decision missed turn deadline" }
+            };
+        }
 
-        // Load configs
-        nlohmann::json actionDefs   = simulation->config["actionPropertyDefinition"];
-        nlohmann::json stageDefs    = simulation->config["stagePropertyDefinition"];
-        nlohmann::json jsonKeys     = simulation->config["definitionOfJsonKeys"];
-        nlohmann::json instructions = simulation->config["actionInstructionBlock"];
+        // Action/stage đã intern lúc nạp kịch bản (ModifierTables), không copy lại các bảng định nghĩa
+        const ModifierTables & modifiers = simulation->modifiers;
 
         // === 2. VALIDATE agentNextActionType ===
         std::string new_action = llm_json.value("agentNextActionType", "Wait without Action");
-        if (!actionDefs.contains(new_action)) {
+        int         action_id  = modifiers.actionId(new_action);
+        if (!modifiers.isDefinedAction(action_id)) {
             simulation->logger.warn(profile.roundNb)
                 << "Agent " << profile.name << ": Invalid action '" << new_action << "' → default";
             new_action = "Wait without Action";
+            action_id  = modifiers.actionId(new_action);
         }
 
         // === 3. VALIDATE agentStage ===
         std::string new_stage = llm_json.value("agentStage", "In Battle");
-        if (!stageDefs.contains(new_stage)) {
+        if (modifiers.stageId(new_stage) == 0) {
             simulation->logger.warn(profile.roundNb)
                 << "Agent " << profile.name << ": Invalid stage '" << new_stage << "' → default";
             new_stage = "In Battle";
@@ -377,7 +419,11 @@ nlohmann::json Agent::execute() {
         double next_x = profile.position.x, next_y = profile.position.y;
         if (pos_json.is_array() && pos_json.size() == 2 && pos_json[0].is_number() && pos_json[1].is_number()) {
             double x = pos_json[0].get<double>(), y = pos_json[1].get<double>();
-            if (simulation->field.isValidPosition(x, y)) {
+            if (simulation->field.movement.enabled()) {
+                // Chỉ là điểm đến mong muốn; quãng đường thực tế bị cắt ở bước 7
+                next_x = x;
+                next_y = y;
+            } else if (simulation->field.isValidPosition(x, y)) {
                 next_x = x;
                 next_y = y;
                 simulation->logger.info(profile.roundNb)
@@ -432,28 +478,25 @@ nlohmann::json Agent::execute() {
             }
         }
 
-        // === 8. ESTIMATE mainOwnLoss / mainEnemyLoss ===
-        int main_own_loss   = llm_json.value("mainOwnLoss", 0);
-        int main_enemy_loss = llm_json.value("mainEnemyLoss", 0);
-
-        if ((main_own_loss == 0 || main_enemy_loss == 0) && getTarget()) {
-            double vis      = weather_mod.value("visibilityModifier", 1.0);
-            double art      = weather_mod.value("artilleryModifier", 1.0);
-            auto [o, e]     = estimateCasualties(profile.remainingNumOfTroops(), vis, art);
-            main_own_loss   = main_own_loss > 0 ? main_own_loss : o;
-            main_enemy_loss = main_enemy_loss > 0 ? main_enemy_loss : e;
-        }
-
-        if (main_own_loss > 0) {
-            profile.takeDamage(main_own_loss);
-            simulation->logger.info(profile.roundNb) << "Agent " << profile.name << ": MAIN lost " << main_own_loss;
-        }
-        if (main_enemy_loss > 0 && getTarget()) {
-            getTarget()->profile.takeDamage(main_enemy_loss);
+        // Giới hạn di chuyển theo speed, terrain và thời tiết (flow field chung khi đích là stronghold/tunnel)
+        if (simulation->field.movement.enabled() && (next_x != profile.position.x || next_y != profile.position.y)) {
+            const double budget = simulation->field.movement.budgetFor(
+                speed, weather_mod.value("speed_modifier", simulation->field.getSpeedModifier()));
+            const Position reached = simulation->field.advance(profile.position, { next_x, next_y }, budget);
             simulation->logger.info(profile.roundNb)
-                << "Target " << getTarget()->profile.name << ": Lost " << main_enemy_loss << " by MAIN";
+                << "Agent " << profile.name << ": Moving to [" << reached.x << "," << reached.y << "] toward ["
+                << next_x << "," << next_y << "] (budget " << budget << "m)";
+            next_x = reached.x;
+            next_y = reached.y;
         }
 
+        // === 8. ESTIMATE mainOwnLoss / mainEnemyLoss ===
+        // Thương vong không áp ngay: gom vào Simulation::combat, resolve + commit cuối lượt
+        const double vis = weather_mod.value("visibilityModifier", 1.0);
+        const double art = weather_mod.value("artilleryModifier", 1.0);
+        queueEngagement(this, profile.remainingNumOfTroops(), llm_json.value("mainOwnLoss", 0),
+                        llm_json.value("mainEnemyLoss", 0), vis, art);
+
         // === 9. VALIDATE SubAgentsRecall + deploySubAgent CONFLICT ===       
         nlohmann::json        recall_list    = llm_json.value("SubAgentsRecall", nlohmann::json::array());
         std::set<std::string> recall_names;
@@ -490,22 +533,7 @@ nlohmann::json Agent::execute() {
                         continue;
                     }
 
-                    int own_loss   = act.value("ownLoss", 0);
-                    int enemy_loss = act.value("enemyLoss", 0);
-                    if ((own_loss == 0 || enemy_loss == 0) && getTarget()) {
-                        double vis  = weather_mod.value("visibilityModifier", 1.0);
-                        double art  = weather_mod.value("artilleryModifier", 1.0);
-                        auto [o, e] = sub->estimateCasualties(deploy_num, vis, art);
-                        own_loss    = own_loss > 0 ? own_loss : o;
-                        enemy_loss  = enemy_loss > 0 ? enemy_loss : e;
-                    }
-
-                    if (own_loss > 0) {
-                        sub->profile.takeDamage(own_loss);
-                    }
-                    if (enemy_loss > 0 && getTarget()) {
-                        getTarget()->profile.takeDamage(enemy_loss);
-                    }
+                    queueEngagement(sub, deploy_num, act.value("ownLoss", 0), act.value("enemyLoss", 0), vis, art);
 
                     valid_actions.push_back({
                         { "actionType", act.value("actionType", "Unknown") },
@@ -515,8 +543,6 @@ nlohmann::json Agent::execute() {
                         { "speed", act.value("speed",0) },
                         { "deployedNum", deploy_num },
                         { "position", act["position"] },
-                        { "ownLoss", own_loss },
-                        { "enemyLoss", enemy_loss },
                         { "inTunnel", act.value("inTunnel", false) },
                         { "remarks", act.value("remarks", "") }
                     });
@@ -535,11 +561,28 @@ nlohmann::json Agent::execute() {
                         continue;
                     }
 
-                    if (act.contains("position") && act.is_array() && act["position"].size() == 2) {
+                    if (act.contains("position") && act["position"].is_array() && act["position"].size() == 2 &&
+                        act["position"][0].is_number() && act["position"][1].is_number()) {
                         double x = act["position"][0].get<double>(), y = act["position"][1].get<double>();
-                        if (simulation->field.isValidPosition(x, y)) {
+                        if (simulation->field.movement.enabled()) {
+                            // Lệnh không ghi speed thì dùng speed hiện tại của sub-agent
+                            const double budget = simulation->field.movement.budgetFor(
+                                act.value("speed", sub->profile.speed),
+                                weather_mod.value("speed_modifier", simulation->field.getSpeedModifier()));
+                            const Position reached = simulation->field.advance(sub->profile.position, { x, y }, budget);
+                            simulation->logger.info(profile.roundNb)
+                                << "Sub-agent " << sub->profile.name << ": Moving to [" << reached.x << ","
+                                << reached.y << "] toward [" << x << "," << y << "] (budget " << budget << "m)";
+                            simulation->trace.move(profile.roundNb, sub->profile.name, sub->profile.position.x,
+                                                   sub->profile.position.y, reached.x, reached.y);
+                            sub->profile.position  = reached;
+                            simulation->field.onAgentMoved(sub);
+                        } else if (simulation->field.isValidPosition(x, y)) {
+                            simulation->trace.move(profile.roundNb, sub->profile.name, sub->profile.position.x,
+                                                   sub->profile.position.y, x, y);
                             sub->profile.position.x = x;
                             sub->profile.position.y = y;
+                            simulation->field.onAgentMoved(sub);
                         }
                     }
                     int current_sub_troops = sub->profile.remainingNumOfTroops();
@@ -549,22 +592,8 @@ nlohmann::json Agent::execute() {
 
                     profile.speed = act.value("speed", 0);
 
-                    int own_loss   = act.value("ownLoss", 0);
-                    int enemy_loss = act.value("enemyLoss", 0);
-                    if ((own_loss == 0 || enemy_loss == 0) && getTarget()) {
-                        double vis  = weather_mod.value("visibilityModifier", 1.0);
-                        double art  = weather_mod.value("artilleryModifier", 1.0);
-                        auto [o, e] = sub->estimateCasualties(sub->profile.remainingNumOfTroops(), vis, art);
-                        own_loss    = own_loss > 0 ? own_loss : o;
-                        enemy_loss  = enemy_loss > 0 ? enemy_loss : e;
-                    }
-
-                    if (own_loss > 0) {
-                        sub->profile.takeDamage(own_loss);
-                    }
-                    if (enemy_loss > 0 && getTarget()) {
-                        getTarget()->profile.takeDamage(enemy_loss);
-                    }
+                    queueEngagement(sub, sub->profile.remainingNumOfTroops(), act.value("ownLoss", 0),
+                                    act.value("enemyLoss", 0), vis, art);
                     valid_actions.push_back({
                         { "actionType", act.value("actionType", "Unknown") },
                         { "troopType", sub->profile.troopType },
@@ -572,8 +601,6 @@ nlohmann::json Agent::execute() {
                         { "speed", act.value("speed", 0) },
                         { "agentName", name },                     
                         { "position", act["position"] },
-                        { "ownLoss", own_loss },
-                        { "enemyLoss", enemy_loss },
                         { "inTunnel", act.value("inTunnel", false) },
                         { "remarks", act.value("remarks", "") }
                     });                    
@@ -605,34 +632,86 @@ nlohmann::json Agent::execute() {
         result["inTunnel"]            = in_tunnel;
         result["weather_modifier"]    = weather_mod;       
         result["SubAgentsRecall"]     = valid_recall;
-        result["mainOwnLoss"]         = main_own_loss;
-        result["mainEnemyLoss"]       = main_enemy_loss;
         result["actions"]             = valid_actions;
         result["remarks"]             = llm_json.value("remarks", "Action executed.");
 
         // === 13. UPDATE profile ===
+        if (next_x != profile.position.x || next_y != profile.position.y) {
+            simulation->trace.move(profile.roundNb, profile.name, profile.position.x, profile.position.y, next_x,
+                                   next_y);
+        }
         profile.position.x    = next_x;
         profile.position.y    = next_y;
+        simulation->field.onAgentMoved(this);
         profile.currentAction = new_action;
+        profile.actionId      = action_id;
         profile.speed         = speed;
         profile.currentStage  = new_stage + " " + llm_json.value("remarks", "Action executed.");
-               // === 14. SAVE history ===
-        history.push_back(result);
-        if (history.size() > 10) {
-            history.erase(history.begin());
-        }
+        // === 14. SAVE history ===
+        history.record(DecisionRecord::fromResult(result, profile.roundNb));
 
         simulation->logger.info(profile.roundNb)
             << "Agent " << profile.name << ": '" << new_action << "' | Stage: " << new_stage << " | Pos: [" << next_x
             << "," << next_y << "]"
-            << " | MainLoss: " << main_own_loss << " | Subs: " << valid_actions.size();
+            << " | Subs: " << valid_actions.size();
 
     } catch (const std::exception & e) {
         simulation->logger.error(profile.roundNb) << "Agent " << profile.name << ": " << e.what();
         result["remarks"] = "Error: " + std::string(e.what());
-        history.push_back(result);
+        history.record(DecisionRecord::fromResult(result, profile.roundNb));
+    }
+
+    return result;
+}
+
+// Lượt không được cấp LLM call: giữ hành động/stage của quyết định trước, đứng yên;
+// tiếp tục giao chiến theo estimateCasualties nếu mục tiêu cũ còn sống và trong tầm engage_range.
+nlohmann::json Agent::carryForward(double engage_range) {
+    profile.updateTroopInformation();
+
+    const bool        has_last = !history.empty();
+    DecisionRecord    last     = has_last ? history.records().back() : DecisionRecord();
+    nlohmann::json    weather  = simulation->field.getWeather();
+    const std::string action   = profile.currentAction.empty() ? "Wait without Action" : profile.currentAction;
+    const std::string stage    = has_last && !last.stage.empty() ? last.stage : "In Battle";
+
+    Agent * tgt = getTarget();
+    if (tgt && (tgt->mergedOrPruned ||
+                tgt->profile.currentStage == "Crushing Defeat" || tgt->profile.currentStage == "Fleeing Off the Map")) {
+        clearTarget();
+        profile.targetedAgentName = "None";
+        tgt                       = nullptr;
+    }
+
+    const bool engaged =
+        tgt && action != "Wait without Action" &&
+        std::hypot(tgt->profile.position.x - profile.position.x, tgt->profile.position.y - profile.position.y) <=
+            engage_range;
+    if (engaged) {
+        queueEngagement(this, profile.remainingNumOfTroops(), 0, 0, weather.value("visibilityModifier", 1.0),
+                        weather.value("artilleryModifier", 1.0));
     }
 
+    nlohmann::json result = {
+        { "agentName", profile.name },
+        { "agentNextActionType", action },
+        { "agentStage", stage },
+        { "currentBattlefieldSituation", profile.currentBattlefieldSituation },
+        { "targetedAgentName", tgt ? tgt->profile.name : "None" },
+        { "agentMoral", profile.getMoralString() },
+        { "speed", profile.speed },
+        { "inTunnel", simulation->field.isInTunnel(this, 0.0) },
+        { "weather_modifier", weather },
+        { "deploySubAgent", false },
+        { "SubAgentsRecall", nlohmann::json::array() },
+        { "actions", nlohmann::json::array() },
+        { "remarks", "Carried forward (no LLM call this turn)" },
+        { "agentNextPosition", { profile.position.x, profile.position.y } }
+    };
+    history.record(DecisionRecord::fromResult(result, profile.roundNb));
+
+    simulation->logger.info(profile.roundNb) << "Agent " << profile.name << ": carried forward '" << action
+                                             << "' | Stage: " << stage << (engaged ? " | engaging " + tgt->profile.name : "");
     return result;
 }
 
@@ -675,22 +754,16 @@ Agent* Agent::spawnSubAgent(const nlohmann::json& action) {
         {"ammo", profile.ammo},
         {"equipment", profile.equipment},
         {"tactics", profile.tactics},
-        {"historySetting", profile.historySetting},
-        {"armySetting", profile.armySetting},
-        {"roleSetting", profile.roleSetting},
         {"troopInformation", profile.troopInformation},
-        {"actionList", profile.actionList},
-        {"actionPropertyDefinition", profile.actionPropertyDefinition},
-        {"stagePropertyDefinition", profile.stagePropertyDefinition},
-        {"actionInstructionBlock", profile.actionInstructionBlock},
-        {"jsonConstraintVariable", profile.jsonConstraintVariable},
         {"currentBattlefieldSituation", profile.currentBattlefieldSituation}
         });
+    sub_profile.shareScenarioText(profile);  // Văn bản kịch bản: chỉ copy handle, không copy chuỗi
 
-    Agent* sub_agent = new Agent(sub_profile, simulation);
+    Agent* sub_agent = simulation->createAgent(sub_profile);
     sub_agent->setParent(this);
     profile.deployedNumOfTroops += deployed_num;
     simulation->addAgent(sub_agent);
+    simulation->trace.spawn(profile.roundNb, sub_profile.name, profile.name, deployed_num, position[0], position[1]);
     simulation->logger.info(profile.roundNb) << "Agent " << profile.name << " created sub-agent " << sub_profile.name
         << " with troops: " << deployed_num << ", position: [" << position[0] << ", " << position[1] << "]";
 
@@ -719,6 +792,9 @@ nlohmann::json Agent::BranchStreamlining(const std::string& sub_agent_name) {
         streamlining = "Merge";
     }
 
+    // Thương vong của lượt chờ tới resolveCombat: áp phần của child ngay để Merge/Prune tính trên số đã commit
+    simulation->settleCombat(child);
+
     int children_relocated = 0;
     for (Agent* sub_agent : child->getChildren()) {
         sub_agent->setParent(this);
@@ -734,8 +810,10 @@ nlohmann::json Agent::BranchStreamlining(const std::string& sub_agent_name) {
         child->profile.currentStage = "Crushing Defeat";
     }
 
+    simulation->trace.recall(profile.roundNb, child->profile.name, profile.name, child->profile.remainingNumOfTroops(),
+                             streamlining == "Prune");
     child->mergedOrPruned = true;
-    child->parent = nullptr;
+    child->parent = AgentHandle();
 
     simulation->removeAgent(child);
 
@@ -766,7 +844,7 @@ nlohmann::json Agent::generateTargetSummary() {
         summary["target"] = "No target assigned";
     }
 
-    simulation->logger.debug(profile.roundNb) << "Agent " << profile.name << " TargetSummary: " << summary.dump(2);
+    LOG_DEBUG(simulation->logger, profile.roundNb) << "Agent " << profile.name << " TargetSummary: " << summary.dump(2);
     return summary;
 }
 
@@ -785,112 +863,70 @@ std::vector<SoldierAgent*> Agent::getSoldiers() {
     return collector->getSoldiers(this);
 }
 
+// Báo cáo tình báo binh sĩ lấy từ cache; Simulation::refreshSoldierSummaries cập nhật theo lô mỗi lượt
 std::string Agent::generateSoldierSummary() {
-    std::vector<SoldierAgent *> my_soldiers = getSoldiers();
-
-    if (my_soldiers.empty()) {
-        return "";  // ✅ Trả về rỗng thay vì "No soldiers"
+    if (!simulation->config.contains("soldier_summary_config")) {
+        return "";  // ✅ Không có config thì skip
     }
+    return simulation->soldierSummaries.get(profile.name);
+}
 
+// Dữ liệu đầu vào cho báo cáo tình báo của agent (dùng trong request gộp nhiều agent)
+nlohmann::json Agent::soldierReportInput() {
     nlohmann::json soldier_data = nlohmann::json::array();
-    for (SoldierAgent * soldier : my_soldiers) {
+    for (SoldierAgent * soldier : getSoldiers()) {
         soldier_data.push_back(soldier->toJson());
     }
+    return {
+        { "action", profile.currentAction },
+        { "troops", profile.remainingNumOfTroops() },
+        { "lost", profile.lostNumOfTroops },
+        { "situation", nlohmann::json::parse(simulation->field.generateCompactSituation(this)) },
+        { "soldiers", soldier_data }
+    };
+}
 
-    std::vector<nlohmann::json> prompts;
-    std::stringstream           prompt_system;
-
-    if (!simulation->config.contains("soldier_summary_config")) {
-        return "";  // ✅ Không có config thì skip
-    }
-
-    nlohmann::json soldier_summary_config = simulation->config["soldier_summary_config"];
-
-    prompt_system << "### SYSTEM INSTRUCTION: INTELLIGENCE OFFICER ROLE ###\n";
-    prompt_system << "You are a highly experienced Intelligence Officer. ";
-    prompt_system << "Analyze the 'RAW SOLDIER DATA' and 'SITUATION' to produce ONE consolidated tactical report.\n";
-    prompt_system << "\n--- JSON OUTPUT CONSTRAINT ---\n";
-
-    if (soldier_summary_config.contains("soldier_summary_schema")) {
-        prompt_system << "Output Schema: " << soldier_summary_config["soldier_summary_schema"].dump() << "\n";
+void Agent::queueEngagement(Agent * unit, int deployedNum, int fixed_own, int fixed_enemy, double visibilityModifier,
+                            double artilleryModifier) {
+    CombatBatch::Engagement e;
+    e.owner       = this;
+    e.attacker    = unit;
+    e.victim      = getTarget();
+    e.fixed_own   = fixed_own;
+    e.fixed_enemy = fixed_enemy;
+    if ((fixed_own == 0 || fixed_enemy == 0) && getTarget()) {
+        unit->gatherEngagement(e, deployedNum, visibilityModifier, artilleryModifier);
     }
-
-    if (soldier_summary_config.contains("analysis_guidance")) {
-        prompt_system << "Analysis Guidance: " << soldier_summary_config["analysis_guidance"].dump() << "\n";
-    }
-
-    prompt_system << "Output pure JSON only. No explanation.\n";
-
-    prompts.push_back({
-        {"role",     "system"           },
-        { "content", prompt_system.str()}
-    });
-
-    std::stringstream user_prompt_content;
-    user_prompt_content << "[RAW SOLDIER DATA]\n";
-    user_prompt_content << soldier_data.dump(2) << "\n";
-    user_prompt_content << "\n--- CURRENT SITUATION ---\n";
-    user_prompt_content << "Action: " << profile.currentAction << "\n";
-    user_prompt_content << "Battlefield: " << simulation->field.generateBattlefieldSituation(this) << "\n";
-    user_prompt_content << "\n[JSON REPORT START]\n";
-
-    prompts.push_back({
-        {"role",     "user"                   },
-        { "content", user_prompt_content.str()}
-    });
-
-    try {
-        std::string    soldier_report_json = simulation->llm->infer(prompts);
-        nlohmann::json report              = nlohmann::json::parse(soldier_report_json);
-
-        std::stringstream formatted_summary;
-        formatted_summary << "=== UNIT MORALE & INTELLIGENCE SUMMARY ===\n";
-        formatted_summary << "MORALE: " << report.value("agent_morale_assessment", "N/A") << "\n";
-        formatted_summary << "OBSERVATIONS: " << report.value("key_observations_summary", "None") << "\n";
-        formatted_summary << "SENTIMENT: " << report.value("overall_sentiment_summary", "Stable") << "\n";
-
-        if (report.contains("physical_condition_trend")) {
-            formatted_summary << "PHYSICAL: " << report["physical_condition_trend"].get<std::string>() << "\n";
-        }
-
-        if (report.contains("combat_effectiveness_estimate")) {
-            double effectiveness = report["combat_effectiveness_estimate"].get<double>();
-            formatted_summary << "EFFECTIVENESS: " << static_cast<int>(effectiveness * 100) << "%\n";
-        }
-
-        formatted_summary << "==========================================\n";
-
-        return formatted_summary.str();
-
-    } catch (const std::exception & e) {
-        simulation->logger.error(profile.roundNb)
-            << "Failed to generate soldier summary for " << profile.name << ": " << e.what();
-        return "";  // ✅ Fail silent, không crash
+    if (e.fixed_own > 0 || e.estimate || (e.victim && e.fixed_enemy > 0)) {
+        simulation->combat.add(e);
     }
 }
 
-std::pair<int, int> Agent::estimateCasualties(int deployedNum, double visibilityModifier, double artilleryModifier) {
+// Thu thập hệ số giao chiến (bước 1-12 của công thức thương vong) vào e; false nếu không giao chiến được.
+// Không đụng tới owner/victim/fixed_* của e.
+bool Agent::gatherEngagement(CombatBatch::Engagement & e, int deployedNum, double visibilityModifier,
+                             double artilleryModifier) {
     // ========================================
     // 1. VALIDATION - Kiểm tra đầu vào
     // ========================================
     int attacker_avail = profile.remainingNumOfTroops();
     deployedNum        = std::min(deployedNum, attacker_avail);
 
-    if (deployedNum <= 0 || !target) {
+    if (deployedNum <= 0 || !getTarget()) {
         simulation->logger.warn(profile.roundNb) << "CasualtyCalc: " << profile.name << ": no valid target or troops";
-        return { 0, 0 };
+        return false;
     }
 
     Agent * defender = getTarget();
     if (!defender) {
         simulation->logger.warn(profile.roundNb) << "CasualtyCalc: " << profile.name << ": target is null";
-        return { 0, 0 };
+        return false;
     }
 
     int defender_avail = defender->profile.remainingNumOfTroops();
     if (defender_avail <= 0) {
         simulation->logger.warn(profile.roundNb) << "CasualtyCalc: " << profile.name << ": target already destroyed";
-        return { 0, 0 };
+        return false;
     }
 
     // ========================================
@@ -914,14 +950,9 @@ std::pair<int, int> Agent::estimateCasualties(int deployedNum, double visibility
         att_eff += profile.tactics.at("attack");
     }
 
-    // Troop type bonus
-    double troop_bonus = 1.0;
-    if (profile.troopType == "artillery") {
-        troop_bonus = 1.3;
-    } else if (profile.troopType == "scout") {
-        troop_bonus = 0.8;
-    }
-    att_eff *= troop_bonus;
+    // Troop type bonus (troopTypeDefinition.attack_modifier)
+    const ModifierTables & modifiers = simulation->modifiers;
+    att_eff *= modifiers.troopAttack(profile.troopTypeId);
 
     // ========================================
     // 4. TÍNH DEFENSE EFFECTIVENESS
@@ -983,44 +1014,19 @@ std::pair<int, int> Agent::estimateCasualties(int deployedNum, double visibility
 
     if (att_power <= 0 || def_power <= 0) {
         simulation->logger.warn(profile.roundNb) << "CasualtyCalc: " << profile.name << ": invalid power calculation";
-        return { 0, 0 };
+        return false;
     }
 
     // ========================================
-    // 8. TÍNH COMBAT RATIO
+    // 8. COMBAT RATIO, THƯƠNG VONG CUỐI (bước 13-14): CombatBatch::resolve
     // ========================================
-    double ratio = att_power / (att_power + def_power);
-    ratio        = std::clamp(ratio, 0.05, 0.95);
 
     // ========================================
     // 9. TERRAIN MODIFIERS
     // ========================================
-    double terrain_mod_attacker = 1.0;
-    double terrain_mod_defender = 1.0;
-
-    // Attacker attacking into stronghold = harder
-    if (def_terrain && def_terrain->type == TerrainType::Stronghold) {
-        terrain_mod_attacker = 1.4;   // Attacker takes more casualties
-        terrain_mod_defender = 0.65;  // Defender takes less casualties
-    } else if (def_terrain) {
-        // Other terrain types
-        switch (def_terrain->type) {
-            case TerrainType::Hills:
-                terrain_mod_attacker = 1.2;
-                terrain_mod_defender = 0.8;
-                break;
-            case TerrainType::Forest:
-                terrain_mod_attacker = 1.15;
-                terrain_mod_defender = 0.85;
-                break;
-            case TerrainType::Flat:
-                terrain_mod_attacker = 1.3;
-                terrain_mod_defender = 1.0;
-                break;
-            default:
-                break;
-        }
-    }
+    // Attacker đánh vào stronghold/hills... chịu thương vong cao hơn (terrain_config.combat_modifiers)
+    double terrain_mod_attacker = def_terrain ? modifiers.terrainAttacker(def_terrain->type) : 1.0;
+    double terrain_mod_defender = def_terrain ? modifiers.terrainDefender(def_terrain->type) : 1.0;
 
     // ========================================
     // 10. TUNNEL PROTECTION (50% reduction)
@@ -1042,22 +1048,7 @@ std::pair<int, int> Agent::estimateCasualties(int deployedNum, double visibility
     // ========================================
     // 11. ACTION MODIFIERS
     // ========================================
-    double action_mod = 1.0;
-    if (profile.currentAction == "Launch Full Assault") {
-        action_mod = 1.50;
-    } else if (profile.currentAction == "Launch Night Assault") {
-        action_mod = 1.35;
-    } else if (profile.currentAction == "Human Wave Assault") {
-        action_mod = 1.80;
-    } else if (profile.currentAction == "Hold Position") {
-        action_mod = 0.70;
-    } else if (profile.currentAction == "Fortify Position") {
-        action_mod = 0.65;
-    } else if (profile.currentAction == "Dig Assault Tunnel") {
-        action_mod = 0.80;
-    } else if (profile.currentAction == "Move to Tunnel") {
-        action_mod = 0.75;
-    }
+    double action_mod = modifiers.actionCasualty(profile.actionId);  // actionPropertyDefinition.casualty_modifier
 
     // ========================================
     // 12. ARTILLERY DOMINANCE (Vietnamese)
@@ -1066,74 +1057,51 @@ std::pair<int, int> Agent::estimateCasualties(int deployedNum, double visibility
 
     if (isCountryA() && simulation->config["battle_config"].contains("artillery_dominance_vn")) {
         artillery_advantage *= simulation->config["battle_config"]["artillery_dominance_vn"].get<double>();
-        simulation->logger.debug(profile.roundNb) << "Vietnamese artillery advantage: " << artillery_advantage;
+        LOG_DEBUG(simulation->logger, profile.roundNb) << "Vietnamese artillery advantage: " << artillery_advantage;
     }
 
     // French artillery degrades over time
     if (!isCountryA() && profile.roundNb >= 20) {
         artillery_advantage *= 0.3;  // Reduced to 30% effectiveness after Round 20
-        simulation->logger.debug(profile.roundNb) << "French artillery degraded: " << artillery_advantage;
+        LOG_DEBUG(simulation->logger, profile.roundNb) << "French artillery degraded: " << artillery_advantage;
     }
 
-    // ========================================
-    // 13. FINAL CASUALTY CALCULATION
-    // ========================================
-    // Own Loss Formula: troops × coeff × (1-ratio) × terrain × visibility × tunnel × morale × action
-    int est_own_loss =
-        static_cast<int>(deployedNum * base_coeff * (1.0 - ratio) * terrain_mod_attacker * visibilityModifier *
-                         tunnel_mod_attacker * (1.0 / att_morale) *  // Lower morale = more casualties
-                         action_mod);
-
-    // Enemy Loss Formula: enemy_troops × coeff × ratio × terrain × artillery × morale × action
-    int est_enemy_loss = static_cast<int>(defender_avail * base_coeff * ratio * terrain_mod_defender *
-                                          artillery_advantage * (1.0 / def_morale) *  // Lower morale = more casualties
-                                          action_mod);
-
-    // ========================================
-    // 14. CLAMP VALUES
-    // ========================================
-    est_own_loss   = std::clamp(est_own_loss, 0, attacker_avail);
-    est_enemy_loss = std::clamp(est_enemy_loss, 0, defender_avail);
-
-    // ========================================
-    // 15. HISTORICAL ACCURACY CHECK
-    // ========================================
-    // VN average ~410/round, French ~41/round
-    // Major battles: 5-10× higher
-    if (est_own_loss > deployedNum * 0.5) {
-        simulation->logger.warn(profile.roundNb)
-            << "WARNING: " << profile.name << " casualties very high: " << est_own_loss << " ("
-            << (est_own_loss * 100 / deployedNum) << "%)";
-    }
+    e.attacker       = this;
+    e.deployed       = deployedNum;
+    e.attacker_avail = attacker_avail;
+    e.defender_avail = defender_avail;
+    e.att_eff        = att_eff;
+    e.def_eff        = def_eff;
+    e.att_morale     = att_morale;
+    e.def_morale     = def_morale;
+    e.att_tactical   = att_tactical;
+    e.def_tactical   = def_tactical;
+    e.terrain_att    = terrain_mod_attacker;
+    e.terrain_def    = terrain_mod_defender;
+    e.tunnel_att     = tunnel_mod_attacker;
+    e.tunnel_def     = tunnel_mod_defender;
+    e.action_mod     = action_mod;
+    e.artillery      = artillery_advantage;
+    e.visibility     = visibilityModifier;
+    e.coeff          = base_coeff;
+    e.estimate       = true;
+    return true;
+}
 
-    if (est_enemy_loss > defender_avail * 0.5) {
-        simulation->logger.warn(profile.roundNb)
-            << "WARNING: " << defender->profile.name << " casualties very high: " << est_enemy_loss << " ("
-            << (est_enemy_loss * 100 / defender_avail) << "%)";
+// Ước lượng một trận ngay lập tức (batch một hàng, cùng bộ giải với Simulation::combat)
+std::pair<int, int> Agent::estimateCasualties(int deployedNum, double visibilityModifier, double artilleryModifier) {
+    CombatBatch::Engagement e;
+    e.owner  = this;
+    e.victim = getTarget();
+    if (!gatherEngagement(e, deployedNum, visibilityModifier, artilleryModifier)) {
+        return { 0, 0 };
     }
-
-    // ========================================
-    // 16. DETAILED LOGGING
-    // ========================================
-    simulation->logger.debug(profile.roundNb)
-        << "\n=== CASUALTY CALCULATION: " << profile.name << " vs " << defender->profile.name << " ==="
-        << "\nDeployed: " << deployedNum << " vs Defender: " << defender_avail << "\nAttack Eff: " << att_eff
-        << " | Defense Eff: " << def_eff << "\nAttack Power: " << att_power << " | Defense Power: " << def_power
-        << "\nCombat Ratio: " << ratio << "\nModifiers:"
-        << "\n  - Visibility: " << visibilityModifier << "\n  - Artillery: " << artillery_advantage
-        << "\n  - Tunnel (Att): " << tunnel_mod_attacker << "\n  - Tunnel (Def): " << tunnel_mod_defender
-        << "\n  - Terrain (Att): " << terrain_mod_attacker << "\n  - Terrain (Def): " << terrain_mod_defender
-        << "\n  - Action: " << action_mod << "\nResult: Own Loss = " << est_own_loss
-        << " | Enemy Loss = " << est_enemy_loss
-        << "\n====================================================================";
-
-    // ========================================
-    // 17. APPLY CASUALTIES (REMOVED - Let caller handle)
-    // ========================================
-    // NOTE: Không apply damage ở đây nữa, để caller (execute()) xử lý
-    // Tránh double-counting casualties
-
-    return { est_own_loss, est_enemy_loss };
+    CombatBatch single;
+    single.configure(simulation->combat.resolver(), simulation->combat.subSteps());
+    single.add(e);
+    single.resolve();
+    simulation->logCombatRow(single, 0);
+    return { single.ownLoss(0), single.enemyLoss(0) };
 }
 
 nlohmann::json Agent::getProfilePrompt() const {
@@ -1151,8 +1119,8 @@ nlohmann::json Agent::getProfilePrompt() const {
     p["Target"]    = profile.targetedAgentName;
 
     double distanceToTarget = -1;
-    if (target) {
-        distanceToTarget = profile.getDistanceTo(target->profile.position);
+    if (Agent * tgt = getTarget()) {
+        distanceToTarget = profile.getDistanceTo(tgt->profile.position);
     }
 
     p["Distance to Target"] = distanceToTarget;
@@ -1,5 +1,8 @@
 #pragma once
 #include "BattleField.h"
+#include "CombatBatch.h"
+#include "DecisionHistory.h"
+#include "GenerationalPool.h"
 #include "LLMInference.h"
 #include "nlohmann/json.hpp"
 #include "Profile.h"
@@ -11,6 +14,9 @@
 class Simulation;  // Forward declaration
 class SoldierAgent;
 
+// Agent nằm trong Simulation::agentPool; target/parent giữ handle nên agent đã bị xoá tra ra nullptr
+using AgentHandle = PoolHandle;
+
 class Agent {
   public:
     Agent(const Profile & profile, Simulation * sim);
@@ -24,36 +30,16 @@ class Agent {
     std::vector<Agent *> getChildren();
     Agent *              findChildByName(const std::string & name);
 
-    Agent * getParent() { return parent; }
-
-    Agent * Agent::getRootParent() {
-        Agent * current = this;
-        while (current->getParent() != nullptr) {
-            current = current->getParent();
-        }
-        return current;
-    }
-
-    bool setParent(Agent * p) {
-        if (p) {
-            parent = p;
-            return true;
-        }
-        return false;
-    }
+    Agent * getParent() const;  // nullptr nếu không có cha hoặc cha đã bị xoá
+    Agent * getRootParent();
+    bool    setParent(Agent * p);
 
     // Target management
-    Agent * getTarget() { return target; }
-
-    bool setTarget(Agent * t) {
-        if (t) {
-            target                    = t;
-            profile.targetedAgentName = t->profile.name;
-            profile.targetPosition    = t->profile.position;
-            return true;
-        }
-        return false;
-    }
+    Agent * getTarget() const;  // nullptr nếu không có mục tiêu hoặc mục tiêu đã bị xoá
+
+    // Đổi mục tiêu và cập nhật Simulation::engagements; t == nullptr giữ nguyên mục tiêu cũ (trả false)
+    bool setTarget(Agent * t);
+    void clearTarget();
 
     // Faction identification
     bool        isCountryA();
@@ -62,14 +48,23 @@ class Agent {
     // Soldier management
     std::vector<SoldierAgent *> getSoldiers();
     std::string                 generateSoldierSummary();
+    nlohmann::json              soldierReportInput();
 
     // Execution & combat
     nlohmann::json      execute();
+    nlohmann::json      carryForward(double engage_range);  // Không gọi LLM, xem DecisionScheduler
     std::pair<int, int> estimateCasualties(int deployedNum, double visibilityModifier, double artilleryModifier);
+    bool gatherEngagement(CombatBatch::Engagement & e, int deployedNum, double visibilityModifier,
+                          double artilleryModifier);
+
+    // Đưa trận của unit (this hoặc sub-agent) vào Simulation::combat; thương vong chốt cuối lượt.
+    // fixed_own/fixed_enemy > 0 (do LLM đưa) thay cho ước lượng; enemyLoss tính cho mục tiêu của this.
+    void queueEngagement(Agent * unit, int deployedNum, int fixed_own, int fixed_enemy, double visibilityModifier,
+                         double artilleryModifier);
 
     // Prompt generation
     std::vector<nlohmann::json> constructPrompt();
-    std::string                 summarizeHistory(int max_len = 5) const;
+    std::string                 summarizeHistory(int max_len = 5, int token_cap = 0) const;
 
     // Sub-agent management
     Agent *        spawnSubAgent(const nlohmann::json & action);
@@ -82,8 +77,9 @@ class Agent {
     // Public members
     Profile                     profile;
     Simulation *                simulation;
-    Agent *                     target;
+    AgentHandle                 self;  // Handle của chính agent, Simulation::createAgent gán
+    AgentHandle                 target;
     bool                        mergedOrPruned;
-    Agent *                     parent;
-    std::vector<nlohmann::json> history;
+    AgentHandle                 parent;
+    DecisionHistory             history;
 };
@@ -0,0 +1,174 @@
+#include "AgentSpatialHash.h"
+
+#include "Agent.h"
+
+#include <algorithm>
+#include <cmath>
+
+AgentSpatialHash::AgentSpatialHash(double cell_size) : cell_size(cell_size > 0 ? cell_size : 200.0) {}
+
+long long AgentSpatialHash::cellKey(int cx, int cy) {
+    return (static_cast<long long>(cx) << 32) ^ static_cast<unsigned int>(cy);
+}
+
+int AgentSpatialHash::cellOf(double v) const {
+    return static_cast<int>(std::floor(v / cell_size));
+}
+
+long long AgentSpatialHash::keyOf(const Position & p) const {
+    return cellKey(cellOf(p.x), cellOf(p.y));
+}
+
+void AgentSpatialHash::insert(Agent * agent) {
+    if (!agent) {
+        return;
+    }
+    if (slots.count(agent)) {
+        update(agent);
+        return;
+    }
+    const Position & p   = agent->profile.position;
+    const int        cx  = cellOf(p.x);
+    const int        cy  = cellOf(p.y);
+    const long long  key = cellKey(cx, cy);
+    cells[key].push_back(agent);
+    slots[agent] = key;
+
+    if (max_cx < min_cx) {
+        min_cx = max_cx = cx;
+        min_cy = max_cy = cy;
+    } else {
+        min_cx = std::min(min_cx, cx);
+        max_cx = std::max(max_cx, cx);
+        min_cy = std::min(min_cy, cy);
+        max_cy = std::max(max_cy, cy);
+    }
+}
+
+void AgentSpatialHash::erase(Agent * agent) {
+    auto slot = slots.find(agent);
+    if (slot == slots.end()) {
+        return;
+    }
+    auto cell = cells.find(slot->second);
+    if (cell != cells.end()) {
+        std::vector<Agent *> & bucket = cell->second;
+        auto                   it     = std::find(bucket.begin(), bucket.end(), agent);
+        if (it != bucket.end()) {
+            *it = bucket.back();
+            bucket.pop_back();
+        }
+        if (bucket.empty()) {
+            cells.erase(cell);
+        }
+    }
+    slots.erase(slot);
+}
+
+void AgentSpatialHash::update(Agent * agent) {
+    auto slot = slots.find(agent);
+    if (slot == slots.end()) {
+        return;
+    }
+    if (slot->second == keyOf(agent->profile.position)) {
+        return;  // Vẫn trong ô cũ
+    }
+    erase(agent);
+    insert(agent);
+}
+
+void AgentSpatialHash::rebuild(const std::vector<Agent *> & agents) {
+    clear();
+    for (Agent * agent : agents) {
+        insert(agent);
+    }
+}
+
+void AgentSpatialHash::clear() {
+    cells.clear();
+    slots.clear();
+    min_cx = min_cy = 0;
+    max_cx = max_cy = -1;
+}
+
+void AgentSpatialHash::within(const Position & center, double radius, std::vector<Agent *> & out) const {
+    out.clear();
+    const int x0 = cellOf(center.x - radius), x1 = cellOf(center.x + radius);
+    const int y0 = cellOf(center.y - radius), y1 = cellOf(center.y + radius);
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            auto it = cells.find(cellKey(cx, cy));
+            if (it == cells.end()) {
+                continue;
+            }
+            for (Agent * a : it->second) {
+                if (std::hypot(a->profile.position.x - center.x, a->profile.position.y - center.y) <= radius) {
+                    out.push_back(a);
+                }
+            }
+        }
+    }
+}
+
+std::vector<Agent *> AgentSpatialHash::nearest(const Position & center, size_t k, double max_range,
+                                               const Accept & accept) const {
+    std::vector<std::pair<double, Agent *>> found;
+    if (k == 0 || slots.empty()) {
+        return {};
+    }
+
+    auto before = [](const std::pair<double, Agent *> & a, const std::pair<double, Agent *> & b) {
+        return a.first != b.first ? a.first < b.first : a.second->profile.name < b.second->profile.name;
+    };
+
+    const int cx = cellOf(center.x);
+    const int cy = cellOf(center.y);
+    // Số vòng cần quét để phủ hết biên các ô có agent
+    const int max_ring = std::max({ std::abs(cx - min_cx), std::abs(cx - max_cx), std::abs(cy - min_cy),
+                                    std::abs(cy - max_cy) });
+
+    for (int r = 0; r <= max_ring; ++r) {
+        const double ring_min_dist = (r - 1) * cell_size;
+        if (ring_min_dist > max_range) {
+            break;
+        }
+        if (found.size() >= k) {
+            std::nth_element(found.begin(), found.begin() + (k - 1), found.end(), before);
+            if (found[k - 1].first <= ring_min_dist) {
+                break;
+            }
+        }
+        for (int y = cy - r; y <= cy + r; ++y) {
+            const bool edge_row = std::abs(y - cy) == r;
+            for (int x = cx - r; x <= cx + r; x += (edge_row ? 1 : 2 * r)) {
+                auto it = cells.find(cellKey(x, y));
+                if (it != cells.end()) {
+                    for (Agent * a : it->second) {
+                        double dist = std::hypot(a->profile.position.x - center.x, a->profile.position.y - center.y);
+                        if (dist <= max_range && (!accept || accept(a, dist))) {
+                            found.emplace_back(dist, a);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(found.begin(), found.end(), before);
+    std::vector<Agent *> out;
+    for (size_t i = 0; i < found.size() && i < k; ++i) {
+        out.push_back(found[i].second);
+    }
+    return out;
+}
+
+Agent * AgentSpatialHash::nearestEnemy(Agent * agent, double max_range, const Accept & accept) const {
+    if (!agent) {
+        return nullptr;
+    }
+    const bool           is_country_a = agent->isCountryA();
+    std::vector<Agent *> hit          = nearest(agent->profile.position, 1, max_range, [&](Agent * other, double dist) {
+        return other != agent && other->isCountryA() != is_country_a && (!accept || accept(other, dist));
+    });
+    return hit.empty() ? nullptr : hit.front();
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "Profile.h"
+
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+class Agent;
+
+// Lưới băm đều vị trí agent, cập nhật tăng dần khi agent được thêm/xoá/di chuyển
+// (Simulation::insertAgent/removeAgents/setAgent, Agent::execute và lệnh cho sub-agent).
+// Khoảng cách luôn tính theo vị trí hiện tại của agent; ô chỉ dùng để thu hẹp ứng viên.
+// Không lọc agent đã thua/bị gộp: người gọi tự lọc qua accept.
+class AgentSpatialHash {
+  public:
+    using Accept = std::function<bool(Agent *, double)>;  // (agent, khoảng cách)
+
+    explicit AgentSpatialHash(double cell_size = 200.0);
+
+    void   insert(Agent * agent);
+    void   erase(Agent * agent);
+    void   update(Agent * agent);  // Gọi sau khi profile.position thay đổi
+    void   rebuild(const std::vector<Agent *> & agents);
+    void   clear();
+    size_t size() const { return slots.size(); }
+
+    // Agent trong bán kính radius (không theo thứ tự); out được clear và tái sử dụng
+    void within(const Position & center, double radius, std::vector<Agent *> & out) const;
+
+    // k agent gần nhất thoả accept, trong bán kính max_range; sắp theo (khoảng cách, tên)
+    std::vector<Agent *> nearest(const Position & center, size_t k,
+                                 double max_range = std::numeric_limits<double>::infinity(),
+                                 const Accept & accept = nullptr) const;
+
+    // Địch gần nhất (khác phe theo isCountryA) thoả accept, hoặc nullptr
+    Agent * nearestEnemy(Agent * agent, double max_range = std::numeric_limits<double>::infinity(),
+                         const Accept & accept = nullptr) const;
+
+  private:
+    long long keyOf(const Position & p) const;
+    int       cellOf(double v) const;
+
+    static long long cellKey(int cx, int cy);
+
+    double                                              cell_size;
+    std::unordered_map<long long, std::vector<Agent *>> cells;
+    std::unordered_map<Agent *, long long>              slots;  // Ô hiện tại của từng agent
+
+    // Biên các ô từng có agent (chỉ nới rộng) để giới hạn vòng quét của nearest()
+    int min_cx = 0, max_cx = -1, min_cy = 0, max_cy = -1;
+};
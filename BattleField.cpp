@@ -4,6 +4,7 @@
 #include "Simulation.h"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <limits>
 
@@ -44,6 +45,10 @@ void BattleField::setTerrain(double      x,
     obj.construction_start    = 0;
     obj.construction_complete = 0;
     terrains.push_back(obj);
+    tunnel_slot.push_back(-1);
+    indexTerrain(terrains.size() - 1);
+    tactical_raster.valid = false;
+    movement.invalidate();
 }
 
 void BattleField::setTerrainName(double              x,
@@ -61,6 +66,8 @@ void BattleField::setTerrainName(double              x,
             break;
         }
     }
+    tactical_raster.valid = false;
+    movement.invalidate();
 }
 
 void BattleField::addTunnel(const Position &    start,
@@ -87,6 +94,42 @@ void BattleField::addTunnel(const Position &    start,
     obj.construction_start    = construction_start;
     obj.construction_complete = construction_complete;
     terrains.push_back(obj);
+    tunnel_slot.push_back(static_cast<int>(tunnel_geometry.size()));
+    indexTerrain(terrains.size() - 1);
+    tactical_raster.valid = false;
+    movement.invalidate();
+    tunnel_geometry.add(start, end, terrains.size() - 1);
+    tunnel_open.push_back(construction_complete <= 0 || (tunnel_round >= 0 && tunnel_round >= construction_complete));
+}
+
+long long BattleField::terrainCellKey(int cx, int cy) {
+    return (static_cast<long long>(cx) << 32) ^ static_cast<unsigned int>(cy);
+}
+
+void BattleField::indexTerrain(size_t index) {
+    const TerrainObject & obj  = terrains[index];
+    auto                  cell = [](double v) { return static_cast<int>(std::floor(v / kTerrainCellSize)); };
+
+    if (obj.type != TerrainType::Tunnel) {
+        terrain_cells[terrainCellKey(cell(obj.position.x), cell(obj.position.y))].push_back(index);
+        return;
+    }
+
+    // Raster bảo thủ: ô được nhận nếu tâm ô cách đoạn tunnel không quá nửa đường chéo ô
+    const double half_diag = kTerrainCellSize * 0.5 * std::sqrt(2.0) + 1e-6;
+    const int    x0        = cell(std::min(obj.position.x, obj.end_position.x));
+    const int    x1        = cell(std::max(obj.position.x, obj.end_position.x));
+    const int    y0        = cell(std::min(obj.position.y, obj.end_position.y));
+    const int    y1        = cell(std::max(obj.position.y, obj.end_position.y));
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            double center_x = (cx + 0.5) * kTerrainCellSize;
+            double center_y = (cy + 0.5) * kTerrainCellSize;
+            if (calculateDistanceToTunnel(obj, center_x, center_y) <= half_diag) {
+                terrain_cells[terrainCellKey(cx, cy)].push_back(index);
+            }
+        }
+    }
 }
 
 // ============================================================================
@@ -118,12 +161,30 @@ double BattleField::getAirdropSuccess() const {
 // TERRAIN QUERIES
 // ============================================================================
 
-std::vector<TerrainObject> BattleField::getTerrainObjects() const {
-    return terrains;
+void BattleField::queryTerrain(double x, double y, double radius, std::vector<size_t> & out) const {
+    out.clear();
+    const int x0 = static_cast<int>(std::floor((x - radius) / kTerrainCellSize));
+    const int x1 = static_cast<int>(std::floor((x + radius) / kTerrainCellSize));
+    const int y0 = static_cast<int>(std::floor((y - radius) / kTerrainCellSize));
+    const int y1 = static_cast<int>(std::floor((y + radius) / kTerrainCellSize));
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            auto it = terrain_cells.find(terrainCellKey(cx, cy));
+            if (it != terrain_cells.end()) {
+                out.insert(out.end(), it->second.begin(), it->second.end());
+            }
+        }
+    }
+    // Tunnel có thể nằm ở nhiều ô; giữ thứ tự chỉ số để kết quả giống hệt quét tuyến tính
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
 }
 
 TerrainType BattleField::getTerrainTypeAt(double x, double y) const {
-    for (const auto & obj : terrains) {
+    thread_local std::vector<size_t> candidates;
+    queryTerrain(x, y, 50.0, candidates);
+    for (size_t i : candidates) {
+        const TerrainObject & obj = terrains[i];
         if (obj.type == TerrainType::Tunnel) {
             double dist = calculateDistanceToTunnel(obj, x, y);
             if (dist <= 50.0) {
@@ -140,8 +201,11 @@ TerrainObject * BattleField::getTerrainObject(double x, double y) const {
     TerrainObject * nearest      = nullptr;
     double          min_distance = std::numeric_limits<double>::max();
 
-    for (const auto & obj : terrains) {
-        double distance;
+    thread_local std::vector<size_t> candidates;
+    queryTerrain(x, y, 100.0, candidates);
+    for (size_t i : candidates) {
+        const TerrainObject & obj = terrains[i];
+        double                distance;
 
         if (obj.type == TerrainType::Tunnel) {
             distance = calculateDistanceToTunnel(obj, x, y);
@@ -259,23 +323,187 @@ int BattleField::countUnitsInTunnel(const TerrainObject & tunnel, Agent * agent)
 // TACTICAL EVALUATION
 // ============================================================================
 
+// ============================================================================
+// AGENT HOOKS & TUNNEL OCCUPANCY
+// ============================================================================
+
+static bool isActiveAgent(const Agent * agent) {
+    return agent && !agent->mergedOrPruned && agent->profile.currentStage != "Crushing Defeat" &&
+           agent->profile.currentStage != "Fleeing Off the Map";
+}
+
+void BattleField::onAgentAdded(Agent * agent) {
+    agentIndex.insert(agent);
+    onAgentMoved(agent);
+}
+
+void BattleField::onAgentMoved(Agent * agent) {
+    agentIndex.update(agent);
+    if (tunnel_round < 0 || !agent) {
+        return;
+    }
+
+    const int tunnel = isActiveAgent(agent) ? locateTunnel(agent) : -1;
+    auto      it     = tunnel_membership.find(agent);
+    if (it != tunnel_membership.end() && static_cast<int>(it->second.tunnel) == tunnel) {
+        it->second.troops = agent->profile.remainingNumOfTroops();  // Vẫn trong tunnel cũ, giữ thứ tự vào
+        admitTunnel(it->second.tunnel);
+        return;
+    }
+    leaveTunnel(agent);
+    if (tunnel >= 0) {
+        enterTunnel(agent, static_cast<size_t>(tunnel));
+    }
+}
+
+void BattleField::onAgentRemoved(Agent * agent) {
+    agentIndex.erase(agent);
+    leaveTunnel(agent);
+}
+
+int BattleField::firstTunnelWithin(const double * d2) const {
+    const double buffer2 = tunnel_buffer * tunnel_buffer;
+    for (size_t k = 0; k < tunnel_geometry.size(); ++k) {
+        if (tunnel_open[k] && d2[k] <= buffer2) {
+            return static_cast<int>(tunnel_geometry.terrainIndex(k));
+        }
+    }
+    return -1;
+}
+
+int BattleField::locateTunnel(const Agent * agent) const {
+    if (tunnel_geometry.size() == 0) {
+        return -1;
+    }
+    const double px      = agent->profile.position.x;
+    const double py      = agent->profile.position.y;
+    const double buffer2 = tunnel_buffer * tunnel_buffer;
+
+    // Lưới terrain đã gắn tunnel vào mọi ô đoạn thẳng đi qua, nên tunnel cách điểm <= tunnel_buffer
+    // luôn nằm trong kết quả; ứng viên sắp theo chỉ số terrains → cùng tunnel với firstTunnelWithin
+    thread_local std::vector<size_t> candidates;
+    queryTerrain(px, py, tunnel_buffer, candidates);
+    for (size_t i : candidates) {
+        const int k = tunnel_slot[i];
+        if (k >= 0 && tunnel_open[k] && tunnel_geometry.distanceSq(k, px, py) <= buffer2) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void BattleField::enterTunnel(Agent * agent, size_t tunnel) {
+    TunnelMembership m;
+    m.tunnel                 = static_cast<size_t>(tunnel);
+    m.troops                 = agent->profile.remainingNumOfTroops();
+    tunnel_membership[agent] = m;
+    tunnel_occupants[m.tunnel].push_back(agent);
+    admitTunnel(m.tunnel);
+}
+
+void BattleField::leaveTunnel(const Agent * agent) {
+    auto it = tunnel_membership.find(agent);
+    if (it == tunnel_membership.end()) {
+        return;
+    }
+    const size_t                 tunnel    = it->second.tunnel;
+    std::vector<const Agent *> & occupants = tunnel_occupants[tunnel];
+    occupants.erase(std::remove(occupants.begin(), occupants.end(), agent), occupants.end());
+    tunnel_membership.erase(it);
+    admitTunnel(tunnel);
+}
+
+void BattleField::admitTunnel(size_t tunnel) {
+    const int power      = terrains[tunnel].power;
+    int       cumulative = 0;
+    bool      full       = false;
+    for (const Agent * occupant : tunnel_occupants[tunnel]) {
+        TunnelMembership & m = tunnel_membership[occupant];
+        if (power <= 0) {
+            m.admitted = true;
+            continue;
+        }
+        // Nhận theo thứ tự vào; đơn vị đầu tiên làm tràn sức chứa chặn tất cả đơn vị vào sau
+        cumulative += m.troops;
+        full       = full || cumulative > power;
+        m.admitted = !full;
+    }
+}
+
+void BattleField::refreshTunnelOccupancy(const std::vector<Agent *> & agents, int round, double buffer) {
+    tunnel_occupants.clear();
+    tunnel_membership.clear();
+    tunnel_round  = round;
+    tunnel_buffer = buffer;
+
+    tunnel_open.assign(tunnel_geometry.size(), 0);
+    for (size_t k = 0; k < tunnel_geometry.size(); ++k) {
+        const TerrainObject & obj = terrains[tunnel_geometry.terrainIndex(k)];
+        tunnel_open[k]            = obj.construction_complete <= 0 || round >= obj.construction_complete;
+    }
+    if (tunnel_geometry.size() == 0) {
+        return;
+    }
+
+    // Tính khoảng cách theo khối agent × toàn bộ tunnel, giữ thứ tự vào theo danh sách agents
+    constexpr size_t            kBlock = 64;
+    std::array<Agent *, kBlock> block;
+    std::array<double, kBlock>  px, py;
+    std::vector<double>         d2(kBlock * tunnel_geometry.size());
+    size_t                      n = 0;
+
+    auto flush = [&]() {
+        tunnel_geometry.distanceSqBatch(px.data(), py.data(), n, d2.data());
+        for (size_t i = 0; i < n; ++i) {
+            int tunnel = firstTunnelWithin(d2.data() + i * tunnel_geometry.size());
+            if (tunnel >= 0) {
+                enterTunnel(block[i], static_cast<size_t>(tunnel));
+            }
+        }
+        n = 0;
+    };
+    for (Agent * agent : agents) {
+        if (!isActiveAgent(agent)) {
+            continue;
+        }
+        block[n] = agent;
+        px[n]    = agent->profile.position.x;
+        py[n]    = agent->profile.position.y;
+        if (++n == kBlock) {
+            flush();
+        }
+    }
+    if (n > 0) {
+        flush();
+    }
+}
+
+const TerrainObject * BattleField::occupiedTunnel(const Agent * agent) const {
+    auto it = tunnel_membership.find(agent);
+    return it != tunnel_membership.end() && it->second.admitted ? &terrains[it->second.tunnel] : nullptr;
+}
+
+const TerrainObject * BattleField::overflowTunnel(const Agent * agent) const {
+    auto it = tunnel_membership.find(agent);
+    return it != tunnel_membership.end() && !it->second.admitted ? &terrains[it->second.tunnel] : nullptr;
+}
+
 bool BattleField::isInTunnel(Agent * agent, double tunnel_dist, int current_round) const {
     if (!agent) {
         return false;
     }
 
+    // Đường nhanh: tra sổ chiếm dụng của lượt hiện tại
+    if (tunnel_round >= 0 && tunnel_dist <= 0 && (current_round < 0 || current_round == tunnel_round)) {
+        return occupiedTunnel(agent) != nullptr;
+    }
+
     if (tunnel_dist < 0) {
         tunnel_dist = 0.0;
     }
 
-    // Get tunnel buffer from config
-    double tunnel_buffer = 50.0;
-    if (agent->simulation && agent->simulation->config.contains("actionPropertyDefinition")) {
-        nlohmann::json action_defs = agent->simulation->config["actionPropertyDefinition"];
-        if (action_defs.contains("Move to Tunnel") && action_defs["Move to Tunnel"].contains("tunnel_buffer")) {
-            tunnel_buffer = action_defs["Move to Tunnel"]["tunnel_buffer"].get<double>();
-        }
-    }
+    // Tunnel buffer đã đọc sẵn lúc nạp kịch bản (ModifierTables)
+    const double tunnel_buffer = agent->simulation ? agent->simulation->modifiers.tunnelBuffer() : 50.0;
 
     // Use agent's round if not specified
     if (current_round < 0) {
@@ -290,7 +518,7 @@ bool BattleField::isInTunnel(Agent * agent, double tunnel_dist, int current_roun
         // ✅ CHECK: Tunnel construction status
         if (obj.construction_complete > 0 && current_round < obj.construction_complete) {
             if (agent->simulation) {
-                agent->simulation->logger.debug(current_round)
+                LOG_DEBUG(agent->simulation->logger, current_round)
                     << "Tunnel " << obj.name << " not yet complete (round " << current_round << " < "
                     << obj.construction_complete << ")";
             }
@@ -315,7 +543,7 @@ bool BattleField::isInTunnel(Agent * agent, double tunnel_dist, int current_roun
             }
 
             if (agent->simulation) {
-                agent->simulation->logger.debug(current_round) << "Agent " << agent->profile.name << " in tunnel "
+                LOG_DEBUG(agent->simulation->logger, current_round) << "Agent " << agent->profile.name << " in tunnel "
                                                                << obj.name << " (stealth=" << obj.stealth_bonus << ")";
             }
 
@@ -338,7 +566,10 @@ bool BattleField::isEnemyWithin(Agent * agent, double distance) const {
     double      effective_distance = distance * visibilityModifier;
     std::string faction            = agent->getFaction();
 
-    for (auto * other_agent : agent->simulation->getAgents()) {
+    // Stealth chỉ làm tầm phát hiện ngắn lại nên ứng viên nằm trong effective_distance
+    thread_local std::vector<Agent *> nearby;
+    agentIndex.within(agent->profile.position, effective_distance, nearby);
+    for (auto * other_agent : nearby) {
         if (!other_agent || other_agent->mergedOrPruned || other_agent->profile.currentStage == "Crushing Defeat" ||
             other_agent->profile.currentStage == "Fleeing Off the Map") {
             continue;
@@ -355,16 +586,13 @@ bool BattleField::isEnemyWithin(Agent * agent, double distance) const {
 
         // Apply stealth factor if enemy in tunnel
         double enemy_stealth_factor = 1.0;
-        if (isInTunnel(other_agent, 0.0)) {
-            TerrainObject * tunnel = getTerrainObject(other_agent->profile.position.x, other_agent->profile.position.y);
-            if (tunnel && tunnel->type == TerrainType::Tunnel) {
-                enemy_stealth_factor = 1.0 - tunnel->stealth_bonus;
-            }
+        if (const TerrainObject * tunnel = occupiedTunnel(other_agent)) {
+            enemy_stealth_factor = 1.0 - tunnel->stealth_bonus;
         }
 
         if (dist <= effective_distance * enemy_stealth_factor) {
             if (agent->simulation) {
-                agent->simulation->logger.debug(agent->profile.roundNb)
+                LOG_DEBUG(agent->simulation->logger, agent->profile.roundNb)
                     << "Enemy " << other_agent->profile.name << " detected at distance " << static_cast<int>(dist);
             }
             return true;
@@ -374,17 +602,20 @@ bool BattleField::isEnemyWithin(Agent * agent, double distance) const {
     return false;
 }
 
-double BattleField::evaluateTacticalUse(Agent * agent) const {
-    if (!agent) {
-        return 1.0;
+// Phần điểm chiến thuật chỉ phụ thuộc vị trí (chưa cộng tunnel bonus, chưa clamp).
+// step (nếu có) nhận riêng phần bậc thang power * 0.5 của tunnel, không liên tục ở mép bán kính.
+double BattleField::terrainInfluenceAt(double x, double y, double * step) const {
+    if (step) {
+        *step = 0.0;
     }
-
     double tactical_score   = 100.0;
     double influence_radius = 150.0;
 
-    for (const auto & terrain : terrains) {
-        double dist =
-            std::hypot(agent->profile.position.x - terrain.position.x, agent->profile.position.y - terrain.position.y);
+    thread_local std::vector<size_t> candidates;
+    queryTerrain(x, y, influence_radius, candidates);
+    for (size_t i : candidates) {
+        const TerrainObject & terrain = terrains[i];
+        double                dist    = std::hypot(x - terrain.position.x, y - terrain.position.y);
 
         if (dist > influence_radius) {
             continue;
@@ -435,10 +666,23 @@ double BattleField::evaluateTacticalUse(Agent * agent) const {
                 tactical_score += terrain.defense_bonus * 1.5 * proximity;
                 tactical_score += terrain.stealth_bonus * 120 * proximity;
                 tactical_score += terrain.power * 0.5;
+                if (step) {
+                    *step += terrain.power * 0.5;
+                }
                 break;
         }
     }
 
+    return tactical_score;
+}
+
+double BattleField::evaluateTacticalUseExact(Agent * agent) const {
+    if (!agent) {
+        return 1.0;
+    }
+
+    double tactical_score = terrainInfluenceAt(agent->profile.position.x, agent->profile.position.y);
+
     // Bonus if in tunnel
     if (isInTunnel(agent, 0.0)) {
         tactical_score += 150;
@@ -448,6 +692,118 @@ double BattleField::evaluateTacticalUse(Agent * agent) const {
     return clamped_score / 100.0;
 }
 
+double BattleField::evaluateTacticalUse(Agent * agent) const {
+    if (!agent) {
+        return 1.0;
+    }
+
+    double tactical_score = 0.0;
+    if (!sampleTacticalRaster(agent->profile.position.x, agent->profile.position.y, tactical_score)) {
+        return evaluateTacticalUseExact(agent);  // Raster chưa dựng / ngoài biên
+    }
+    if (isInTunnel(agent, 0.0)) {
+        tactical_score += 150;
+    }
+    double score = std::clamp(tactical_score, 10.0, 500.0) / 100.0;
+
+    if (tactical_raster.validate) {
+        double exact = evaluateTacticalUseExact(agent);
+        double error = std::abs(score - exact);
+        {
+            std::lock_guard<std::mutex> lock(tactical_mutex);
+            tactical_max_error = std::max(tactical_max_error, error);
+        }
+        if (error > tactical_raster.tolerance && agent->simulation) {
+            agent->simulation->logger.warn(agent->profile.roundNb)
+                << "Tactical raster error " << error << " at [" << agent->profile.position.x << ","
+                << agent->profile.position.y << "] (raster " << score << ", exact " << exact << ")";
+        }
+    }
+    return score;
+}
+
+// ============================================================================
+// TACTICAL RASTER
+// ============================================================================
+
+void BattleField::configureTacticalRaster(double cell_size, bool validate, double tolerance) {
+    tactical_raster.cell      = cell_size > 0 ? cell_size : 10.0;
+    tactical_raster.validate  = validate;
+    tactical_raster.tolerance = tolerance;
+    tactical_raster.valid     = false;
+}
+
+void BattleField::ensureTacticalRaster() {
+    TacticalRaster & r = tactical_raster;
+    if (r.valid && r.width == width && r.height == height) {
+        return;
+    }
+
+    r.width    = width;
+    r.height   = height;
+    r.origin_x = -width / 2.0;
+    r.origin_y = -height / 2.0;
+    r.cols     = static_cast<int>(std::ceil(width / r.cell)) + 1;
+    r.rows     = static_cast<int>(std::ceil(height / r.cell)) + 1;
+    if (r.cols < 2 || r.rows < 2) {
+        r.valid = false;
+        return;
+    }
+    r.values.assign(static_cast<size_t>(r.cols) * r.rows, 0.0);
+    std::vector<double> steps(r.values.size(), 0.0);
+    for (int j = 0; j < r.rows; ++j) {
+        for (int i = 0; i < r.cols; ++i) {
+            const size_t n = static_cast<size_t>(j) * r.cols + i;
+            r.values[n]    = terrainInfluenceAt(r.origin_x + i * r.cell, r.origin_y + j * r.cell, &steps[n]);
+        }
+    }
+
+    // Ô có 4 góc khác nhau về phần bậc thang nằm trên mép bán kính tunnel: nội suy sẽ sai lớn,
+    // nên các ô này luôn dùng bản chính xác
+    r.exact_cells.assign(static_cast<size_t>(r.cols - 1) * (r.rows - 1), 0);
+    for (int j = 0; j + 1 < r.rows; ++j) {
+        for (int i = 0; i + 1 < r.cols; ++i) {
+            const size_t n = static_cast<size_t>(j) * r.cols + i;
+            const double s = steps[n];
+            r.exact_cells[static_cast<size_t>(j) * (r.cols - 1) + i] =
+                s != steps[n + 1] || s != steps[n + r.cols] || s != steps[n + r.cols + 1];
+        }
+    }
+    r.valid = true;
+}
+
+bool BattleField::sampleTacticalRaster(double x, double y, double & out) const {
+    const TacticalRaster & r = tactical_raster;
+    if (!r.valid || r.width != width || r.height != height) {
+        return false;
+    }
+    const double gx = (x - r.origin_x) / r.cell;
+    const double gy = (y - r.origin_y) / r.cell;
+    if (gx < 0 || gy < 0 || gx > r.cols - 1 || gy > r.rows - 1) {
+        return false;
+    }
+
+    // Nội suy song tuyến từ 4 mẫu quanh điểm
+    const int    i   = std::min(static_cast<int>(gx), r.cols - 2);
+    const int    j   = std::min(static_cast<int>(gy), r.rows - 2);
+    if (r.exact_cells[static_cast<size_t>(j) * (r.cols - 1) + i]) {
+        return false;
+    }
+    const double fx  = gx - i;
+    const double fy  = gy - j;
+    const double v00 = r.values[static_cast<size_t>(j) * r.cols + i];
+    const double v10 = r.values[static_cast<size_t>(j) * r.cols + i + 1];
+    const double v01 = r.values[static_cast<size_t>(j + 1) * r.cols + i];
+    const double v11 = r.values[static_cast<size_t>(j + 1) * r.cols + i + 1];
+    out              = (v00 * (1 - fx) + v10 * fx) * (1 - fy) + (v01 * (1 - fx) + v11 * fx) * fy;
+    return true;
+}
+
+double BattleField::tacticalRasterMaxError() const {
+    std::lock_guard<std::mutex> lock(tactical_mutex);
+    return tactical_max_error;
+}
+
 // ============================================================================
 // POSITION VALIDATION
 // ============================================================================
@@ -475,11 +831,16 @@ bool BattleField::isValidPosition(double x, double y) const {
     return true;
 }
 
+Position BattleField::advance(const Position & from, const Position & desired, double budget) {
+    return movement.advance(*this, from, desired, budget);
+}
+
 // ============================================================================
 // SITUATION GENERATION
 // ============================================================================
 
 std::string BattleField::generateBattlefieldSituation(Agent * agent) const {
+    ScopedTimer timer("situation");
     nlohmann::json situation;
 
     try {
@@ -512,32 +873,14 @@ std::string BattleField::generateBattlefieldSituation(Agent * agent) const {
             return situation.dump(2);
         }
 
-        // Generate agent-specific situation
-        Position    pos         = agent->profile.position;
-        TerrainType terrainType = getTerrainTypeAt(pos.x, pos.y);
-
-        situation["local_terrain"] = terrainTypeToString(terrainType);
-        situation["in_tunnel"]     = isInTunnel(agent, 0.0);
-        situation["weather"]       = getWeather();
-
-        // Find nearest terrain feature
-        TerrainObject * nearest = getTerrainObject(pos.x, pos.y);
-        if (nearest) {
-            double distance;
-            if (nearest->type == TerrainType::Tunnel) {
-                distance = calculateDistanceToTunnel(*nearest, pos.x, pos.y);
-            } else {
-                distance = std::hypot(pos.x - nearest->position.x, pos.y - nearest->position.y);
-            }
-
-            situation["nearby_feature"] = {
-                {"name",           nearest->name                     },
-                { "type",          terrainTypeToString(nearest->type)},
-                { "distance",      static_cast<int>(distance)        },
-                { "defense_bonus", nearest->defense_bonus            }
-            };
+        // Dùng world snapshot của lượt nếu có (view được memo hoá)
+        if (snapshot.valid && agent->simulation) {
+            return situationFromSnapshot(agent);
         }
 
+        // Generate agent-specific situation
+        situation = agentSituationHeader(agent);
+
         // Forces information
         nlohmann::json allied  = nlohmann::json::array();
         nlohmann::json enemy   = nlohmann::json::array();
@@ -566,11 +909,7 @@ std::string BattleField::generateBattlefieldSituation(Agent * agent) const {
         situation["allied_forces"] = allied;
         situation["enemy_forces"]  = enemy;
 
-        // Tactical evaluation
-        double tactical_score       = evaluateTacticalUse(agent);
-        situation["tactical_score"] = tactical_score;
-
-        return situation.dump(2);
+        return situation.dump();
 
     } catch (const std::exception & e) {
         if (agent && agent->simulation) {
@@ -581,6 +920,231 @@ std::string BattleField::generateBattlefieldSituation(Agent * agent) const {
     }
 }
 
+// Phần view chỉ phụ thuộc vào chính agent: địa hình, tunnel, thời tiết, điểm chiến thuật
+nlohmann::json BattleField::agentSituationHeader(Agent * agent) const {
+    nlohmann::json situation;
+    Position       pos         = agent->profile.position;
+    TerrainType    terrainType = getTerrainTypeAt(pos.x, pos.y);
+
+    situation["local_terrain"] = terrainTypeToString(terrainType);
+    situation["in_tunnel"]     = isInTunnel(agent, 0.0);
+    situation["weather"]       = getWeather();
+
+    // Find nearest terrain feature
+    TerrainObject * nearest = getTerrainObject(pos.x, pos.y);
+    if (nearest) {
+        double distance;
+        if (nearest->type == TerrainType::Tunnel) {
+            distance = calculateDistanceToTunnel(*nearest, pos.x, pos.y);
+        } else {
+            distance = std::hypot(pos.x - nearest->position.x, pos.y - nearest->position.y);
+        }
+
+        situation["nearby_feature"] = {
+            {"name",           nearest->name                     },
+            { "type",          terrainTypeToString(nearest->type)},
+            { "distance",      static_cast<int>(distance)        },
+            { "defense_bonus", nearest->defense_bonus            }
+        };
+    }
+
+    // Tactical evaluation
+    situation["tactical_score"] = evaluateTacticalUse(agent);
+    return situation;
+}
+
+// ============================================================================
+// WORLD SNAPSHOT
+// ============================================================================
+
+void BattleField::buildSnapshot(const std::vector<Agent *> & agents, int turn) {
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    snapshot.turn  = turn;
+    snapshot.valid = true;
+    snapshot.agents.clear();
+    snapshot.agents.reserve(agents.size());
+    snapshot.situation_views.clear();
+    snapshot.weather = getWeather();
+
+    for (auto * other : agents) {
+        if (!other || other->mergedOrPruned || other->profile.currentStage == "Crushing Defeat" ||
+            other->profile.currentStage == "Fleeing Off the Map") {
+            continue;
+        }
+
+        AgentSnapshot a;
+        a.agent          = other;
+        a.name           = other->profile.name;
+        a.faction        = other->getFaction();
+        a.position       = other->profile.position;
+        a.troops         = other->profile.remainingNumOfTroops();
+        a.moral          = other->profile.getMoralString();
+        a.stealth_factor = 1.0;
+        // Cùng luật stealth như isEnemyWithin: đơn vị trong tunnel khó bị phát hiện hơn
+        if (const TerrainObject * tunnel = occupiedTunnel(other)) {
+            a.stealth_factor = 1.0 - tunnel->stealth_bonus;
+        }
+        a.json = nlohmann::json{
+            {"name",      a.name                         },
+            { "position", { a.position.x, a.position.y }},
+            { "troops",   a.troops                       },
+            { "moral",    a.moral                        }
+        }.dump();
+        snapshot.agents.push_back(std::move(a));
+    }
+
+    // Lưới đều phủ toàn bản đồ; ô bằng nửa tầm phát hiện để truy vấn chỉ chạm vài ô
+    snapshot.cell_size = std::max(50.0, situationConfig.detection_range * 0.5);
+    snapshot.origin_x  = -width / 2;
+    snapshot.origin_y  = -height / 2;
+    snapshot.cols      = std::max(1, static_cast<int>(std::ceil(width / snapshot.cell_size)));
+    snapshot.rows      = std::max(1, static_cast<int>(std::ceil(height / snapshot.cell_size)));
+    snapshot.cells.assign(static_cast<size_t>(snapshot.cols) * snapshot.rows, {});
+    for (size_t i = 0; i < snapshot.agents.size(); ++i) {
+        const Position & p  = snapshot.agents[i].position;
+        int              cx = std::clamp(static_cast<int>((p.x - snapshot.origin_x) / snapshot.cell_size), 0, snapshot.cols - 1);
+        int              cy = std::clamp(static_cast<int>((p.y - snapshot.origin_y) / snapshot.cell_size), 0, snapshot.rows - 1);
+        snapshot.cells[static_cast<size_t>(cy) * snapshot.cols + cx].push_back(i);
+    }
+}
+
+void BattleField::invalidateSnapshot() {
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    snapshot.valid = false;
+    snapshot.situation_views.clear();
+}
+
+std::vector<size_t> BattleField::nearestInSnapshot(
+    const Position & from, size_t k, double max_range,
+    const std::function<bool(const AgentSnapshot &, double)> & accept) const {
+    std::vector<std::pair<double, size_t>> found;
+    if (k == 0 || snapshot.cells.empty()) {
+        return {};
+    }
+
+    const double cell = snapshot.cell_size;
+    const int    cx   = std::clamp(static_cast<int>((from.x - snapshot.origin_x) / cell), 0, snapshot.cols - 1);
+    const int    cy   = std::clamp(static_cast<int>((from.y - snapshot.origin_y) / cell), 0, snapshot.rows - 1);
+    const int    max_ring = std::max(snapshot.cols, snapshot.rows);
+
+    // Quét theo vòng ô quanh (cx, cy); dừng khi vòng kế tiếp chắc chắn xa hơn kết quả thứ k
+    for (int r = 0; r <= max_ring; ++r) {
+        const double ring_min_dist = (r - 1) * cell;
+        if (ring_min_dist > max_range) {
+            break;
+        }
+        if (found.size() >= k) {
+            std::nth_element(found.begin(), found.begin() + (k - 1), found.end());
+            if (found[k - 1].first <= ring_min_dist) {
+                break;
+            }
+        }
+        for (int y = cy - r; y <= cy + r; ++y) {
+            if (y < 0 || y >= snapshot.rows) {
+                continue;
+            }
+            for (int x = cx - r; x <= cx + r; ++x) {
+                if (x < 0 || x >= snapshot.cols || (std::abs(x - cx) != r && std::abs(y - cy) != r)) {
+                    continue;
+                }
+                for (size_t i : snapshot.cells[static_cast<size_t>(y) * snapshot.cols + x]) {
+                    const AgentSnapshot & a = snapshot.agents[i];
+                    double dist = std::hypot(a.position.x - from.x, a.position.y - from.y);
+                    if (dist <= max_range && accept(a, dist)) {
+                        found.emplace_back(dist, i);
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+    if (found.size() > k) {
+        found.resize(k);
+    }
+    std::vector<size_t> out;
+    out.reserve(found.size());
+    for (const auto & f : found) {
+        out.push_back(f.second);
+    }
+    return out;
+}
+
+double BattleField::nearestEnemyDistance(Agent * agent) const {
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    if (!snapshot.valid) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    const std::string   faction = agent->getFaction();
+    const Position      pos     = agent->profile.position;
+    const double        vision  = situationConfig.detection_range * visibilityModifier;
+    std::vector<size_t> nearest = nearestInSnapshot(pos, 1, vision, [&](const AgentSnapshot & a, double dist) {
+        return a.faction != faction && dist <= vision * a.stealth_factor;
+    });
+    if (nearest.empty()) {
+        return std::numeric_limits<double>::infinity();
+    }
+    const AgentSnapshot & e = snapshot.agents[nearest.front()];
+    return std::hypot(e.position.x - pos.x, e.position.y - pos.y);
+}
+
+std::string BattleField::situationFromSnapshot(Agent * agent) const {
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    auto                        it = snapshot.situation_views.find(agent->profile.name);
+    if (it != snapshot.situation_views.end()) {
+        return it->second;
+    }
+
+    const std::string faction = agent->getFaction();
+    const Position    pos     = agent->profile.position;
+    const double      vision  = situationConfig.detection_range * visibilityModifier;
+
+    // Đồng minh: k đơn vị gần nhất (liên lạc được, không cần phát hiện)
+    size_t allies_total = 0;
+    for (const auto & a : snapshot.agents) {
+        if (a.faction == faction && a.name != agent->profile.name) {
+            ++allies_total;
+        }
+    }
+    std::vector<size_t> allies = nearestInSnapshot(
+        pos, situationConfig.max_allies, std::numeric_limits<double>::max(),
+        [&](const AgentSnapshot & a, double) { return a.faction == faction && a.name != agent->profile.name; });
+
+    // Địch: chỉ những đơn vị phát hiện được (tầm nhìn thời tiết × stealth tunnel), k gần nhất
+    size_t              enemies_detected = 0;
+    std::vector<size_t> enemies          = nearestInSnapshot(
+        pos, std::numeric_limits<size_t>::max(), vision, [&](const AgentSnapshot & a, double dist) {
+            return a.faction != faction && dist <= vision * a.stealth_factor;
+        });
+    enemies_detected = enemies.size();
+    if (enemies.size() > situationConfig.max_enemies) {
+        enemies.resize(situationConfig.max_enemies);
+    }
+
+    auto join = [&](const std::vector<size_t> & ids) {
+        std::string out = "[";
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (i) {
+                out += ",";
+            }
+            out += snapshot.agents[ids[i]].json;
+        }
+        return out + "]";
+    };
+
+    // Ghép header của agent với các entry đã dump sẵn
+    nlohmann::json header             = agentSituationHeader(agent);
+    header["allied_units_total"]      = allies_total;
+    header["enemy_units_detected"]    = enemies_detected;
+    header["detection_range"]         = static_cast<int>(vision);
+    std::string view                  = header.dump();
+    view.pop_back();
+    view += ",\"allied_forces\":" + join(allies) + ",\"enemy_forces\":" + join(enemies) + "}";
+
+    return snapshot.situation_views.emplace(agent->profile.name, std::move(view)).first->second;
+}
+
 std::string BattleField::generateCompactSituation(Agent * agent) const {
     if (!agent) {
         return "{}";
@@ -603,24 +1167,16 @@ std::string BattleField::generateCompactSituation(Agent * agent) const {
     // Find nearest enemies
     nlohmann::json enemies = nlohmann::json::array();
     std::string    faction = agent->getFaction();
-    int            count   = 0;
-
-    for (auto * other : agent->simulation->getAgents()) {
-        if (count >= 2 || !other || other->mergedOrPruned || other->getFaction() == faction ||
-            other->profile.currentStage == "Crushing Defeat") {
-            continue;
-        }
 
+    for (auto * other : agentIndex.nearest(pos, 2, 800, [&](Agent * a, double) {
+             return !a->mergedOrPruned && a->getFaction() != faction && a->profile.currentStage != "Crushing Defeat";
+         })) {
         double dist = std::hypot(pos.x - other->profile.position.x, pos.y - other->profile.position.y);
-
-        if (dist <= 800) {
-            enemies.push_back({
-                {"name",      other->profile.name                  },
-                { "troops",   other->profile.remainingNumOfTroops()},
-                { "distance", static_cast<int>(dist)               }
-            });
-            count++;
-        }
+        enemies.push_back({
+            {"name",      other->profile.name                  },
+            { "troops",   other->profile.remainingNumOfTroops()},
+            { "distance", static_cast<int>(dist)               }
+        });
     }
 
     compact["enemies"] = enemies;
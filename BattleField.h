@@ -1,8 +1,15 @@
 #pragma once
+#include "AgentSpatialHash.h"
+#include "MovementEngine.h"
 #include "nlohmann/json.hpp"
 #include "Profile.h"
+#include "TunnelGeometry.h"
 
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 enum class TerrainType { Flat, Hills, Valley, River, Forest, Stronghold, Airfield, Tunnel };
@@ -41,6 +48,43 @@ struct TerrainObject {
         construction_complete(0) {}
 };
 
+// Trạng thái một agent tại đầu lượt (bất biến trong lượt)
+struct AgentSnapshot {
+    Agent *     agent;
+    std::string name;
+    std::string faction;
+    Position    position;
+    int         troops;
+    std::string moral;
+    double      stealth_factor;  // 1 - stealth_bonus nếu đang trong tunnel, ngược lại 1
+    std::string json;            // {"moral","name","position","troops"} đã dump compact sẵn
+};
+
+// Giới hạn báo cáo tình hình: chỉ k đơn vị gần nhất, địch phải nằm trong tầm phát hiện
+struct SituationConfig {
+    size_t max_allies      = 6;
+    size_t max_enemies     = 6;
+    double detection_range = 800.0;  // Nhân với visibilityModifier và stealth của địch
+};
+
+// Ảnh chụp thế giới dựng một lần mỗi lượt; view tình hình của từng agent là phép chiếu
+// từ ảnh chụp này và được memo hoá tới lượt sau.
+struct WorldSnapshot {
+    int                                   turn  = -1;
+    bool                                  valid = false;
+    std::vector<AgentSnapshot>            agents;
+    nlohmann::json                        weather;
+
+    // Lưới đều chỉ số agent theo vị trí đầu lượt, phục vụ truy vấn k-nearest
+    double                                cell_size = 400.0;
+    double                                origin_x  = 0.0;
+    double                                origin_y  = 0.0;
+    int                                   cols      = 0;
+    int                                   rows      = 0;
+    std::vector<std::vector<size_t>>      cells;
+    std::map<std::string, std::string>    situation_views;  // theo tên agent
+};
+
 class BattleField {
   public:
     BattleField(double width, double height);
@@ -83,9 +127,13 @@ class BattleField {
     double getAirdropSuccess() const;
 
     // Terrain queries
-    std::vector<TerrainObject> getTerrainObjects() const;
-    TerrainType                getTerrainTypeAt(double x, double y) const;
-    TerrainObject *            getTerrainObject(double x, double y) const;
+    const std::vector<TerrainObject> & getTerrainObjects() const { return terrains; }
+    TerrainType                        getTerrainTypeAt(double x, double y) const;
+    TerrainObject *                    getTerrainObject(double x, double y) const;
+
+    // Chỉ số (tăng dần, không trùng) các terrain có thể nằm trong bán kính radius quanh (x, y),
+    // lấy từ lưới băm; người gọi vẫn phải lọc bằng khoảng cách thật. out được clear và tái sử dụng.
+    void queryTerrain(double x, double y, double radius, std::vector<size_t> & out) const;
     double                     getSpeedMultiplier(TerrainType type) const;
     int                        getHealthBonus(TerrainType type) const;
     int                        getLossPenalty(TerrainType type) const;
@@ -93,18 +141,52 @@ class BattleField {
     // Position validation
     bool isValidPosition(double x, double y) const;
 
+    // Di chuyển có giới hạn: từ from về phía desired với quãng đường budget (xem MovementEngine)
+    Position advance(const Position & from, const Position & desired, double budget);
+
+    // Hook vị trí/danh sách agent: cập nhật agentIndex và sổ tunnel
+    void onAgentAdded(Agent * agent);
+    void onAgentMoved(Agent * agent);
+    void onAgentRemoved(Agent * agent);
+
+    // Sổ chiếm dụng tunnel: dựng lại đầu mỗi lượt, cập nhật tăng dần khi agent vào/ra.
+    // Mỗi agent thuộc tunnel đã xây xong đầu tiên trong phạm vi buffer; trong một tunnel, agent được
+    // nhận theo thứ tự vào chừng nào tổng quân còn <= power (power <= 0: không giới hạn).
+    void                  refreshTunnelOccupancy(const std::vector<Agent *> & agents, int round, double buffer);
+    const TerrainObject * occupiedTunnel(const Agent * agent) const;  // Tunnel đã nhận agent, hoặc nullptr
+    const TerrainObject * overflowTunnel(const Agent * agent) const;  // Tunnel agent đứng trong nhưng đã đầy
+
     // Tactical evaluation
     bool   isInTunnel(Agent * agent, double tunnel_dist = 0.0, int current_round = -1) const;
     bool   isEnemyWithin(Agent * agent, double distance) const;
-    double evaluateTacticalUse(Agent * agent) const;
+    double evaluateTacticalUse(Agent * agent) const;       // Lấy mẫu raster, fallback về bản chính xác
+    double evaluateTacticalUseExact(Agent * agent) const;  // Quét terrain trực tiếp
+
+    // Raster điểm chiến thuật: lưới mẫu terrainInfluenceAt trên toàn bản đồ, lấy mẫu song tuyến.
+    // Dựng lúc nạp kịch bản, tự mất hiệu lực khi terrain/kích thước bản đồ đổi (ensure dựng lại).
+    // validate: mỗi lần lấy mẫu so với bản chính xác, cảnh báo khi lệch quá tolerance.
+    void   configureTacticalRaster(double cell_size, bool validate = false, double tolerance = 0.1);
+    void   ensureTacticalRaster();
+    double tacticalRasterMaxError() const;
 
     // Situation generation
     std::string generateBattlefieldSituation(Agent * agent = nullptr) const;
     std::string generateCompactSituation(Agent * agent) const;
 
+    // World snapshot: dựng ở đầu mỗi lượt, generateBattlefieldSituation dùng nó khi còn hiệu lực
+    void                  buildSnapshot(const std::vector<Agent *> & agents, int turn);
+    void                  invalidateSnapshot();
+    const WorldSnapshot & getSnapshot() const { return snapshot; }
+
+    // Khoảng cách tới địch gần nhất phát hiện được trong snapshot (infinity nếu không có)
+    double nearestEnemyDistance(Agent * agent) const;
+
     // Public members
     double                     width;
     double                     height;
+    SituationConfig            situationConfig;
+    AgentSpatialHash           agentIndex;  // Vị trí agent hiện tại (khác snapshot đầu lượt)
+    MovementEngine             movement;    // Lưới chi phí + flow field, mất hiệu lực khi terrain đổi
     std::vector<TerrainObject> terrains;
     std::string                currentWeather;
 
@@ -113,6 +195,69 @@ class BattleField {
     double artilleryModifier;
     double speedModifier;
 
+    mutable WorldSnapshot snapshot;
+    mutable std::mutex    snapshot_mutex;
+
+    // Lưới băm đều chỉ số terrain: điểm nằm ở một ô, tunnel được raster vào mọi ô đoạn thẳng đi qua.
+    // Cập nhật tăng dần trong setTerrain/addTunnel (terrain không đổi hình học sau khi thêm).
+    static constexpr double                            kTerrainCellSize = 100.0;
+    std::unordered_map<long long, std::vector<size_t>> terrain_cells;
+
+    void             indexTerrain(size_t index);
+    static long long terrainCellKey(int cx, int cy);
+
+    struct TacticalRaster {
+        bool                valid     = false;
+        bool                validate  = false;
+        double              tolerance = 0.1;
+        double              cell      = 10.0;
+        double              width     = 0;  // Kích thước bản đồ lúc dựng
+        double              height    = 0;
+        double              origin_x  = 0;
+        double              origin_y  = 0;
+        int                 cols      = 0;
+        int                 rows      = 0;
+        std::vector<double> values;       // 100 + ảnh hưởng terrain tại mỗi nút lưới
+        std::vector<char>   exact_cells;  // Ô cắt mép bán kính tunnel: không nội suy
+    };
+
+    TacticalRaster     tactical_raster;
+    mutable double     tactical_max_error = 0.0;
+    mutable std::mutex tactical_mutex;
+
+    double terrainInfluenceAt(double x, double y, double * step = nullptr) const;
+    bool   sampleTacticalRaster(double x, double y, double & out) const;
+
+    struct TunnelMembership {
+        size_t tunnel   = 0;  // Chỉ số trong terrains
+        int    troops   = 0;
+        bool   admitted = false;
+    };
+
+    std::unordered_map<size_t, std::vector<const Agent *>> tunnel_occupants;  // Theo thứ tự vào
+    std::unordered_map<const Agent *, TunnelMembership>    tunnel_membership;
+    int                                                    tunnel_round  = -1;  // -1: chưa dựng sổ
+    double                                                 tunnel_buffer = 50.0;
+    TunnelGeometry                                         tunnel_geometry;
+    std::vector<char>                                      tunnel_open;  // Theo slot geometry, xây xong ở tunnel_round
+    std::vector<int>                                       tunnel_slot;  // Theo terrains: slot geometry, -1 nếu không phải tunnel
+
+    // Tunnel mở đầu tiên (theo thứ tự terrains) cách điểm không quá tunnel_buffer; d2 là một hàng
+    // kết quả của tunnel_geometry.distanceSqBatch
+    int  firstTunnelWithin(const double * d2) const;
+    // Cùng kết quả cho một agent, nhưng chỉ tính khoảng cách tới các tunnel lưới terrain trả về quanh vị trí
+    int  locateTunnel(const Agent * agent) const;
+    void enterTunnel(Agent * agent, size_t tunnel);
+    void leaveTunnel(const Agent * agent);
+    void admitTunnel(size_t tunnel);
+
+    nlohmann::json agentSituationHeader(Agent * agent) const;
+    std::string    situationFromSnapshot(Agent * agent) const;
+
+    // k agent gần nhất trong snapshot thoả accept(entry, distance), bán kính tối đa max_range
+    std::vector<size_t> nearestInSnapshot(const Position & from, size_t k, double max_range,
+                                          const std::function<bool(const AgentSnapshot &, double)> & accept) const;
+
     // Helper functions
     std::string terrainTypeToString(TerrainType type) const;
     double      calculateDistanceToTunnel(const TerrainObject & tunnel, double x, double y) const;
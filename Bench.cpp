@@ -0,0 +1,456 @@
+// Benchmark target cho BattleAgent.
+//
+//   llama-battleagent-bench mock   [mock options] [--duration-s N]
+//       Chạy mock server OpenAI-compatible độc lập (để đo CPU client tách biệt).
+//
+//   llama-battleagent-bench server [--url URL] [--requests N] [--concurrency 1,2,4,8]
+//                                  [--scenario scenario.json] [--out result.json] [mock options]
+//       Đo throughput, tail latency và CPU overhead của client server-mode (LLMInference::infer)
+//       khi tăng concurrency. Nếu không có --url sẽ tự chạy mock server trong process.
+//
+//   llama-battleagent-bench combat [--rows N] [--units N] [--iterations N] [--steps N] [--seed N] [--out FILE]
+//       So sánh bộ giải thương vong Ratio (estimateCasualties) và Lanchester (sub-step) trên cùng batch
+//       giao chiến tổng hợp: thời gian resolve mỗi hàng và tổng thương vong hai phía.
+//
+// Mock options: --port N --ttft-ms N --token-ms N --chars-per-token N --error-rate F
+//               --stall-rate F --stall-ms N --seed N --canned FILE
+#include "CombatBatch.h"
+#include "LLMInference.h"
+#include "MockLLMServer.h"
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#    define NOMINMAX
+#    include <windows.h>
+#else
+#    include <sys/resource.h>
+#endif
+
+using json = nlohmann::json;
+
+// CPU time của cả process (user + kernel), millisecond
+static double processCpuMs() {
+#ifdef _WIN32
+    FILETIME creation, exit_time, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit_time, &kernel, &user);
+    auto to_ms = [](const FILETIME & ft) {
+        ULARGE_INTEGER v;
+        v.LowPart  = ft.dwLowDateTime;
+        v.HighPart = ft.dwHighDateTime;
+        return static_cast<double>(v.QuadPart) / 10000.0;
+    };
+    return to_ms(kernel) + to_ms(user);
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 + usage.ru_stime.tv_sec * 1000.0 +
+           usage.ru_stime.tv_usec / 1000.0;
+#endif
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t idx = static_cast<size_t>(std::ceil(p / 100.0 * values.size()));
+    idx        = std::clamp<size_t>(idx, 1, values.size()) - 1;
+    return values[idx];
+}
+
+static void print_usage(const char * prog_name) {
+    std::cerr << "\nUsage:\n"
+              << "  " << prog_name << " mock   [--port N] [--duration-s N] [mock options]\n"
+              << "  " << prog_name
+              << " server [--url URL] [--requests N] [--concurrency 1,2,4,8] [--scenario FILE] [--out FILE]"
+                 " [mock options]\n"
+              << "  " << prog_name << " combat [--rows N] [--units N] [--iterations N] [--steps N] [--seed N] [--out FILE]\n"
+              << "Mock options: --ttft-ms N --token-ms N --chars-per-token N --error-rate F --stall-rate F"
+                 " --stall-ms N --seed N --canned FILE\n";
+}
+
+// Đọc các tham số dạng --key value thành JSON để MockServerConfig::fromJson xử lý
+static json parseArgs(int argc, char ** argv, int first) {
+    json args = json::object();
+    for (int i = first; i < argc; ++i) {
+        std::string key = argv[i];
+        if (key.rfind("--", 0) != 0 || i + 1 >= argc) {
+            throw std::runtime_error("Invalid argument: " + key);
+        }
+        key = key.substr(2);
+        std::replace(key.begin(), key.end(), '-', '_');
+        args[key] = argv[++i];
+    }
+    return args;
+}
+
+static MockServerConfig mockConfigFromArgs(const json & args) {
+    json mock = json::object();
+    auto num  = [&](const char * arg, const char * key, bool is_float) {
+        if (args.contains(arg)) {
+            const std::string v = args[arg].get<std::string>();
+            mock[key]           = is_float ? json(std::stod(v)) : json(std::stoi(v));
+        }
+    };
+    num("port", "port", false);
+    num("ttft_ms", "ttft_ms", false);
+    num("token_ms", "token_latency_ms", false);
+    num("chars_per_token", "chars_per_token", false);
+    num("error_rate", "error_rate", true);
+    num("stall_rate", "stall_rate", true);
+    num("stall_ms", "stall_ms", false);
+    num("seed", "seed", false);
+    if (args.contains("canned")) {
+        std::ifstream     f(args["canned"].get<std::string>());
+        std::stringstream ss;
+        ss << f.rdbuf();
+        mock["canned_response"] = ss.str();
+    }
+    return MockServerConfig::fromJson(mock);
+}
+
+static int runMock(const json & args) {
+    MockServerConfig config = mockConfigFromArgs(args);
+    if (config.port == 0) {
+        config.port = 8080;
+    }
+    MockLLMServer server(config);
+    if (!server.start()) {
+        return 1;
+    }
+    std::cout << "Mock LLM server listening on " << server.url() << "/v1/chat/completions\n";
+
+    int duration_s = args.contains("duration_s") ? std::stoi(args["duration_s"].get<std::string>()) : 0;
+    if (duration_s > 0) {
+        std::this_thread::sleep_for(std::chrono::seconds(duration_s));
+    } else {
+        std::cout << "Press Enter to stop.\n";
+        std::string line;
+        std::getline(std::cin, line);
+    }
+
+    MockServerStats st = server.stats();
+    std::cout << "Served " << st.requests << " requests (" << st.errors << " injected errors, " << st.stalls
+              << " injected stalls)\n";
+    server.stop();
+    return 0;
+}
+
+// Prompt mẫu: nếu có scenario thì dùng system block + schema thật, ngược lại dùng prompt ngắn
+static void buildBenchPrompt(const json & args, std::vector<json> & prompts, json & response_format) {
+    std::string system_text = "You are a tactical decision-making AI. Return JSON only.";
+    std::string user_text   = "You are **Bench_Unit**. Round 1. Choose the next action.";
+    response_format         = "";
+
+    if (args.contains("scenario")) {
+        std::ifstream f(args["scenario"].get<std::string>());
+        json          scenario;
+        f >> scenario;
+        std::stringstream system_ss;
+        system_ss << "SystemPrompt: " << scenario.value("prompt", "") << "\n";
+        system_ss << "actionList:\n" << scenario["actionList"].dump() << "\n";
+        system_ss << "actionPropertyDefinition:\n" << scenario["actionPropertyDefinition"].dump() << "\n";
+        system_ss << "stagePropertyDefinition:\n" << scenario["stagePropertyDefinition"].dump() << "\n";
+        system_ss << "definitionOfJsonKeys:\n" << scenario["definitionOfJsonKeys"].dump() << "\n";
+        system_ss << "actionInstructionBlock:\n" << scenario["actionInstructionBlock"].dump() << "\n";
+        system_text = system_ss.str();
+        if (scenario.contains("jsonConstraintVariable")) {
+            response_format = scenario["jsonConstraintVariable"];
+        }
+    }
+
+    prompts = {
+        { { "role", "system" }, { "content", system_text } },
+        { { "role", "user" }, { "content", user_text } }
+    };
+}
+
+static int runServerBench(const json & args) {
+    std::unique_ptr<MockLLMServer> mock;
+    std::string                    url;
+    if (args.contains("url")) {
+        url = args["url"].get<std::string>();
+    } else {
+        mock = std::make_unique<MockLLMServer>(mockConfigFromArgs(args));
+        if (!mock->start()) {
+            return 1;
+        }
+        url = mock->url();
+    }
+
+    int              total_requests = args.contains("requests") ? std::stoi(args["requests"].get<std::string>()) : 64;
+    std::vector<int> levels;
+    {
+        std::string       spec = args.contains("concurrency") ? args["concurrency"].get<std::string>() : "1,2,4,8,16";
+        std::stringstream ss(spec);
+        std::string       item;
+        while (std::getline(ss, item, ',')) {
+            if (!item.empty()) {
+                levels.push_back(std::max(1, std::stoi(item)));
+            }
+        }
+    }
+
+    std::vector<json> prompts;
+    json              response_format;
+    buildBenchPrompt(args, prompts, response_format);
+
+    std::cout << "Benchmarking " << url << " with " << total_requests << " requests per level"
+              << (mock ? " (in-process mock: CPU includes server threads)" : "") << "\n\n";
+    std::cout << std::left << std::setw(6) << "conc" << std::setw(10) << "ok" << std::setw(10) << "failed"
+              << std::setw(12) << "req/s" << std::setw(12) << "p50 ms" << std::setw(12) << "p95 ms" << std::setw(12)
+              << "p99 ms" << std::setw(12) << "max ms" << std::setw(14) << "cpu ms/req" << "cpu util\n";
+
+    json results = json::array();
+    for (int concurrency : levels) {
+        // Mỗi worker có LLMInference riêng: log stream của LLMInference không an toàn giữa nhiều thread
+        std::vector<std::unique_ptr<LLMInference>> clients;
+        for (int i = 0; i < concurrency; ++i) {
+            clients.push_back(std::make_unique<LLMInference>(url));
+        }
+
+        std::vector<std::vector<double>> latencies(concurrency);
+        std::atomic<int>                 next_request{ 0 };
+        std::atomic<int>                 n_ok{ 0 }, n_failed{ 0 };
+
+        const double cpu_start  = processCpuMs();
+        const auto   wall_start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> workers;
+        for (int w = 0; w < concurrency; ++w) {
+            workers.emplace_back([&, w]() {
+                while (next_request.fetch_add(1) < total_requests) {
+                    auto        t0     = std::chrono::steady_clock::now();
+                    std::string result = clients[w]->infer(prompts, response_format);
+                    auto        t1     = std::chrono::steady_clock::now();
+                    latencies[w].push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+
+                    bool ok = false;
+                    try {
+                        json j = json::parse(result);
+                        ok     = !j.contains("error");
+                    } catch (...) {
+                    }
+                    (ok ? n_ok : n_failed).fetch_add(1);
+                }
+            });
+        }
+        for (auto & t : workers) {
+            t.join();
+        }
+
+        const double wall_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+        const double cpu_ms = processCpuMs() - cpu_start;
+
+        std::vector<double> all;
+        for (const auto & l : latencies) {
+            all.insert(all.end(), l.begin(), l.end());
+        }
+
+        json level = {
+            { "concurrency",        concurrency                                },
+            { "ok",                 n_ok.load()                                },
+            { "failed",             n_failed.load()                            },
+            { "wall_ms",            wall_ms                                    },
+            { "throughput_rps",     all.size() * 1000.0 / std::max(wall_ms, 1.0)},
+            { "latency_p50_ms",     percentile(all, 50)                        },
+            { "latency_p95_ms",     percentile(all, 95)                        },
+            { "latency_p99_ms",     percentile(all, 99)                        },
+            { "latency_max_ms",     percentile(all, 100)                       },
+            { "cpu_ms",             cpu_ms                                     },
+            { "cpu_ms_per_request", cpu_ms / std::max<size_t>(all.size(), 1)   },
+            { "cpu_utilization",    cpu_ms / std::max(wall_ms, 1.0)            }
+        };
+        results.push_back(level);
+
+        std::cout << std::left << std::fixed << std::setprecision(1) << std::setw(6) << concurrency << std::setw(10)
+                  << n_ok.load() << std::setw(10) << n_failed.load() << std::setw(12)
+                  << level["throughput_rps"].get<double>() << std::setw(12) << level["latency_p50_ms"].get<double>()
+                  << std::setw(12) << level["latency_p95_ms"].get<double>() << std::setw(12)
+                  << level["latency_p99_ms"].get<double>() << std::setw(12) << level["latency_max_ms"].get<double>()
+                  << std::setw(14) << std::setprecision(2) << level["cpu_ms_per_request"].get<double>()
+                  << std::setprecision(2) << level["cpu_utilization"].get<double>() << "\n";
+    }
+
+    if (mock) {
+        MockServerStats st = mock->stats();
+        std::cout << "\nMock server: " << st.requests << " requests, " << st.errors << " injected errors, " << st.stalls
+                  << " injected stalls\n";
+        mock->stop();
+    }
+
+    if (args.contains("out")) {
+        std::ofstream out(args["out"].get<std::string>());
+        out << json{ { "url", url }, { "requests_per_level", total_requests }, { "levels", results } }.dump(2);
+    }
+    return 0;
+}
+
+// Batch giao chiến tổng hợp: hệ số lấy trong khoảng mà Agent::gatherEngagement sinh ra.
+// resolve() chỉ dùng con trỏ agent làm khoá nên đơn vị là các ô trong một mảng byte.
+static void buildCombatBatch(CombatBatch & batch, std::vector<char> & units, size_t rows, size_t n_units,
+                             unsigned seed) {
+    std::mt19937                           rng(seed);
+    std::uniform_real_distribution<double> u01(0.0, 1.0);
+    auto                                   pick = [&](std::initializer_list<double> values) {
+        return *(values.begin() + rng() % values.size());
+    };
+
+    units.assign(std::max<size_t>(n_units, 2), 0);
+    std::vector<int> troops(units.size());
+    for (auto & t : troops) {
+        t = 200 + static_cast<int>(rng() % 4800);
+    }
+
+    const size_t half = units.size() / 2;
+    for (size_t i = 0; i < rows; ++i) {
+        const size_t a = rng() % half;                          // Phe A
+        const size_t v = half + rng() % (units.size() - half);  // Phe B
+
+        CombatBatch::Engagement e;
+        e.owner          = reinterpret_cast<Agent *>(&units[a]);
+        e.attacker       = e.owner;
+        e.victim         = reinterpret_cast<Agent *>(&units[v]);
+        e.estimate       = true;
+        e.attacker_avail = troops[a];
+        e.defender_avail = troops[v];
+        e.deployed       = std::max(1, static_cast<int>(troops[a] * (0.3 + 0.7 * u01(rng))));
+        e.att_eff        = (1.0 + u01(rng)) * pick({ 0.8, 1.0, 1.3 });
+        e.def_eff        = 1.0 + u01(rng);
+        e.att_morale     = pick({ 0.8, 1.0, 1.2 });
+        e.def_morale     = pick({ 0.8, 1.0, 1.2 });
+        e.att_tactical   = 100.0 + 100.0 * u01(rng);
+        e.def_tactical   = 100.0 + 100.0 * u01(rng);
+        e.terrain_att    = pick({ 1.0, 1.15, 1.2, 1.3, 1.4 });
+        e.terrain_def    = pick({ 0.65, 0.8, 0.85, 1.0 });
+        e.tunnel_att     = pick({ 0.5, 1.0, 1.0, 1.0 });
+        e.tunnel_def     = pick({ 0.5, 1.0, 1.0, 1.0 });
+        e.action_mod     = pick({ 0.65, 0.7, 0.75, 0.8, 1.0, 1.35, 1.5, 1.8 });
+        e.artillery      = 0.3 + 1.2 * u01(rng);
+        e.visibility     = 0.5 + 0.5 * u01(rng);
+        e.coeff          = 0.08;
+        batch.add(e);
+    }
+}
+
+static int runCombatBench(const json & args) {
+    auto arg_int = [&](const char * key, int def) {
+        return args.contains(key) ? std::stoi(args[key].get<std::string>()) : def;
+    };
+    const size_t rows       = static_cast<size_t>(std::max(1, arg_int("rows", 4096)));
+    const size_t n_units    = static_cast<size_t>(std::max(2, arg_int("units", static_cast<int>(rows / 4))));
+    const int    iterations = std::max(1, arg_int("iterations", 200));
+    const int    steps      = std::max(1, arg_int("steps", 8));
+    const int    seed       = arg_int("seed", 42);
+
+    CombatBatch       batch;
+    std::vector<char> units;
+    buildCombatBatch(batch, units, rows, n_units, static_cast<unsigned>(seed));
+
+    std::cout << "Combat resolve: " << rows << " engagements, " << units.size() << " units, " << iterations
+              << " iterations\n\n";
+    std::cout << std::left << std::setw(16) << "resolver" << std::setw(14) << "ns/row" << std::setw(14) << "own loss"
+              << std::setw(14) << "enemy loss" << "mean |d own| / |d enemy| vs ratio\n";
+
+    struct Run {
+        std::string           name;
+        CombatBatch::Resolver resolver;
+        int                   steps;
+    };
+    const std::vector<Run> runs = {
+        { "ratio",                                   CombatBatch::Resolver::Ratio,      1     },
+        { "lanchester/" + std::to_string(steps),     CombatBatch::Resolver::Lanchester, steps },
+        { "lanchester/" + std::to_string(steps * 4), CombatBatch::Resolver::Lanchester, steps * 4 },
+    };
+
+    json             results = json::array();
+    std::vector<int> ratio_own, ratio_enemy;
+    for (const Run & run : runs) {
+        batch.configure(run.resolver, run.steps);
+        batch.resolve();  // Warm-up
+
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int it = 0; it < iterations; ++it) {
+            batch.resolve();
+        }
+        const double ns_per_row =
+            std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / iterations / rows;
+
+        long long own = 0, enemy = 0;
+        double    d_own = 0, d_enemy = 0;
+        for (size_t i = 0; i < rows; ++i) {
+            own += batch.ownLoss(i);
+            enemy += batch.enemyLoss(i);
+            if (run.resolver == CombatBatch::Resolver::Ratio) {
+                ratio_own.push_back(batch.ownLoss(i));
+                ratio_enemy.push_back(batch.enemyLoss(i));
+            } else {
+                d_own += std::abs(batch.ownLoss(i) - ratio_own[i]);
+                d_enemy += std::abs(batch.enemyLoss(i) - ratio_enemy[i]);
+            }
+        }
+        d_own /= rows;
+        d_enemy /= rows;
+
+        std::cout << std::left << std::fixed << std::setprecision(1) << std::setw(16) << run.name << std::setw(14)
+                  << ns_per_row << std::setw(14) << own << std::setw(14) << enemy << d_own << " / " << d_enemy
+                  << "\n";
+        results.push_back({
+            { "resolver",         run.name   },
+            { "ns_per_row",       ns_per_row },
+            { "own_loss",         own        },
+            { "enemy_loss",       enemy      },
+            { "mean_abs_d_own",   d_own      },
+            { "mean_abs_d_enemy", d_enemy    }
+        });
+    }
+
+    if (args.contains("out")) {
+        std::ofstream out(args["out"].get<std::string>());
+        out << json{ { "rows", rows }, { "units", units.size() }, { "iterations", iterations }, { "runs", results } }
+                   .dump(2);
+    }
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        std::string mode = argv[1];
+        json        args = parseArgs(argc, argv, 2);
+        if (mode == "mock") {
+            return runMock(args);
+        }
+        if (mode == "server") {
+            return runServerBench(args);
+        }
+        if (mode == "combat") {
+            return runCombatBench(args);
+        }
+    } catch (const std::exception & e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    print_usage(argv[0]);
+    return 1;
+}
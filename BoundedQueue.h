@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Hàng đợi vòng dung lượng cố định, nhiều producer / nhiều consumer, không khoá (thuật toán của D. Vyukov):
+// mỗi ô có số thứ tự riêng nên producer và consumer chỉ tranh chấp một phép CAS trên vị trí đầu/cuối.
+// Khác RingBuffer: đầy thì tryPush trả false (không ghi đè), người gọi tự chọn bỏ hay chờ.
+// Dung lượng làm tròn lên luỹ thừa của 2, bộ nhớ cấp phát một lần lúc khởi tạo.
+template <typename T> class BoundedQueue {
+  public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        mask  = n - 1;
+        cells = std::make_unique<Cell[]>(n);
+        for (size_t i = 0; i < n; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue &)             = delete;
+    BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+    bool tryPush(T && value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &         cell = cells[pos & mask];
+            const size_t   seq  = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Đầy
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T & out) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &         cell = cells[pos & mask];
+            const size_t   seq  = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Rỗng
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Xấp xỉ khi có producer/consumer đang chạy
+    size_t size() const {
+        const size_t head = dequeue_pos.load(std::memory_order_relaxed);
+        const size_t tail = enqueue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence{ 0 };
+        T                   value{};
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t                  mask = 0;
+
+    alignas(64) std::atomic<size_t> enqueue_pos{ 0 };
+    alignas(64) std::atomic<size_t> dequeue_pos{ 0 };
+};
@@ -0,0 +1,251 @@
+#include "CombatBatch.h"
+
+#include "Agent.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Số thương vong từ giá trị thực: NaN/âm → 0, chặn trên bởi cap trước khi ép kiểu (tránh UB khi ép inf/NaN sang int)
+static int toLoss(double value, double cap) {
+    if (!(value > 0)) {
+        return 0;
+    }
+    return static_cast<int>(std::min(value, std::max(cap, 0.0)));
+}
+
+// Tinh thần dùng làm mẫu số 1.0 / morale: phải hữu hạn và dương
+static bool usableMorale(double morale) {
+    return std::isfinite(morale) && morale > 0;
+}
+
+size_t CombatBatch::add(const Engagement & e) {
+    owner.push_back(e.owner);
+    attacker.push_back(e.attacker);
+    victim.push_back(e.victim);
+    estimate.push_back(e.estimate ? 1 : 0);
+    fixed_own.push_back(e.fixed_own);
+    fixed_enemy.push_back(e.fixed_enemy);
+    deployed.push_back(e.deployed);
+    attacker_avail.push_back(e.attacker_avail);
+    defender_avail.push_back(e.defender_avail);
+    att_eff.push_back(e.att_eff);
+    def_eff.push_back(e.def_eff);
+    att_morale.push_back(e.att_morale);
+    def_morale.push_back(e.def_morale);
+    att_tactical.push_back(e.att_tactical);
+    def_tactical.push_back(e.def_tactical);
+    terrain_att.push_back(e.terrain_att);
+    terrain_def.push_back(e.terrain_def);
+    tunnel_att.push_back(e.tunnel_att);
+    tunnel_def.push_back(e.tunnel_def);
+    action_mod.push_back(e.action_mod);
+    artillery.push_back(e.artillery);
+    visibility.push_back(e.visibility);
+    coeff.push_back(e.coeff);
+    return owner.size() - 1;
+}
+
+void CombatBatch::clear() {
+    forEachColumn([](auto & column) { column.clear(); });
+    ratio.clear();
+    own_loss.clear();
+    enemy_loss.clear();
+}
+
+CombatBatch CombatBatch::extract(const Agent * agent) {
+    CombatBatch part;
+    part.configure(mode, sub_steps);
+    if (!agent || empty()) {
+        return part;
+    }
+    std::vector<char> take(size(), 0);
+    bool              any = false;
+    for (size_t i = 0; i < size(); ++i) {
+        if (owner[i] == agent || attacker[i] == agent || victim[i] == agent) {
+            take[i] = 1;
+            any     = true;
+        }
+    }
+    if (!any) {
+        return part;
+    }
+    // Lanchester: pool quân số của phần tách ra chỉ gồm các trận của agent này
+    part = *this;
+    part.keepRows(take);
+    for (char & t : take) {
+        t = !t;
+    }
+    keepRows(take);
+    return part;
+}
+
+void CombatBatch::keepRows(const std::vector<char> & keep) {
+    forEachColumn([&](auto & column) {
+        size_t kept = 0;
+        for (size_t i = 0; i < keep.size(); ++i) {
+            if (keep[i]) {
+                column[kept++] = column[i];
+            }
+        }
+        column.resize(kept);
+    });
+    ratio.clear();  // Cần resolve() lại
+    own_loss.clear();
+    enemy_loss.clear();
+}
+
+void CombatBatch::configure(Resolver resolver, int steps) {
+    mode      = resolver;
+    sub_steps = std::max(1, steps);
+}
+
+void CombatBatch::resolve() {
+    const size_t n = size();
+    ratio.assign(n, 0.0);
+    own_loss.assign(n, 0);
+    enemy_loss.assign(n, 0);
+    if (mode == Resolver::Lanchester) {
+        resolveLanchester();
+    } else {
+        resolveRatio();
+    }
+}
+
+void CombatBatch::resolveRatio() {
+    const size_t n = size();
+
+    // Kernel: cùng công thức và thứ tự phép tính với Agent::estimateCasualties (bước 7-14),
+    // không rẽ nhánh theo agent nên mỗi hàng độc lập
+    for (size_t i = 0; i < n; ++i) {
+        const double att_power = deployed[i] * att_eff[i] * att_morale[i] * att_tactical[i];
+        const double def_power = defender_avail[i] * def_eff[i] * def_morale[i] * def_tactical[i];
+        const bool   valid     = estimate[i] && att_power > 0 && def_power > 0 && usableMorale(att_morale[i]) &&
+                           usableMorale(def_morale[i]);
+        const double r = valid ? std::clamp(att_power / (att_power + def_power), 0.05, 0.95) : 0.0;
+
+        int est_own   = 0;
+        int est_enemy = 0;
+        if (valid) {
+            est_own   = toLoss(deployed[i] * coeff[i] * (1.0 - r) * terrain_att[i] * visibility[i] * tunnel_att[i] *
+                                   (1.0 / att_morale[i]) * action_mod[i],
+                               attacker_avail[i]);
+            est_enemy = toLoss(defender_avail[i] * coeff[i] * r * terrain_def[i] * artillery[i] *
+                                   (1.0 / def_morale[i]) * action_mod[i],
+                               defender_avail[i]);
+        }
+
+        ratio[i]      = r;
+        own_loss[i]   = fixed_own[i] > 0 ? fixed_own[i] : est_own;
+        enemy_loss[i] = victim[i] ? (fixed_enemy[i] > 0 ? fixed_enemy[i] : est_enemy) : 0;
+    }
+}
+
+void CombatBatch::resolveLanchester() {
+    const size_t n = size();
+
+    // Pool quân số theo agent (con trỏ chỉ dùng làm khoá), khởi tạo từ quân số lúc gom
+    std::unordered_map<const Agent *, int> slot_of;
+    std::vector<double>                    pool;
+    auto                                   slotFor = [&](const Agent * a, double avail) {
+        auto [it, inserted] = slot_of.emplace(a, static_cast<int>(pool.size()));
+        if (inserted) {
+            pool.push_back(avail);
+        } else {
+            pool[it->second] = std::max(pool[it->second], avail);
+        }
+        return it->second;
+    };
+    slot_of.reserve(2 * n);
+    pool.reserve(2 * n);
+
+    // Hệ số hao mòn mỗi hàng: cùng các hệ số địa hình/tunnel/tinh thần/pháo binh như Ratio,
+    // thêm tunnel_def (công thức Ratio bỏ qua) vào phía defender
+    std::vector<double> alpha(n, 0.0), beta(n, 0.0), strength(n, 0.0);
+    std::vector<int>    a_slot(n, -1), v_slot(n, -1);
+    for (size_t i = 0; i < n; ++i) {
+        const double sa = att_eff[i] * att_morale[i] * att_tactical[i];
+        const double sd = def_eff[i] * def_morale[i] * def_tactical[i];
+        if (!estimate[i] || !attacker[i] || !victim[i] || deployed[i] <= 0 || defender_avail[i] <= 0 || sa <= 0 ||
+            sd <= 0 || !usableMorale(att_morale[i]) || !usableMorale(def_morale[i])) {
+            continue;
+        }
+        const double share = std::clamp(sa / (sa + sd), 0.05, 0.95);
+        ratio[i]           = share;
+        alpha[i] = coeff[i] * share * terrain_def[i] * tunnel_def[i] * artillery[i] * (1.0 / def_morale[i]) *
+                   action_mod[i];
+        beta[i]  = coeff[i] * (1.0 - share) * terrain_att[i] * visibility[i] * tunnel_att[i] *
+                  (1.0 / att_morale[i]) * action_mod[i];
+        a_slot[i] = slotFor(attacker[i], attacker_avail[i]);
+        v_slot[i] = slotFor(victim[i], defender_avail[i]);
+    }
+
+    const std::vector<double> pool0 = pool;
+    std::vector<double>       engaged(pool.size()), damage(pool.size());
+    std::vector<double>       own_acc(n, 0.0), enemy_acc(n, 0.0);
+    const double              dt = 1.0 / sub_steps;
+
+    for (int step = 0; step < sub_steps; ++step) {
+        std::fill(engaged.begin(), engaged.end(), 0.0);
+        std::fill(damage.begin(), damage.end(), 0.0);
+
+        // Sức mạnh attacker giảm theo tỉ lệ pool còn lại
+        for (size_t i = 0; i < n; ++i) {
+            if (a_slot[i] < 0) {
+                continue;
+            }
+            const int a = a_slot[i];
+            strength[i] = pool0[a] > 0 ? deployed[i] * pool[a] / pool0[a] : 0.0;
+            engaged[v_slot[i]] += strength[i];
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (a_slot[i] < 0) {
+                continue;
+            }
+            const int    v         = v_slot[i];
+            const double defenders = engaged[v] > 0 ? pool[v] * strength[i] / engaged[v] : 0.0;
+            const double to_victim = dt * alpha[i] * strength[i];
+            const double to_self   = dt * beta[i] * defenders;
+            enemy_acc[i] += to_victim;
+            own_acc[i] += to_self;
+            damage[v] += to_victim;
+            damage[a_slot[i]] += to_self;
+        }
+        for (size_t k = 0; k < pool.size(); ++k) {
+            pool[k] = std::max(0.0, pool[k] - damage[k]);
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const int est_own   = toLoss(own_acc[i], attacker_avail[i]);
+        const int est_enemy = toLoss(enemy_acc[i], defender_avail[i]);
+        own_loss[i]         = fixed_own[i] > 0 ? fixed_own[i] : est_own;
+        enemy_loss[i]       = victim[i] ? (fixed_enemy[i] > 0 ? fixed_enemy[i] : est_enemy) : 0;
+    }
+}
+
+void CombatBatch::commit() {
+    if (own_loss.size() != size()) {
+        resolve();
+    }
+
+    // Cộng dồn trước rồi mới takeDamage: min(tổng, còn lại) giống áp lần lượt, nhưng không phụ thuộc thứ tự
+    std::unordered_map<Agent *, int> damage;
+    std::vector<Agent *>             order;  // Thứ tự xuất hiện đầu tiên, để log ổn định
+    auto                             credit = [&](Agent * a, int loss) {
+        if (!a || loss <= 0) {
+            return;
+        }
+        auto [it, inserted] = damage.emplace(a, 0);
+        if (inserted) {
+            order.push_back(a);
+        }
+        it->second += loss;
+    };
+    for (size_t i = 0; i < size(); ++i) {
+        credit(attacker[i], own_loss[i]);
+        credit(victim[i], enemy_loss[i]);
+    }
+    for (Agent * a : order) {
+        a->profile.takeDamage(damage[a]);
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+class Agent;
+
+// Các trận giao chiến của một lượt, gom dạng structure-of-arrays rồi giải một lần:
+//  - Agent::execute/carryForward chỉ thu thập hệ số (gatherEngagement) và add() vào batch,
+//    không gọi takeDamage giữa lượt → kết quả không phụ thuộc thứ tự duyệt agent.
+//  - resolve(): kernel số học thuần trên các mảng, các hàng độc lập nhau (có thể chia luồng/vector hoá).
+//  - commit(): cộng dồn thương vong theo agent rồi takeDamage một lần cho mỗi agent.
+//
+// Hai bộ giải (battle_config.combat_resolver):
+//  - Ratio: công thức tỉ lệ sức mạnh một bước của estimateCasualties.
+//  - Lanchester: tích phân phương trình hao mòn bậc hai dA/dt = -β·D, dD/dt = -α·A qua sub_steps bước
+//    cho mọi trận cùng lúc; quân số mỗi agent là một pool dùng chung giữa các trận nó tham gia,
+//    hoả lực của defender chia theo sức mạnh các attacker đang đánh nó.
+class CombatBatch {
+  public:
+    enum class Resolver { Ratio, Lanchester };
+
+    // Một hàng đầu vào; các hệ số giống hệt các bước trong Agent::estimateCasualties
+    struct Engagement {
+        Agent * owner    = nullptr;  // Agent ra quyết định (ghi lịch sử)
+        Agent * attacker = nullptr;  // Đơn vị chịu ownLoss (owner hoặc sub-agent)
+        Agent * victim   = nullptr;  // Đơn vị chịu enemyLoss (mục tiêu của owner)
+        bool    estimate = false;    // false: chỉ dùng fixed_own/fixed_enemy
+
+        int fixed_own   = 0;  // Giá trị LLM đưa ra; > 0 thì thay cho ước lượng
+        int fixed_enemy = 0;
+
+        int    deployed       = 0;
+        int    attacker_avail = 0;
+        int    defender_avail = 0;
+        double att_eff        = 1.0;
+        double def_eff        = 1.0;
+        double att_morale     = 1.0;
+        double def_morale     = 1.0;
+        double att_tactical   = 1.0;
+        double def_tactical   = 1.0;
+        double terrain_att    = 1.0;
+        double terrain_def    = 1.0;
+        double tunnel_att     = 1.0;
+        double tunnel_def     = 1.0;
+        double action_mod     = 1.0;
+        double artillery      = 1.0;
+        double visibility     = 1.0;
+        double coeff          = 0.08;
+    };
+
+    void     configure(Resolver resolver, int sub_steps = 8);
+    Resolver resolver() const { return mode; }
+    int      subSteps() const { return sub_steps; }
+
+    size_t add(const Engagement & e);
+    void   clear();
+    // Tách các hàng tham chiếu agent (owner/attacker/victim) ra batch riêng cùng bộ giải và bỏ khỏi batch này:
+    // agent sắp bị xoá khỏi simulation thì phần thương vong của nó được resolve + commit trước, không bị mất
+    CombatBatch extract(const Agent * agent);
+
+    size_t size() const { return owner.size(); }
+    bool   empty() const { return owner.empty(); }
+
+    // Tính own_loss/enemy_loss cho mọi hàng theo bộ giải đã chọn
+    void resolve();
+
+    // Áp thương vong đã resolve: tổng theo agent, takeDamage một lần cho mỗi agent
+    void commit();
+
+    Agent * ownerOf(size_t i) const { return owner[i]; }
+    Agent * attackerOf(size_t i) const { return attacker[i]; }
+    Agent * victimOf(size_t i) const { return victim[i]; }
+    int     deployedOf(size_t i) const { return static_cast<int>(deployed[i]); }
+    int     defenderAvailOf(size_t i) const { return static_cast<int>(defender_avail[i]); }
+    bool    estimated(size_t i) const { return estimate[i] != 0; }
+    double  ratioOf(size_t i) const { return ratio[i]; }
+    int     ownLoss(size_t i) const { return own_loss[i]; }
+    int     enemyLoss(size_t i) const { return enemy_loss[i]; }  // 0 nếu không có victim
+
+  private:
+    void resolveRatio();
+    void resolveLanchester();
+    void keepRows(const std::vector<char> & keep);  // Giữ các hàng keep[i] != 0, bỏ kết quả resolve cũ
+
+    // Gọi fn trên từng cột đầu vào (cùng độ dài size())
+    template <typename Fn> void forEachColumn(Fn && fn) {
+        fn(owner);
+        fn(attacker);
+        fn(victim);
+        fn(estimate);
+        fn(fixed_own);
+        fn(fixed_enemy);
+        for (auto * column : { &deployed, &attacker_avail, &defender_avail, &att_eff, &def_eff, &att_morale,
+                               &def_morale, &att_tactical, &def_tactical, &terrain_att, &terrain_def, &tunnel_att,
+                               &tunnel_def, &action_mod, &artillery, &visibility, &coeff }) {
+            fn(*column);
+        }
+    }
+
+    std::vector<Agent *> owner, attacker, victim;
+    std::vector<char>    estimate;
+    std::vector<int>     fixed_own, fixed_enemy;
+    std::vector<double>  deployed, attacker_avail, defender_avail;
+    std::vector<double>  att_eff, def_eff, att_morale, def_morale, att_tactical, def_tactical;
+    std::vector<double>  terrain_att, terrain_def, tunnel_att, tunnel_def, action_mod, artillery, visibility, coeff;
+
+    Resolver mode      = Resolver::Ratio;
+    int      sub_steps = 8;
+
+    // Kết quả resolve()
+    std::vector<double> ratio;
+    std::vector<int>    own_loss, enemy_loss;
+};
@@ -0,0 +1,123 @@
+#include "DecisionHistory.h"
+
+#include <cmath>
+#include <sstream>
+
+DecisionRecord DecisionRecord::fromResult(const nlohmann::json & result, int round) {
+    DecisionRecord rec;
+    rec.round   = round;
+    rec.action  = result.value("agentNextActionType", "Wait without Action");
+    rec.stage   = result.value("agentStage", "In Battle");
+    rec.target  = result.value("targetedAgentName", "None");
+    rec.moral   = result.value("agentMoral", "Medium");
+    rec.remarks = result.value("remarks", "");
+
+    const nlohmann::json pos = result.value("agentNextPosition", nlohmann::json::array({ 0.0, 0.0 }));
+    if (pos.is_array() && pos.size() == 2 && pos[0].is_number() && pos[1].is_number()) {
+        rec.position = { pos[0].get<double>(), pos[1].get<double>() };
+    }
+
+    rec.ownLoss   = result.value("mainOwnLoss", 0);
+    rec.enemyLoss = result.value("mainEnemyLoss", 0);
+    if (result.contains("actions") && result["actions"].is_array()) {
+        for (const auto & action : result["actions"]) {
+            rec.ownLoss += action.value("ownLoss", 0);
+            rec.enemyLoss += action.value("enemyLoss", 0);
+        }
+        rec.subActions = static_cast<int>(result["actions"].size());
+    }
+    if (result.contains("SubAgentsRecall") && result["SubAgentsRecall"].is_array()) {
+        rec.recalled = static_cast<int>(result["SubAgentsRecall"].size());
+    }
+    return rec;
+}
+
+DecisionHistory::DecisionHistory(size_t capacity) : recent(capacity), stage_transitions(8) {}
+
+void DecisionHistory::record(const DecisionRecord & rec) {
+    if (!recent.empty() && recent.back().round == rec.round) {
+        recent.back() = rec;
+        return;
+    }
+    if (!recent.empty()) {
+        fold(recent.back());  // Round trước đã chốt
+    }
+    recent.push(rec);
+}
+
+void DecisionHistory::addLosses(int round, int own, int enemy) {
+    if (recent.empty() || recent.back().round != round) {
+        return;
+    }
+    recent.back().ownLoss += own;
+    recent.back().enemyLoss += enemy;
+}
+
+void DecisionHistory::fold(const DecisionRecord & rec) {
+    if (rounds_folded == 0) {
+        first_round    = rec.round;
+        first_position = rec.position;
+        last_position  = rec.position;
+    }
+    distance_moved += std::hypot(rec.position.x - last_position.x, rec.position.y - last_position.y);
+    last_position = rec.position;
+    total_own_loss += rec.ownLoss;
+    total_enemy_loss += rec.enemyLoss;
+    ++rounds_folded;
+
+    if (rec.stage != last_stage) {
+        std::ostringstream t;
+        t << "R" << rec.round << " " << rec.stage;
+        stage_transitions.push(t.str());
+        ++transitions_total;
+        last_stage = rec.stage;
+    }
+}
+
+std::string DecisionHistory::summaryLine() const {
+    if (recent.empty()) {
+        return "";
+    }
+
+    // Gộp tóm tắt đã chốt với bản ghi của round hiện tại
+    const DecisionRecord & cur       = recent.back();
+    const bool             has_fold  = rounds_folded > 0;
+    const int              rounds    = rounds_folded + 1;
+    const int              own       = total_own_loss + cur.ownLoss;
+    const int              enemy     = total_enemy_loss + cur.enemyLoss;
+    const Position         start     = has_fold ? first_position : cur.position;
+    const double           travelled = distance_moved + (has_fold ? std::hypot(cur.position.x - last_position.x,
+                                                                               cur.position.y - last_position.y)
+                                                                    : 0.0);
+
+    std::ostringstream oss;
+    oss << "Rounds " << (has_fold ? first_round : cur.round) << "-" << cur.round << " (" << rounds
+        << " decisions): own losses " << own << ", enemy losses " << enemy << "; path [" << (int) start.x << ","
+        << (int) start.y << "]->[" << (int) cur.position.x << "," << (int) cur.position.y << "] ("
+        << (int) travelled << "m travelled); stages: ";
+    if (transitions_total > static_cast<int>(stage_transitions.size())) {
+        oss << "... ";
+    }
+    for (size_t i = 0; i < stage_transitions.size(); ++i) {
+        oss << (i ? " -> " : "") << stage_transitions[i];
+    }
+    if (cur.stage != last_stage) {
+        oss << (stage_transitions.empty() ? "" : " -> ") << "R" << cur.round << " " << cur.stage;
+    }
+    oss << "; current target: " << cur.target;
+    return oss.str();
+}
+
+std::string DecisionHistory::recordLine(const DecisionRecord & rec) const {
+    std::ostringstream oss;
+    oss << "R" << rec.round << " " << rec.action << " | " << rec.stage << " | tgt " << rec.target << " | ["
+        << (int) rec.position.x << "," << (int) rec.position.y << "] | loss " << rec.ownLoss << "/" << rec.enemyLoss
+        << " | " << rec.moral;
+    if (rec.subActions > 0 || rec.recalled > 0) {
+        oss << " | subs " << rec.subActions << " recalled " << rec.recalled;
+    }
+    if (!rec.remarks.empty()) {
+        oss << " | " << (rec.remarks.size() > 120 ? rec.remarks.substr(0, 117) + "..." : rec.remarks);
+    }
+    return oss.str();
+}
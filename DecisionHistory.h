@@ -0,0 +1,63 @@
+#pragma once
+#include "nlohmann/json.hpp"
+#include "Profile.h"
+#include "RingBuffer.h"
+
+#include <string>
+#include <vector>
+
+// Bản ghi quyết định của một lượt (thay cho việc lưu nguyên JSON kết quả execute())
+struct DecisionRecord {
+    int         round      = 0;
+    std::string action;
+    std::string stage;
+    std::string target;
+    std::string moral;
+    Position    position   = { 0, 0 };
+    int         ownLoss    = 0;  // Thương vong đã chốt của lượt (addLosses sau resolveCombat)
+    int         enemyLoss  = 0;
+    int         subActions = 0;
+    int         recalled   = 0;
+    std::string remarks;
+
+    static DecisionRecord fromResult(const nlohmann::json & result, int round);
+};
+
+// Lịch sử quyết định có giới hạn: ring buffer các bản ghi gần nhất + bản tóm tắt dài hạn
+// được cập nhật tăng dần (tổng thương vong, chuyển stage, quãng đường) nên không phình theo số lượt.
+class DecisionHistory {
+  public:
+    explicit DecisionHistory(size_t capacity = 10);
+
+    // execute() có thể chạy nhiều lần trong một lượt: bản ghi cùng round thay thế bản ghi trước,
+    // chỉ bản ghi cuối của mỗi round được gộp vào tóm tắt.
+    void record(const DecisionRecord & rec);
+
+    // Thương vong chốt sau khi Simulation::resolveCombat giải batch: cộng vào bản ghi của round (nếu có)
+    void addLosses(int round, int own, int enemy);
+
+    const RingBuffer<DecisionRecord> & records() const { return recent; }
+
+    size_t size() const { return recent.size(); }
+    bool   empty() const { return recent.empty(); }
+
+    std::string summaryLine() const;                           // Tóm tắt toàn bộ các lượt
+    std::string recordLine(const DecisionRecord & rec) const;  // Một dòng compact cho một lượt
+
+  private:
+    void fold(const DecisionRecord & rec);
+
+    RingBuffer<DecisionRecord> recent;
+    RingBuffer<std::string>    stage_transitions;
+
+    // Tóm tắt các round đã chốt (không tính bản ghi của round hiện tại)
+    int         rounds_folded     = 0;
+    int         first_round       = 0;
+    int         total_own_loss    = 0;
+    int         total_enemy_loss  = 0;
+    int         transitions_total = 0;
+    double      distance_moved    = 0.0;
+    Position    first_position    = { 0, 0 };
+    Position    last_position     = { 0, 0 };
+    std::string last_stage;
+};
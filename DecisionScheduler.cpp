@@ -0,0 +1,92 @@
+#include "DecisionScheduler.h"
+
+#include "Agent.h"
+#include "BattleField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Agent chưa từng ra quyết định / quá hạn replan luôn đứng đầu hàng đợi
+static const double kMustReplanUrgency = 1e6;
+
+DecisionScheduler::DecisionScheduler(const nlohmann::json & config) {
+    if (config.contains("battle_config")) {
+        const nlohmann::json & bc = config["battle_config"];
+        calls_per_turn            = bc.value("llm_calls_per_turn", 0);
+        replan_max_interval       = std::max(1, bc.value("replan_max_interval", 3));
+        engage_range              = bc.value("urgency_engage_range", 300.0);
+        heavy_loss_ratio          = bc.value("urgency_heavy_loss_ratio", 0.05);
+    }
+}
+
+double DecisionScheduler::urgency(Agent * agent, const BattleField & field, int turn) const {
+    auto it = entries.find(agent->profile.name);
+    if (it == entries.end() || it->second.last_turn < 0) {
+        return kMustReplanUrgency;
+    }
+    const Entry & e     = it->second;
+    const int     stale = turn - e.last_turn;
+    if (stale >= replan_max_interval) {
+        return kMustReplanUrgency + stale;
+    }
+
+    double score = 0.0;
+
+    // Gần địch (chỉ địch phát hiện được)
+    double enemy_dist = field.nearestEnemyDistance(agent);
+    if (enemy_dist <= engage_range) {
+        score += 4.0;
+    } else if (std::isfinite(enemy_dist)) {
+        score += 2.0;
+    }
+
+    // Đang chịu thương vong kể từ quyết định trước
+    int    lost  = agent->profile.lostNumOfTroops - e.lost_at_decision;
+    double ratio = static_cast<double>(lost) / std::max(1, agent->profile.initialNumOfTroops);
+    if (ratio >= heavy_loss_ratio) {
+        score += 4.0;
+    } else if (lost > 0) {
+        score += 2.0;
+    }
+
+    // Chỉ huy: quyết định của họ kéo theo cả nhánh
+    if (agent->getParent() == nullptr) {
+        score += 3.0;
+    } else if (!agent->getChildren().empty()) {
+        score += 1.0;
+    }
+
+    // Độ cũ: agent yên tĩnh lần lượt được xoay vòng
+    score += stale;
+    return score;
+}
+
+std::unordered_set<Agent *> DecisionScheduler::plan(const std::vector<Agent *> & candidates, const BattleField & field,
+                                                    int turn) {
+    std::unordered_set<Agent *> scheduled;
+    if (calls_per_turn <= 0 || static_cast<int>(candidates.size()) <= calls_per_turn) {
+        scheduled.insert(candidates.begin(), candidates.end());
+        return scheduled;
+    }
+
+    std::vector<std::pair<double, Agent *>> ranked;
+    ranked.reserve(candidates.size());
+    for (Agent * agent : candidates) {
+        ranked.emplace_back(urgency(agent, field, turn), agent);
+    }
+    // Ổn định theo thứ tự roster khi bằng điểm
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const auto & a, const auto & b) { return a.first > b.first; });
+
+    for (int i = 0; i < calls_per_turn; ++i) {
+        scheduled.insert(ranked[i].second);
+    }
+    return scheduled;
+}
+
+void DecisionScheduler::markDecided(Agent * agent, int turn) {
+    Entry & e          = entries[agent->profile.name];
+    e.last_turn        = turn;
+    e.lost_at_decision = agent->profile.lostNumOfTroops;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "nlohmann/json.hpp"
+
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class Agent;
+class BattleField;
+
+// Phân bổ ngân sách gọi LLM mỗi lượt (battle_config.llm_calls_per_turn, 0 = không giới hạn).
+// Agent được xếp theo mức khẩn cấp: gần địch, đang chịu thương vong, là chỉ huy, lâu chưa ra quyết định.
+// Agent ngoài ngân sách dùng Agent::carryForward() (giữ quyết định trước, cập nhật theo luật đơn giản).
+class DecisionScheduler {
+  public:
+    explicit DecisionScheduler(const nlohmann::json & config);
+
+    // Chọn các agent được gọi LLM trong lượt; cần snapshot của field còn hiệu lực
+    std::unordered_set<Agent *> plan(const std::vector<Agent *> & candidates, const BattleField & field, int turn);
+
+    // Ghi nhận agent vừa ra quyết định bằng LLM (mốc tính thương vong và độ cũ)
+    void markDecided(Agent * agent, int turn);
+
+    double urgency(Agent * agent, const BattleField & field, int turn) const;
+
+    int    budget() const { return calls_per_turn; }
+    double engageRange() const { return engage_range; }
+
+  private:
+    struct Entry {
+        int last_turn        = -1;
+        int lost_at_decision = 0;
+    };
+
+    int    calls_per_turn      = 0;
+    int    replan_max_interval = 3;      // Số lượt tối đa được carry forward liên tiếp
+    double engage_range        = 300.0;  // Địch trong tầm này coi như đang giao chiến
+    double heavy_loss_ratio    = 0.05;   // Thương vong kể từ quyết định trước / quân số ban đầu
+
+    std::map<std::string, Entry> entries;  // Theo tên agent (con trỏ có thể bị tái sử dụng)
+};
@@ -0,0 +1,66 @@
+#include "EngagementGraph.h"
+
+#include "Agent.h"
+
+#include <algorithm>
+
+void EngagementGraph::link(Agent * attacker, Agent * target) {
+    if (!attacker || !target) {
+        return;
+    }
+    auto it = outgoing.find(attacker);
+    if (it != outgoing.end() && it->second == target) {
+        return;
+    }
+    unlink(attacker);
+    outgoing[attacker] = target;
+    incoming[target].push_back(attacker);
+}
+
+void EngagementGraph::unlink(const Agent * attacker) {
+    auto it = outgoing.find(attacker);
+    if (it == outgoing.end()) {
+        return;
+    }
+    auto in = incoming.find(it->second);
+    if (in != incoming.end()) {
+        auto & list = in->second;
+        list.erase(std::remove(list.begin(), list.end(), attacker), list.end());
+        if (list.empty()) {
+            incoming.erase(in);
+        }
+    }
+    outgoing.erase(it);
+}
+
+void EngagementGraph::remove(const Agent * agent) {
+    unlink(agent);
+    auto in = incoming.find(agent);
+    if (in == incoming.end()) {
+        return;
+    }
+    // Các attacker đang nhắm agent này: bỏ cạnh và xoá mục tiêu để updateTargetList chọn lại
+    const std::vector<Agent *> attackers = std::move(in->second);
+    incoming.erase(in);
+    for (Agent * a : attackers) {
+        outgoing.erase(a);
+        a->target                    = AgentHandle();
+        a->profile.targetedAgentName = "";
+    }
+}
+
+void EngagementGraph::clear() {
+    outgoing.clear();
+    incoming.clear();
+}
+
+Agent * EngagementGraph::targetOf(const Agent * attacker) const {
+    auto it = outgoing.find(attacker);
+    return it == outgoing.end() ? nullptr : it->second;
+}
+
+const std::vector<Agent *> & EngagementGraph::attackersOf(const Agent * target) const {
+    static const std::vector<Agent *> none;
+    auto                              it = incoming.find(target);
+    return it == incoming.end() ? none : it->second;
+}
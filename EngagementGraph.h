@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+class Agent;
+
+// Đồ thị giao chiến attacker → target, cập nhật ngay khi Agent::setTarget/clearTarget đổi mục tiêu:
+//  - Mỗi agent có tối đa một cạnh ra (mục tiêu hiện tại) và danh sách cạnh vào (ai đang đánh nó).
+//  - Các truy vấn bao vây / tuyến tiếp tế / "ai đang đánh tôi" chỉ duyệt bậc của đỉnh,
+//    không quét toàn bộ agents và so tên targetedAgentName.
+//  - remove(): agent bị xoá khỏi simulation thì các attacker của nó mất mục tiêu (Agent::target về handle rỗng),
+//    đồ thị không còn giữ con trỏ tới agent đã huỷ.
+class EngagementGraph {
+  public:
+    void link(Agent * attacker, Agent * target);  // Thay cạnh ra cũ của attacker (nếu có)
+    void unlink(const Agent * attacker);
+    void remove(const Agent * agent);             // Bỏ mọi cạnh ra/vào của agent, xoá target của các attacker
+    void clear();
+
+    Agent *                      targetOf(const Agent * attacker) const;
+    const std::vector<Agent *> & attackersOf(const Agent * target) const;
+    std::size_t                  degreeIn(const Agent * target) const { return attackersOf(target).size(); }
+    std::size_t                  edgeCount() const { return outgoing.size(); }
+
+  private:
+    std::unordered_map<const Agent *, Agent *>              outgoing;
+    std::unordered_map<const Agent *, std::vector<Agent *>> incoming;
+};
@@ -0,0 +1,298 @@
+#include "EventTrace.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const char kMagic[4] = { 'B', 'T', 'R', 'C' };
+
+// Con trỏ đọc tuần tự trên payload của một record; đọc quá payload trả về 0
+struct Cursor {
+    const char * data;
+    size_t       size;
+    size_t       pos = 0;
+
+    template <typename T> T get() {
+        T value{};
+        if (pos + sizeof(T) <= size) {
+            std::memcpy(&value, data + pos, sizeof(T));
+        }
+        pos += sizeof(T);
+        return value;
+    }
+};
+}  // namespace
+
+EventTrace::~EventTrace() {
+    close();
+}
+
+bool EventTrace::open(const std::string & path, size_t buffer_bytes) {
+    close();
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    buffer.assign(std::max<size_t>(buffer_bytes, 1024), 0);
+    used = 0;
+    strings.clear();
+
+    const uint16_t version = kVersion, reserved = 0;
+    put(kMagic, sizeof(kMagic));
+    put(&version, sizeof(version));
+    put(&reserved, sizeof(reserved));
+    return true;
+}
+
+void EventTrace::close() {
+    if (file.is_open()) {
+        drain();
+        file.close();
+    }
+}
+
+void EventTrace::put(const void * data, size_t size) {
+    if (used + size > buffer.size()) {
+        drain();
+    }
+    std::memcpy(buffer.data() + used, data, size);
+    used += size;
+}
+
+void EventTrace::drain() {
+    if (used > 0) {
+        file.write(buffer.data(), static_cast<std::streamsize>(used));
+        used = 0;
+    }
+}
+
+template <typename... Fields> void EventTrace::record(TraceEvent event, int turn, const Fields &... fields) {
+    constexpr size_t payload = (sizeof(Fields) + ... + 0);
+    static_assert(payload <= 255, "trace payload too large");
+    const uint8_t  header[2] = { static_cast<uint8_t>(event), static_cast<uint8_t>(payload) };
+    const uint16_t t         = static_cast<uint16_t>(std::clamp(turn, 0, 0xFFFF));
+    put(header, sizeof(header));
+    put(&t, sizeof(t));
+    (put(&fields, sizeof(fields)), ...);
+}
+
+uint16_t EventTrace::intern(const std::string & text) {
+    if (text.empty() || text == "None") {
+        return 0;
+    }
+    auto it = strings.find(text);
+    if (it != strings.end()) {
+        return it->second;
+    }
+    if (strings.size() >= 0xFFFF - 1) {
+        return 0;  // Hết id: ghi như chuỗi rỗng
+    }
+    const uint16_t id  = static_cast<uint16_t>(strings.size() + 1);
+    const size_t   len = std::min<size_t>(text.size(), 255 - sizeof(id));
+    strings.emplace(text, id);
+
+    const uint8_t  header[2] = { static_cast<uint8_t>(TraceEvent::String), static_cast<uint8_t>(sizeof(id) + len) };
+    const uint16_t turn      = 0;
+    put(header, sizeof(header));
+    put(&turn, sizeof(turn));
+    put(&id, sizeof(id));
+    put(text.data(), len);
+    return id;
+}
+
+void EventTrace::turnStart(int turn, int troops_a, int troops_b, int agents_a, int agents_b) {
+    if (!enabled()) {
+        return;
+    }
+    record(TraceEvent::TurnStart, turn, int32_t(troops_a), int32_t(troops_b), uint16_t(agents_a), uint16_t(agents_b));
+}
+
+void EventTrace::decision(int turn, const std::string & agent, const std::string & action, const std::string & stage,
+                          const std::string & target, int moral, bool carried) {
+    if (!enabled()) {
+        return;
+    }
+    const uint16_t a = intern(agent), act = intern(action), st = intern(stage), tg = intern(target);
+    record(TraceEvent::Decision, turn, a, act, st, tg, uint8_t(moral), uint8_t(carried ? 1 : 0));
+}
+
+void EventTrace::move(int turn, const std::string & agent, double from_x, double from_y, double to_x, double to_y) {
+    if (!enabled()) {
+        return;
+    }
+    const uint16_t a = intern(agent);
+    record(TraceEvent::Move, turn, a, float(from_x), float(from_y), float(to_x), float(to_y));
+}
+
+void EventTrace::casualty(int turn, const std::string & attacker, const std::string & victim, int deployed,
+                          int own_loss, int enemy_loss, double ratio) {
+    if (!enabled()) {
+        return;
+    }
+    const uint16_t a = intern(attacker), v = intern(victim);
+    record(TraceEvent::Casualty, turn, a, v, int32_t(deployed), int32_t(own_loss), int32_t(enemy_loss), float(ratio));
+}
+
+void EventTrace::spawn(int turn, const std::string & agent, const std::string & parent, int troops, double x,
+                       double y) {
+    if (!enabled()) {
+        return;
+    }
+    const uint16_t a = intern(agent), p = intern(parent);
+    record(TraceEvent::Spawn, turn, a, p, int32_t(troops), float(x), float(y));
+}
+
+void EventTrace::recall(int turn, const std::string & agent, const std::string & parent, int troops, bool pruned) {
+    if (!enabled()) {
+        return;
+    }
+    const uint16_t a = intern(agent), p = intern(parent);
+    record(TraceEvent::Recall, turn, a, p, int32_t(troops), uint8_t(pruned ? 1 : 0));
+}
+
+void EventTrace::weather(int turn, const std::string & type, double visibility, double artillery) {
+    if (!enabled()) {
+        return;
+    }
+    const uint16_t w = intern(type);
+    record(TraceEvent::Weather, turn, w, float(visibility), float(artillery));
+}
+
+void EventTrace::victory(int turn, const std::string & winner, int troops_a, int troops_b) {
+    if (!enabled()) {
+        return;
+    }
+    const uint16_t w = intern(winner);
+    record(TraceEvent::Victory, turn, w, int32_t(troops_a), int32_t(troops_b));
+}
+
+// ========================================
+// EventTraceReader
+// ========================================
+
+bool EventTraceReader::open(const std::string & path) {
+    file.open(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    char     magic[4];
+    uint16_t version = 0, reserved = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    file.read(reinterpret_cast<char *>(&reserved), sizeof(reserved));
+    return file && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0 && version == EventTrace::kVersion;
+}
+
+const char * EventTraceReader::eventName(TraceEvent event) {
+    switch (event) {
+        case TraceEvent::String:
+            return "string";
+        case TraceEvent::TurnStart:
+            return "turn_start";
+        case TraceEvent::Decision:
+            return "decision";
+        case TraceEvent::Move:
+            return "move";
+        case TraceEvent::Casualty:
+            return "casualty";
+        case TraceEvent::Spawn:
+            return "spawn";
+        case TraceEvent::Recall:
+            return "recall";
+        case TraceEvent::Weather:
+            return "weather";
+        case TraceEvent::Victory:
+            return "victory";
+    }
+    return "unknown";
+}
+
+bool EventTraceReader::next(nlohmann::json & out) {
+    char payload[255];
+    for (;;) {
+        uint8_t  header[2];
+        uint16_t turn = 0;
+        if (!file.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+            !file.read(reinterpret_cast<char *>(&turn), sizeof(turn)) || !file.read(payload, header[1])) {
+            return false;
+        }
+        const TraceEvent event = static_cast<TraceEvent>(header[0]);
+        Cursor           c{ payload, header[1] };
+        auto             str = [&]() -> const std::string & {
+            const uint16_t id = c.get<uint16_t>();
+            return id < strings.size() ? strings[id] : strings[0];
+        };
+
+        if (event == TraceEvent::String) {
+            const uint16_t id = c.get<uint16_t>();
+            if (strings.size() <= id) {
+                strings.resize(id + 1);
+            }
+            strings[id].assign(payload + c.pos, header[1] - std::min<size_t>(c.pos, header[1]));
+            continue;
+        }
+
+        out          = nlohmann::json::object();
+        out["turn"]  = turn;
+        out["event"] = eventName(event);
+        switch (event) {
+            case TraceEvent::TurnStart:
+                out["troops_a"] = c.get<int32_t>();
+                out["troops_b"] = c.get<int32_t>();
+                out["agents_a"] = c.get<uint16_t>();
+                out["agents_b"] = c.get<uint16_t>();
+                break;
+            case TraceEvent::Decision:
+                out["agent"]   = str();
+                out["action"]  = str();
+                out["stage"]   = str();
+                out["target"]  = str();
+                out["moral"]   = c.get<uint8_t>();
+                out["carried"] = c.get<uint8_t>() != 0;
+                break;
+            case TraceEvent::Move:
+                out["agent"]  = str();
+                out["from_x"] = c.get<float>();
+                out["from_y"] = c.get<float>();
+                out["to_x"]   = c.get<float>();
+                out["to_y"]   = c.get<float>();
+                break;
+            case TraceEvent::Casualty:
+                out["agent"]      = str();
+                out["target"]     = str();
+                out["deployed"]   = c.get<int32_t>();
+                out["own_loss"]   = c.get<int32_t>();
+                out["enemy_loss"] = c.get<int32_t>();
+                out["ratio"]      = c.get<float>();
+                break;
+            case TraceEvent::Spawn:
+                out["agent"]  = str();
+                out["parent"] = str();
+                out["troops"] = c.get<int32_t>();
+                out["x"]      = c.get<float>();
+                out["y"]      = c.get<float>();
+                break;
+            case TraceEvent::Recall:
+                out["agent"]  = str();
+                out["parent"] = str();
+                out["troops"] = c.get<int32_t>();
+                out["pruned"] = c.get<uint8_t>() != 0;
+                break;
+            case TraceEvent::Weather:
+                out["weather"]    = str();
+                out["visibility"] = c.get<float>();
+                out["artillery"]  = c.get<float>();
+                break;
+            case TraceEvent::Victory:
+                out["winner"]   = str();
+                out["troops_a"] = c.get<int32_t>();
+                out["troops_b"] = c.get<int32_t>();
+                break;
+            default:
+                out["event"] = "unknown";
+                out["code"]  = header[0];
+                break;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "nlohmann/json.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Luồng sự kiện nhị phân của một lần chạy (battle_config.event_trace), thay cho việc phân tích log chữ.
+//
+// Định dạng (thứ tự byte của máy ghi, little-endian trên các nền tảng hỗ trợ):
+//   header : "BTRC" | u16 version | u16 reserved
+//   record : u8 event | u8 payload_size | u16 turn | payload
+// Tên agent/action/stage/thời tiết được intern: lần đầu xuất hiện ghi một record String (u16 id + byte chữ),
+// các record sau chỉ chứa id (0 = rỗng/None). payload_size cho phép bộ đọc bỏ qua loại record chưa biết.
+//
+// Payload theo loại:
+//   TurnStart : i32 troops_a, i32 troops_b, u16 agents_a, u16 agents_b
+//   Decision  : u16 agent, u16 action, u16 stage, u16 target, u8 moral, u8 carried (1 = carryForward, không gọi LLM)
+//   Move      : u16 agent, f32 from_x, f32 from_y, f32 to_x, f32 to_y
+//   Casualty  : u16 attacker, u16 victim, i32 deployed, i32 own_loss, i32 enemy_loss, f32 ratio
+//   Spawn     : u16 agent, u16 parent, i32 troops, f32 x, f32 y
+//   Recall    : u16 agent, u16 parent, i32 troops, u8 pruned
+//   Weather   : u16 type, f32 visibility, f32 artillery
+//   Victory   : u16 winner, i32 troops_a, i32 troops_b
+enum class TraceEvent : uint8_t { String = 1, TurnStart, Decision, Move, Casualty, Spawn, Recall, Weather, Victory };
+
+// Ghi qua bộ đệm cố định, chỉ ghi ra file khi đầy hoặc lúc close(); không mở file thì mọi hàm là no-op.
+// Chỉ gọi từ luồng mô phỏng.
+class EventTrace {
+  public:
+    static constexpr uint16_t kVersion = 1;
+
+    ~EventTrace();
+
+    bool open(const std::string & path, size_t buffer_bytes = 64 * 1024);
+    void close();
+    bool enabled() const { return file.is_open(); }
+
+    void turnStart(int turn, int troops_a, int troops_b, int agents_a, int agents_b);
+    void decision(int turn, const std::string & agent, const std::string & action, const std::string & stage,
+                  const std::string & target, int moral, bool carried);
+    void move(int turn, const std::string & agent, double from_x, double from_y, double to_x, double to_y);
+    void casualty(int turn, const std::string & attacker, const std::string & victim, int deployed, int own_loss,
+                  int enemy_loss, double ratio);
+    void spawn(int turn, const std::string & agent, const std::string & parent, int troops, double x, double y);
+    void recall(int turn, const std::string & agent, const std::string & parent, int troops, bool pruned);
+    void weather(int turn, const std::string & type, double visibility, double artillery);
+    void victory(int turn, const std::string & winner, int troops_a, int troops_b);
+
+  private:
+    uint16_t intern(const std::string & text);
+
+    template <typename... Fields> void record(TraceEvent event, int turn, const Fields &... fields);
+    void                               put(const void * data, size_t size);
+    void                               drain();
+
+    std::ofstream                             file;
+    std::vector<char>                         buffer;
+    size_t                                    used = 0;
+    std::unordered_map<std::string, uint16_t> strings;
+};
+
+// Đọc lại luồng sự kiện (EventTraceDump): mỗi record thành một object JSON có tên trường như trên,
+// id chuỗi được thay bằng chữ.
+class EventTraceReader {
+  public:
+    bool open(const std::string & path);
+
+    // false khi hết file hoặc record bị cắt cụt
+    bool next(nlohmann::json & out);
+
+    static const char * eventName(TraceEvent event);
+
+  private:
+    std::ifstream            file;
+    std::vector<std::string> strings = { "" };
+};
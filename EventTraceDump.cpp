@@ -0,0 +1,118 @@
+// Giải mã luồng sự kiện nhị phân (battle_config.event_trace) ra CSV hoặc JSON.
+//
+//   llama-battleagent-tracedump TRACE.bin [--format csv|json] [--event NAME] [--out FILE]
+//       csv : một bảng, các cột là hợp của mọi trường (ô trống nếu loại record không có trường đó)
+//       json: mỗi dòng một object (JSON Lines)
+//       --event lọc theo loại: turn_start, decision, move, casualty, spawn, recall, weather, victory
+#include "EventTrace.h"
+#include "nlohmann/json.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+const std::vector<std::string> kCsvColumns = { "turn",     "event",    "agent",      "target",   "parent",
+                                               "action",   "stage",    "moral",      "carried",  "from_x",
+                                               "from_y",   "to_x",     "to_y",       "x",        "y",
+                                               "troops",   "deployed", "own_loss",   "enemy_loss", "ratio",
+                                               "pruned",   "weather",  "visibility", "artillery", "winner",
+                                               "troops_a", "troops_b", "agents_a",   "agents_b" };
+
+void print_usage(const char * prog) {
+    std::cerr << "Usage: " << prog << " TRACE.bin [--format csv|json] [--event NAME] [--out FILE]\n";
+}
+
+std::string csvField(const json & value) {
+    if (value.is_null()) {
+        return "";
+    }
+    if (value.is_boolean()) {
+        return value.get<bool>() ? "1" : "0";
+    }
+    if (!value.is_string()) {
+        return value.dump();
+    }
+    const std::string text = value.get<std::string>();
+    if (text.find_first_of(",\"\n") == std::string::npos) {
+        return text;
+    }
+    std::string quoted = "\"";
+    for (char ch : text) {
+        quoted += ch == '"' ? std::string("\"\"") : std::string(1, ch);
+    }
+    return quoted + "\"";
+}
+}  // namespace
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string path = argv[1], format = "csv", filter, out_path;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        const std::string key = argv[i];
+        if (key == "--format") {
+            format = argv[i + 1];
+        } else if (key == "--event") {
+            filter = argv[i + 1];
+        } else if (key == "--out") {
+            out_path = argv[i + 1];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (format != "csv" && format != "json") {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    EventTraceReader reader;
+    if (!reader.open(path)) {
+        std::cerr << "Error: " << path << " is not a BattleAgent event trace (version " << EventTrace::kVersion
+                  << ")\n";
+        return 1;
+    }
+
+    std::ofstream out_file;
+    if (!out_path.empty()) {
+        out_file.open(out_path);
+        if (!out_file.is_open()) {
+            std::cerr << "Error: cannot open " << out_path << "\n";
+            return 1;
+        }
+    }
+    std::ostream & out = out_path.empty() ? std::cout : out_file;
+
+    if (format == "csv") {
+        for (size_t i = 0; i < kCsvColumns.size(); ++i) {
+            out << (i ? "," : "") << kCsvColumns[i];
+        }
+        out << '\n';
+    }
+
+    json   record;
+    size_t count = 0;
+    while (reader.next(record)) {
+        if (!filter.empty() && record["event"] != filter) {
+            continue;
+        }
+        if (format == "json") {
+            out << record.dump() << '\n';
+        } else {
+            for (size_t i = 0; i < kCsvColumns.size(); ++i) {
+                out << (i ? "," : "") << csvField(record.value(kCsvColumns[i], json()));
+            }
+            out << '\n';
+        }
+        ++count;
+    }
+    std::cerr << count << " records\n";
+    return 0;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Handle tới một phần tử của GenerationalPool: index của ô + thế hệ của ô lúc cấp phát.
+// Ô bị huỷ thì thế hệ tăng, handle cũ tra ra nullptr thay vì trỏ vào đối tượng đã chết / đối tượng mới.
+struct PoolHandle {
+    static constexpr uint32_t kInvalid = UINT32_MAX;
+
+    uint32_t index      = kInvalid;
+    uint32_t generation = 0;
+
+    bool valid() const { return index != kInvalid; }
+    bool operator==(const PoolHandle & other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const PoolHandle & other) const { return !(*this == other); }
+};
+
+// Arena các ô cỡ cố định, cấp theo slab SlabSize ô: địa chỉ đối tượng không đổi suốt đời ô,
+// ô được huỷ đưa vào free list và dùng lại (LIFO), nên tạo/huỷ là O(1) và không cấp phát lại khi
+// số phần tử dao động. clear() (và destructor) huỷ mọi đối tượng còn sống.
+// Không thread-safe: chỉ dùng từ luồng mô phỏng.
+template <typename T, size_t SlabSize = 64> class GenerationalPool {
+  public:
+    GenerationalPool() = default;
+    ~GenerationalPool() { clear(); }
+
+    GenerationalPool(const GenerationalPool &)             = delete;
+    GenerationalPool & operator=(const GenerationalPool &) = delete;
+
+    template <typename... Args> PoolHandle create(Args &&... args) {
+        uint32_t index;
+        if (free_head != kNone) {
+            index     = free_head;
+            free_head = slot(index).next_free;
+        } else {
+            if (used == slabs.size() * SlabSize) {
+                slabs.push_back(std::make_unique<Slot[]>(SlabSize));
+            }
+            index = used++;
+        }
+        Slot & s = slot(index);
+        try {
+            new (s.storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            s.next_free = free_head;
+            free_head   = index;
+            throw;
+        }
+        s.live = true;
+        ++live;
+        return { index, s.generation };
+    }
+
+    // nullptr nếu handle rỗng, ô đã bị huỷ hoặc đã được dùng lại cho đối tượng khác
+    T * get(PoolHandle handle) const {
+        if (handle.index >= used) {
+            return nullptr;
+        }
+        Slot & s = slot(handle.index);
+        return s.live && s.generation == handle.generation ? object(s) : nullptr;
+    }
+
+    bool destroy(PoolHandle handle) {
+        T * obj = get(handle);
+        if (!obj) {
+            return false;
+        }
+        obj->~T();
+        release(handle.index);
+        return true;
+    }
+
+    void clear() {
+        for (uint32_t i = 0; i < used; ++i) {
+            Slot & s = slot(i);
+            if (s.live) {
+                object(s)->~T();
+                release(i);
+            }
+        }
+    }
+
+    size_t size() const { return live; }
+    size_t capacity() const { return slabs.size() * SlabSize; }
+
+  private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        uint32_t generation = 1;
+        uint32_t next_free  = kNone;
+        bool     live       = false;
+    };
+
+    Slot & slot(uint32_t index) const { return slabs[index / SlabSize][index % SlabSize]; }
+
+    static T * object(Slot & s) { return std::launder(reinterpret_cast<T *>(s.storage)); }
+
+    void release(uint32_t index) {
+        Slot & s = slot(index);
+        s.live   = false;
+        if (++s.generation == 0) {
+            s.generation = 1;  // Thế hệ 0 dành cho handle rỗng
+        }
+        s.next_free = free_head;
+        free_head   = index;
+        --live;
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> slabs;
+    uint32_t                             used      = 0;  // Số ô đã từng cấp (các ô sau chưa khởi tạo)
+    uint32_t                             free_head = kNone;
+    size_t                               live      = 0;
+};
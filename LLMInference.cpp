@@ -1,6 +1,8 @@
 #include "LLMInference.h"
+#include "Profiler.h"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <sstream>
@@ -13,6 +15,7 @@
 #include <future>
 #include <queue>
 #include <mutex>
+#include <optional>
 #include <condition_variable>
 #include <random>
 #define NOMINMAX
@@ -217,6 +220,10 @@ LLMInference::LLMInference(const std::string & model, int ngl_, int n_ctx_) : n_
 }
 
 LLMInference::~LLMInference() {
+    // Đợi các request server đã bị huỷ thoát hẳn trước khi giải phóng
+    while (in_flight_requests.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
     smpl.reset();
     ctx.reset();
     model.reset();
@@ -245,6 +252,86 @@ void LLMInference::setSamplerParams(float temperature, float min_p) {
     min_p       = min_p;
 }
 
+// ========== turn budget & circuit breaker ==========
+void LLMInference::beginTurn(int deadline_ms, int expected_requests) {
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    has_turn_deadline  = deadline_ms > 0;
+    turn_deadline      = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(0, deadline_ms));
+    requests_remaining = std::max(1, expected_requests);
+}
+
+void LLMInference::endTurn() {
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    has_turn_deadline  = false;
+    requests_remaining = 0;
+}
+
+bool LLMInference::deadlineExceeded() const {
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    return has_turn_deadline && std::chrono::steady_clock::now() >= turn_deadline;
+}
+
+void LLMInference::setCircuitBreaker(int failure_threshold, int slow_call_ms, int cooldown_ms) {
+    std::lock_guard<std::mutex> lock(breaker_mutex);
+    breaker_failure_threshold = std::max(1, failure_threshold);
+    breaker_slow_call_ms      = slow_call_ms;
+    breaker_cooldown_ms       = std::max(0, cooldown_ms);
+}
+
+// Phần thời gian còn lại của lượt chia cho số request chưa gửi; request cuối nhận hết phần dư.
+// Trả về <= 0 khi lượt đã hết hạn.
+int LLMInference::nextRequestTimeoutMs(int default_timeout_ms) {
+    std::lock_guard<std::mutex> lock(budget_mutex);
+    if (!has_turn_deadline) {
+        return default_timeout_ms;
+    }
+    const long long remaining_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       turn_deadline - std::chrono::steady_clock::now())
+                                       .count();
+    if (remaining_ms <= 0) {
+        return 0;
+    }
+    const int share = static_cast<int>(remaining_ms / std::max(1, requests_remaining));
+    if (requests_remaining > 1) {
+        --requests_remaining;
+    }
+    return std::max(1, std::min(share, default_timeout_ms));
+}
+
+// Endpoint đang mở (open) thì bỏ qua; hết cooldown thì cho đúng một request thử (half-open).
+bool LLMInference::acquireEndpoint(const std::string & ip) {
+    std::lock_guard<std::mutex> lock(breaker_mutex);
+    EndpointBreaker & b = breakers[ip];
+    if (b.consecutive_failures < breaker_failure_threshold) {
+        return true;
+    }
+    if (std::chrono::steady_clock::now() < b.open_until || b.trial_in_flight) {
+        return false;
+    }
+    b.trial_in_flight = true;
+    return true;
+}
+
+void LLMInference::releaseEndpoint(const std::string & ip) {
+    std::lock_guard<std::mutex> lock(breaker_mutex);
+    breakers[ip].trial_in_flight = false;
+}
+
+void LLMInference::recordEndpointResult(const std::string & ip, bool ok, long long elapsed_ms) {
+    std::lock_guard<std::mutex> lock(breaker_mutex);
+    EndpointBreaker & b = breakers[ip];
+    b.trial_in_flight   = false;
+    if (ok && (breaker_slow_call_ms <= 0 || elapsed_ms <= breaker_slow_call_ms)) {
+        b.consecutive_failures = 0;
+        return;
+    }
+    if (++b.consecutive_failures >= breaker_failure_threshold) {
+        b.open_until = std::chrono::steady_clock::now() + std::chrono::milliseconds(breaker_cooldown_ms);
+        log << "⛔ Circuit open for " << ip << " (" << b.consecutive_failures << " failed/slow calls, cooldown "
+            << breaker_cooldown_ms << "ms)\n";
+    }
+}
+
 bool LLMInference::isInitialized() const noexcept {
     if (is_server_mode) {
         return !server_ips.empty();
@@ -252,6 +339,15 @@ bool LLMInference::isInitialized() const noexcept {
     return model.get() && ctx.get() && smpl.get();
 }
 
+int LLMInference::countTokens(const std::string & text) const {
+    if (!is_server_mode && model) {
+        const int n = llama_tokenize(llama_model_get_vocab(model.get()), text.c_str(), static_cast<int32_t>(text.size()),
+                                     nullptr, 0, false, true);
+        return n < 0 ? -n : n;
+    }
+    return static_cast<int>((text.size() + 3) / 4);
+}
+
 // ========== initialize model ==========
 void LLMInference::initialize(const std::string & model_path, int ngl, int n_ctx) {
     ggml_backend_load_all();
@@ -434,17 +530,23 @@ std::string LLMInference::response(const std::string & prompt) {
     }
 }
 
-std::string LLMInference::response(const std::vector<nlohmann::json> & prompts) {
+std::string LLMInference::response(const std::vector<nlohmann::json> & prompts, int timeout_ms, RequestStats * stats) {
     if (!isInitialized()) {
         log << "generate_json_response: Model/context/sampler not initialized\n";
         return R"({"error":"Model or context not initialized"})";
     }
 
+    // timeout_ms <= 0: không giới hạn thời gian decode
+    const bool call_has_deadline = timeout_ms > 0;
+    const auto call_deadline     = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(0, timeout_ms));
+
     std::mutex                            ctx_mutex;
     std::vector<std::future<std::string>> futures(prompts.size());
+    std::vector<RequestStats>             prompt_stats(prompts.size());
 
     for (size_t i = 0; i < prompts.size(); ++i) {
-        futures[i] = std::async(std::launch::async, [this, &prompts, i, &ctx_mutex]() -> std::string {
+        futures[i] = std::async(std::launch::async, [&, i]() -> std::string {
+            RequestStats & st = prompt_stats[i];
             try {
                 // --- Xây dựng full prompt ---
                 std::ostringstream oss;
@@ -465,6 +567,7 @@ std::string LLMInference::response(const std::vector<nlohmann::json> & prompts)
                 std::string full_prompt = oss.str();
 
                 // --- Tokenize trước, không lock ---
+                std::optional<ScopedTimer> tokenize_timer(std::in_place, "llm.tokenize");
                 const bool is_first = llama_memory_seq_pos_max(llama_get_memory(ctx.get()), 0) == -1;
                 int        n_tokens = -llama_tokenize(llama_model_get_vocab(model.get()), full_prompt.c_str(),
                                                       full_prompt.size(), nullptr, 0, is_first, true);
@@ -479,15 +582,23 @@ std::string LLMInference::response(const std::vector<nlohmann::json> & prompts)
                     return R"({"error":"Tokenization failed"})";
                 }
                 tokens.resize(ret);
+                tokenize_timer.reset();
+                st.prompt_tokens = ret;
 
                 std::string response;
 
                 // --- Lock chỉ khi decode / sample ---
                 {
                     std::lock_guard<std::mutex> lock(ctx_mutex);
+                    ScopedTimer                 decode_timer("llm.decode");
                     llama_batch                 batch = llama_batch_get_one(tokens.data(), tokens.size());
+                    st.dispatched                     = std::chrono::steady_clock::now();
 
                     while (true) {
+                        if (call_has_deadline && std::chrono::steady_clock::now() >= call_deadline) {
+                            log << "⏰ Local decode deadline reached, " << response.size() << " bytes generated\n";
+                            return R"({"error":"deadline_exceeded"})";
+                        }
                         if (llama_decode(ctx.get(), batch) != 0) {
                             return R"({"error":"Decode failed"})";
                         }
@@ -504,6 +615,9 @@ std::string LLMInference::response(const std::vector<nlohmann::json> & prompts)
                             return R"({"error":"Token conversion failed"})";
                         }
                         response.append(buf, n);
+                        if (st.generated_tokens++ == 0) {
+                            st.first_token = std::chrono::steady_clock::now();
+                        }
 
                         batch = llama_batch_get_one(&tok, 1);
                     }
@@ -514,13 +628,16 @@ std::string LLMInference::response(const std::vector<nlohmann::json> & prompts)
                 }
 
                 // --- Parse JSON hoặc wrap text ---
+                ScopedTimer parse_timer("llm.parse");
                 try {
                     nlohmann::json js = nlohmann::json::parse(response);
+                    st.outcome        = LLMCallMetrics::Outcome::Parsed;
                     return js.dump();
                 } catch (...) {
                     nlohmann::json js = {
                         {"content", response}
                     };
+                    st.outcome = LLMCallMetrics::Outcome::Repaired;
                     return js.dump();
                 }
             } catch (...) {
@@ -536,6 +653,24 @@ std::string LLMInference::response(const std::vector<nlohmann::json> & prompts)
         results_json.push_back(nlohmann::json::parse(f.get()));
     }
 
+    // Gộp số liệu các prompt: cộng token, lấy mốc sớm nhất, kết quả xấu nhất
+    if (stats) {
+        stats->endpoint = "local";
+        stats->outcome  = LLMCallMetrics::Outcome::Parsed;
+        for (const auto & st : prompt_stats) {
+            stats->prompt_tokens += st.prompt_tokens;
+            stats->generated_tokens += st.generated_tokens;
+            for (auto [from, to] : { std::pair{ &st.dispatched, &stats->dispatched },
+                                     std::pair{ &st.first_token, &stats->first_token } }) {
+                if (*from != std::chrono::steady_clock::time_point{} &&
+                    (*to == std::chrono::steady_clock::time_point{} || *from < *to)) {
+                    *to = *from;
+                }
+            }
+            stats->outcome = std::max(stats->outcome, st.outcome);
+        }
+    }
+
     return results_json.dump();
 }
 
@@ -560,39 +695,211 @@ std::string LLMInference::infer(const std::string & prompt) {
 }
 
 std::string LLMInference::infer(const std::vector<nlohmann::json> & prompts,
-                                const nlohmann::json & response_format) {
+                                const nlohmann::json & response_format, const LLMCallTag & tag) {
+    ScopedTimer  timer("llm.infer");
+    const auto   started = std::chrono::steady_clock::now();
+    RequestStats stats;
+    std::string  result;
     try {
-        if (is_server_mode) {
+        // Lấy phần ngân sách của lượt hiện tại cho request này
+        const int timeout_ms = nextRequestTimeoutMs(1600000);
+        if (timeout_ms <= 0) {
+            log << "⏰ Turn deadline exceeded, request skipped\n";
+            result = R"({"error":"deadline_exceeded"})";
+        } else if (is_server_mode) {
             // Gọi inference qua server nếu ở chế độ server
-            return response(server_ips, prompts, response_format);
+            result = response(server_ips, prompts, response_format, timeout_ms, &stats);
+        } else {
+            // Gọi inference cục bộ
+            result = response(prompts, timeout_ms, &stats);
         }
-        // Gọi inference cục bộ
-        return response(prompts);
     } catch (const std::exception & e) {
         log << "Exception in infer: " << e.what() << "\n";
         std::ostringstream o;
         o << R"({"error":"Exception: )" << e.what() << "\"}";
-        return o.str();
+        result        = o.str();
+        stats.outcome = LLMCallMetrics::Outcome::Failed;
     } catch (...) {
         log << "Unknown exception in infer\n";
-        return R"({"error":"Unknown exception"})";
+        result        = R"({"error":"Unknown exception"})";
+        stats.outcome = LLMCallMetrics::Outcome::Failed;
     }
+    recordCall(tag, started, stats, result);
+    return result;
+}
+
+
+// ========== call metrics ==========
+double LLMCallMetrics::tokensPerSecond() const {
+    const double decode_ms = total_ms - std::max(0.0, ttft_ms);
+    return (ttft_ms < 0 || generated_tokens <= 1 || decode_ms <= 0) ? 0.0 : (generated_tokens - 1) * 1000.0 / decode_ms;
 }
 
+const char * LLMCallMetrics::outcomeName(Outcome outcome) {
+    switch (outcome) {
+        case Outcome::Parsed:
+            return "parsed";
+        case Outcome::Repaired:
+            return "repaired";
+        case Outcome::Failed:
+            return "failed";
+    }
+    return "unknown";
+}
+
+void LLMInference::enableMetrics(bool enable) {
+    metrics_enabled.store(enable, std::memory_order_relaxed);
+}
+
+std::vector<LLMCallMetrics> LLMInference::callMetrics() const {
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    return metrics;
+}
+
+void LLMInference::recordCall(const LLMCallTag & tag, std::chrono::steady_clock::time_point started,
+                              const RequestStats & stats, const std::string & result) {
+    if (!metrics_enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const auto since = [&](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(t - started).count();
+    };
+    const std::chrono::steady_clock::time_point unset{};
+
+    LLMCallMetrics m;
+    m.agent                   = tag.agent;
+    m.turn                    = tag.turn;
+    m.endpoint                = stats.endpoint;
+    m.prompt_tokens           = stats.prompt_tokens;
+    m.prompt_tokens_estimated = stats.prompt_tokens_estimated;
+    m.generated_tokens        = stats.generated_tokens;
+    m.queue_wait_ms           = stats.dispatched == unset ? 0.0 : std::max(0.0, since(stats.dispatched));
+    m.ttft_ms                 = stats.first_token == unset ? -1.0 : since(stats.first_token);
+    m.total_ms                = since(std::chrono::steady_clock::now());
+    m.outcome                 = stats.outcome;
+    if (m.outcome == LLMCallMetrics::Outcome::Failed) {
+        const nlohmann::json j = nlohmann::json::parse(result, nullptr, false);
+        m.error = j.is_object() && j.contains("error") ? j["error"].dump() : "unparsable response";
+    }
+
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    metrics.push_back(std::move(m));
+}
+
+namespace {
+// mean / p50 / p95 / max (phân vị nearest-rank)
+nlohmann::json distribution(std::vector<double> values) {
+    if (values.empty()) {
+        return nullptr;
+    }
+    std::sort(values.begin(), values.end());
+    const auto rank = [&](double q) {
+        const size_t i = static_cast<size_t>(std::ceil(q * values.size()));
+        return values[std::min(values.size(), std::max<size_t>(i, 1)) - 1];
+    };
+    double sum = 0.0;
+    for (double v : values) {
+        sum += v;
+    }
+    return {
+        { "mean", sum / values.size() },
+        { "p50",  rank(0.50)          },
+        { "p95",  rank(0.95)          },
+        { "max",  values.back()       }
+    };
+}
+
+nlohmann::json aggregate(const std::vector<const LLMCallMetrics *> & calls) {
+    std::map<std::string, int> outcomes = {
+        { "parsed", 0 }, { "repaired", 0 }, { "failed", 0 }
+    };
+    long long           prompt_tokens = 0, generated_tokens = 0, rated_tokens = 0;
+    double              decode_ms = 0.0;
+    std::vector<double> queue_wait, ttft, total, rate;
+    for (const auto * m : calls) {
+        ++outcomes[LLMCallMetrics::outcomeName(m->outcome)];
+        prompt_tokens += m->prompt_tokens;
+        generated_tokens += m->generated_tokens;
+        queue_wait.push_back(m->queue_wait_ms);
+        total.push_back(m->total_ms);
+        if (m->ttft_ms >= 0) {
+            ttft.push_back(m->ttft_ms);
+        }
+        if (m->tokensPerSecond() > 0) {
+            rate.push_back(m->tokensPerSecond());
+            decode_ms += m->total_ms - m->ttft_ms;
+            rated_tokens += m->generated_tokens - 1;
+        }
+    }
+    return {
+        { "calls",                    calls.size()                                           },
+        { "outcomes",                 outcomes                                               },
+        { "prompt_tokens",            prompt_tokens                                          },
+        { "generated_tokens",         generated_tokens                                       },
+        { "queue_wait_ms",            distribution(queue_wait)                               },
+        { "ttft_ms",                  distribution(ttft)                                     },
+        { "total_ms",                 distribution(total)                                    },
+        { "tokens_per_sec",           distribution(rate)                                     },
+        { "aggregate_tokens_per_sec", decode_ms > 0 ? rated_tokens * 1000.0 / decode_ms : 0.0 }
+    };
+}
+}  // namespace
+
+bool LLMInference::writeMetrics(const std::string & path) const {
+    const std::vector<LLMCallMetrics> calls = callMetrics();
+
+    std::vector<const LLMCallMetrics *>                        all;
+    std::map<std::string, std::vector<const LLMCallMetrics *>> by_agent;
+    nlohmann::json                                             records = nlohmann::json::array();
+    for (const auto & m : calls) {
+        all.push_back(&m);
+        by_agent[m.agent.empty() ? "(untagged)" : m.agent].push_back(&m);
+        records.push_back({
+            { "agent",                   m.agent                                },
+            { "turn",                    m.turn                                 },
+            { "endpoint",                m.endpoint                             },
+            { "prompt_tokens",           m.prompt_tokens                        },
+            { "prompt_tokens_estimated", m.prompt_tokens_estimated              },
+            { "generated_tokens",        m.generated_tokens                     },
+            { "queue_wait_ms",           m.queue_wait_ms                        },
+            { "ttft_ms",                 m.ttft_ms                              },
+            { "total_ms",                m.total_ms                             },
+            { "tokens_per_sec",          m.tokensPerSecond()                    },
+            { "outcome",                 LLMCallMetrics::outcomeName(m.outcome) },
+            { "error",                   m.error                                }
+        });
+    }
+    nlohmann::json per_agent = nlohmann::json::object();
+    for (const auto & [agent, list] : by_agent) {
+        per_agent[agent] = aggregate(list);
+    }
+
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        return false;
+    }
+    out << nlohmann::json{
+        { "summary",   aggregate(all) },
+        { "per_agent", per_agent      },
+        { "calls",     records        }
+    }.dump(2);
+    return static_cast<bool>(out);
+}
 
 std::string LLMInference::response(const std::vector<std::string> & ips, const std::string & prompts, int timeout_ms) {
     std::vector<nlohmann::json> formatted_prompts;
     if (!validateAndFormatPrompts(prompts, formatted_prompts)) {      
         return R"({"error":"Invalid prompt format"})";
     }
-    return response(ips, formatted_prompts, timeout_ms);
+    return response(ips, formatted_prompts, "", timeout_ms);
 }
 
 
 std::string LLMInference::response(const std::vector<std::string> &    ips,
                                    const std::vector<nlohmann::json> & prompts,
                                    const nlohmann::json & response_format,
-                                   int                                 timeout_ms) {
+                                   int                                 timeout_ms,
+                                   RequestStats *                      stats) {
     log << "🧠 [response] Starting sequential LLM requests...\n";
 
     if (ips.empty()) {
@@ -600,69 +907,108 @@ std::string LLMInference::response(const std::vector<std::string> &    ips,
         return R"({"error":"No IPs provided"})";
     }
 
-    // Dùng atomic<bool> để đảm bảo chỉ một thread set kết quả đầu tiên
-    std::atomic<bool> done(false);
-    std::mutex        result_mutex;
-    std::string       final_result = R"({"error":"No LLM server responded"})";
-
-    // Tạo vector future
-    std::vector<std::future<void>> futures;
-    futures.reserve(ips.size());
-
+    // Bỏ qua endpoint đang bị circuit breaker ngắt
+    std::vector<std::string> live_ips;
     for (const auto & ip : ips) {
-        futures.push_back(std::async(std::launch::async, [&, ip]() {
-            try {
-                if (done.load(std::memory_order_acquire)) {
-                    return;
-                }
-
-                log << "➡️ [Thread] Connecting to LLM server: " << ip << "\n";
-                std::string result = response(ip, prompts, response_format, timeout_ms);
+        if (acquireEndpoint(ip)) {
+            live_ips.push_back(ip);
+        } else {
+            log << "⛔ [response] Skipping " << ip << " (circuit open)\n";
+        }
+    }
+    if (live_ips.empty()) {
+        return R"({"error":"All LLM endpoints circuit-open"})";
+    }
 
-                // Kiểm tra phản hồi
-                nlohmann::json j;
-                try {
-                    j = nlohmann::json::parse(result);
-                } catch (...) {
-                    log << "⚠️ [Thread " << ip << "] Invalid JSON, skipping.\n";
-                    return;
-                }
+    // Trạng thái dùng chung giữa các thread endpoint. Thread thua cuộc được tách (detach) và tự
+    // abort qua cờ done, nên kết quả đầu tiên được trả về ngay không phải chờ request chậm nhất.
+    struct FanoutState {
+        std::atomic<bool>       accepted{ false };  // Chỉ một thread set kết quả đầu tiên
+        std::atomic<bool>       done{ false };      // Cờ huỷ cho các request còn chạy
+        std::mutex              result_mutex;
+        std::condition_variable result_cv;
+        size_t                  finished     = 0;
+        std::string             final_result = R"({"error":"No LLM server responded"})";
+        RequestStats            final_stats;  // Số liệu của request tạo ra final_result
+    };
+    auto state = std::make_shared<FanoutState>();
+
+    for (const auto & ip : live_ips) {
+        in_flight_requests.fetch_add(1);
+        std::thread([this, state, ip, prompts, response_format, timeout_ms]() {
+            const auto   call_start = std::chrono::steady_clock::now();
+            bool         ok         = false;
+            RequestStats request_stats;
+            try {
+                if (!state->done.load(std::memory_order_acquire)) {
+                    log << "➡️ [Thread] Connecting to LLM server: " << ip << "\n";
+                    std::string result =
+                        response(ip, prompts, response_format, timeout_ms, &state->done, &request_stats);
+
+                    // Kiểm tra phản hồi: JSON lỗi không được tính là kết quả hợp lệ
+                    nlohmann::json j;
+                    try {
+                        j  = nlohmann::json::parse(result);
+                        ok = !(j.is_object() && j.contains("error"));
+                    } catch (...) {
+                        log << "⚠️ [Thread " << ip << "] Invalid JSON, skipping.\n";
+                    }
 
-                // Nếu server trả về JSON hợp lệ, nhận kết quả đầu tiên
-                if (!done.exchange(true, std::memory_order_release)) {
-                    std::lock_guard<std::mutex> lock(result_mutex);
-                    final_result = result;
-                    log << "✅ [Thread " << ip << "] Accepted as first valid response.\n";
-                } else {
-                    log << "ℹ️ [Thread " << ip << "] Late response ignored.\n";
+                    std::lock_guard<std::mutex> lock(state->result_mutex);
+                    if (ok && !state->accepted.exchange(true, std::memory_order_acq_rel)) {
+                        state->final_result = result;
+                        state->final_stats  = request_stats;
+                        state->done.store(true, std::memory_order_release);
+                        log << "✅ [Thread " << ip << "] Accepted as first valid response.\n";
+                    } else if (ok) {
+                        log << "ℹ️ [Thread " << ip << "] Late response ignored.\n";
+                    } else if (!state->accepted.load(std::memory_order_acquire)) {
+                        state->final_result = result;  // Giữ lỗi gần nhất nếu không endpoint nào thành công
+                        state->final_stats  = request_stats;
+                    }
                 }
             } catch (const std::exception & e) {
                 log << "❌ [Thread " << ip << "] Exception: " << e.what() << "\n";
             } catch (...) {
                 log << "❌ [Thread " << ip << "] Unknown error.\n";
             }
-        }));
-    }
 
-    // Chờ tất cả thread kết thúc hoặc có kết quả
-    const auto start_time = std::chrono::steady_clock::now();
+            // Request bị huỷ vì endpoint khác đã trả lời thì không tính là lỗi
+            const long long elapsed_ms =
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - call_start)
+                    .count();
+            if (ok || !state->accepted.load(std::memory_order_acquire)) {
+                recordEndpointResult(ip, ok, elapsed_ms);
+            } else {
+                releaseEndpoint(ip);
+            }
 
-    while (!done.load(std::memory_order_acquire)) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        auto elapsed =
-            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time)
-                .count();
-        if (elapsed > timeout_ms) {
-            log << "⏰ Timeout after " << timeout_ms << "ms, no valid response.\n";
-            break;
-        }
+            {
+                std::lock_guard<std::mutex> lock(state->result_mutex);
+                ++state->finished;
+            }
+            state->result_cv.notify_all();
+            in_flight_requests.fetch_sub(1);
+        }).detach();
     }
 
-    // Đợi toàn bộ thread hoàn tất để cleanup
-    for (auto & f : futures) {
-        try {
-            f.wait();
-        } catch (...) {
+    // Chờ kết quả đầu tiên, tất cả thread kết thúc, hoặc hết timeout; sau đó huỷ các request còn chạy
+    std::string final_result;
+    {
+        std::unique_lock<std::mutex> lock(state->result_mutex);
+        const bool                   responded =
+            state->result_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] {
+                return state->accepted.load(std::memory_order_acquire) || state->finished == live_ips.size();
+            });
+        if (!responded) {
+            log << "⏰ Timeout after " << timeout_ms << "ms, no valid response.\n";
+            state->final_result = R"({"error":"deadline_exceeded"})";
+            state->final_stats.outcome = LLMCallMetrics::Outcome::Failed;
+        }
+        state->done.store(true, std::memory_order_release);
+        final_result = state->final_result;
+        if (stats) {
+            *stats = state->final_stats;
         }
     }
 
@@ -680,8 +1026,30 @@ struct StreamContext {
     bool *                                               done_received;         // Cờ hoàn tất stream
     std::mutex *                                         log_mutex;             // Mutex cho log
     std::ostream *                                       log;                   // Stream log
+    struct StreamCounters *                              counters;              // Đếm token/TTFT cho số liệu
+};
+
+// Số liệu stream: mỗi delta nội dung tính là một token; usage_* >= 0 khi server gửi "usage"
+struct StreamCounters {
+    int                                   content_deltas          = 0;
+    std::chrono::steady_clock::time_point first_content{};
+    int                                   usage_prompt_tokens     = -1;
+    int                                   usage_completion_tokens = -1;
 };
 
+static void noteContent(StreamContext * ctx) {
+    ctx->first_token_received->store(true);
+    if (ctx->counters->content_deltas++ == 0) {
+        ctx->counters->first_content = std::chrono::steady_clock::now();
+    }
+}
+
+// Abort transfer khi request bị huỷ (endpoint khác đã trả lời / hết ngân sách lượt)
+static int CancelCallback(void * userp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    const auto * cancel = static_cast<const std::atomic<bool> *>(userp);
+    return (cancel && cancel->load(std::memory_order_acquire)) ? 1 : 0;
+}
+
 static size_t WriteCallback(void * contents, size_t size, size_t nmemb, void * userp) {
     size_t      realsize = size * nmemb;
     auto *      ctx      = static_cast<StreamContext *>(userp);
@@ -712,15 +1080,20 @@ static size_t WriteCallback(void * contents, size_t size, size_t nmemb, void * u
             std::string json_data = line.substr(6);
             try {
                 nlohmann::json chunk_json = nlohmann::json::parse(json_data);
+                if (chunk_json.contains("usage") && chunk_json["usage"].is_object()) {
+                    const auto & usage                     = chunk_json["usage"];
+                    ctx->counters->usage_prompt_tokens     = usage.value("prompt_tokens", -1);
+                    ctx->counters->usage_completion_tokens = usage.value("completion_tokens", -1);
+                }
                 if (chunk_json.contains("choices") && chunk_json["choices"].is_array()) {
                     const auto & ch = chunk_json["choices"][0];
                     if (ch.contains("delta") && ch["delta"].contains("content") && !ch["delta"]["content"].is_null()) {
                         ctx->result->append(ch["delta"]["content"].get<std::string>());
-                        ctx->first_token_received->store(true);
+                        noteContent(ctx);
                     } else if (ch.contains("message") && ch["message"].contains("content") &&
                                !ch["message"]["content"].is_null()) {
                         ctx->result->append(ch["message"]["content"].get<std::string>());
-                        ctx->first_token_received->store(true);
+                        noteContent(ctx);
                     } else {
                         ctx->chunk_buffer.push_back(json_data);
                     }
@@ -738,7 +1111,7 @@ static size_t WriteCallback(void * contents, size_t size, size_t nmemb, void * u
                     if (ch.contains("message") && ch["message"].contains("content") &&
                         !ch["message"]["content"].is_null()) {
                         ctx->result->append(ch["message"]["content"].get<std::string>());
-                        ctx->first_token_received->store(true);
+                        noteContent(ctx);
                     }
                 } else {
                     ctx->chunk_buffer.push_back(line);
@@ -756,15 +1129,30 @@ static size_t WriteCallback(void * contents, size_t size, size_t nmemb, void * u
 std::string LLMInference::response(const std::string &                 ip,
                                    const std::vector<nlohmann::json> & prompts,
                                    const nlohmann::json &              response_format,
-                                   int                                 timeout_ms) {
+                                   int                                 timeout_ms,
+                                   const std::atomic<bool> *           cancel,
+                                   RequestStats *                      stats) {
+    RequestStats   scratch;
+    RequestStats & st = stats ? *stats : scratch;
+    st.endpoint       = ip;
     try {
         // Khởi tạo biến
         std::string                                        result;
+        StreamCounters                                     counters;
+        auto                                               takeCounters = [&]() {
+            st.generated_tokens = counters.usage_completion_tokens >= 0 ? counters.usage_completion_tokens
+                                                                        : counters.content_deltas;
+            st.first_token      = counters.first_content;
+            if (counters.usage_prompt_tokens >= 0) {
+                st.prompt_tokens           = counters.usage_prompt_tokens;
+                st.prompt_tokens_estimated = false;
+            }
+        };
         std::atomic<bool>                                  first_token_received{ false };
         std::atomic<std::chrono::steady_clock::time_point> last_progress_time{ std::chrono::steady_clock::now() };
         bool                                               done_received = false;
-        const int base_timeout_ms = timeout_ms*10;
-        const int low_speed_time  = base_timeout_ms / 3;
+        const int base_timeout_ms = std::max(1, timeout_ms);
+        const int low_speed_time  = std::max(1000, base_timeout_ms / 3);
         CURLcode  res             = CURLE_FAILED_INIT;
         long      http_code       = 0;
 
@@ -786,7 +1174,16 @@ std::string LLMInference::response(const std::string &                 ip,
         if (!response_format.empty()) {
             body["response_format"] = response_format;
         }
+        body["stream_options"] = { { "include_usage", true } };  // Server hỗ trợ sẽ gửi số token chính xác
         std::string body_str = body.dump();
+        if (stats) {
+            for (const auto & msg : formatted_prompts) {
+                if (msg.contains("content") && msg["content"].is_string()) {
+                    st.prompt_tokens += countTokens(msg["content"].get_ref<const std::string &>());
+                }
+            }
+            st.prompt_tokens_estimated = true;
+        }
 
         // Khởi tạo URL
         std::string url = ip + "/v1/chat/completions";
@@ -810,25 +1207,37 @@ std::string LLMInference::response(const std::string &                 ip,
         headers                     = curl_slist_append(headers, "Connection: keep-alive");
 
         StreamContext ctx{
-            &result, "", {}, &first_token_received, &last_progress_time, &done_received, &log_mutex, &log
+            &result, "", {}, &first_token_received, &last_progress_time, &done_received, &log_mutex, &log, &counters
         };
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl, CURLOPT_POST, 1L);
         curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body_str.c_str());
         curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, body_str.size());
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, base_timeout_ms / 1000);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(std::min(10000, base_timeout_ms)));
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(base_timeout_ms));
         curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 50L);
-        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, low_speed_time / 1000);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, static_cast<long>(low_speed_time / 1000));
         curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
         curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
+        if (cancel) {
+            curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+            curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CancelCallback);
+            curl_easy_setopt(curl, CURLOPT_XFERINFODATA, cancel);
+        }
 
         // Thực hiện CURL request
-        res = curl_easy_perform(curl);
+        const auto perform_start = std::chrono::steady_clock::now();
+        {
+            ScopedTimer http_timer("llm.http");
+            res = curl_easy_perform(curl);
+        }
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        curl_off_t pretransfer_us = 0;
+        curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer_us);
+        st.dispatched = perform_start + std::chrono::microseconds(pretransfer_us);
         {
             std::lock_guard<std::mutex> lock(log_mutex);
             log << "ℹ️ CURL perform completed, res=" << curl_easy_strerror(res) << ", HTTP=" << http_code << "\n";
@@ -836,11 +1245,15 @@ std::string LLMInference::response(const std::string &                 ip,
 
         curl_slist_free_all(headers);
         curl_easy_cleanup(curl);
+        takeCounters();
 
         // Kiểm tra lỗi kết nối
         if (res != CURLE_OK || http_code != 200) {
             std::lock_guard<std::mutex> lock(log_mutex);
             log << "❌ Request failed: CURL=" << curl_easy_strerror(res) << ", HTTP=" << http_code << "\n";
+            if (res == CURLE_OPERATION_TIMEDOUT) {
+                return R"JSON({"error":"deadline_exceeded"})JSON";
+            }
             if (!result.empty()) {
                 nlohmann::json wrapped = {
                     {"content", result                                      },
@@ -863,11 +1276,11 @@ std::string LLMInference::response(const std::string &                 ip,
                     const auto & ch = combined_json["choices"][0];
                     if (ch.contains("delta") && ch["delta"].contains("content") && !ch["delta"]["content"].is_null()) {
                         result += ch["delta"]["content"].get<std::string>();
-                        first_token_received = true;
+                        noteContent(&ctx);
                     } else if (ch.contains("message") && ch["message"].contains("content") &&
                                !ch["message"]["content"].is_null()) {
                         result += ch["message"]["content"].get<std::string>();
-                        first_token_received = true;
+                        noteContent(&ctx);
                     }
                 }
             } catch (...) {
@@ -884,11 +1297,11 @@ std::string LLMInference::response(const std::string &                 ip,
                     const auto & ch = temp_json["choices"][0];
                     if (ch.contains("delta") && ch["delta"].contains("content") && !ch["delta"]["content"].is_null()) {
                         result += ch["delta"]["content"].get<std::string>();
-                        first_token_received = true;
+                        noteContent(&ctx);
                     } else if (ch.contains("message") && ch["message"].contains("content") &&
                                !ch["message"]["content"].is_null()) {
                         result += ch["message"]["content"].get<std::string>();
-                        first_token_received = true;
+                        noteContent(&ctx);
                     }
                 }
             } catch (...) {
@@ -898,6 +1311,8 @@ std::string LLMInference::response(const std::string &                 ip,
             }
         }
 
+        takeCounters();
+
         // Kiểm tra kết quả
         if (result.empty()) {
             std::lock_guard<std::mutex> lock(log_mutex);
@@ -916,6 +1331,7 @@ std::string LLMInference::response(const std::string &                 ip,
         // Thử parse JSON
         try {
             nlohmann::json              jres = nlohmann::json::parse(result);
+            st.outcome                       = LLMCallMetrics::Outcome::Parsed;
             std::lock_guard<std::mutex> lock(log_mutex);
             log << "✅ Received valid JSON from " << ip << "\n";
             log << "🏁 [response] Finished. Result length = " << result.size() << "\n";
@@ -927,6 +1343,7 @@ std::string LLMInference::response(const std::string &                 ip,
             if (!done_received) {
                 wrapped["warning"] = "Partial response, server may not have completed";
             }
+            st.outcome = LLMCallMetrics::Outcome::Repaired;
             std::lock_guard<std::mutex> lock(log_mutex);
             log << "✅ [response] Accepted partial response as JSON\n";
             log << "🏁 [response] Finished. Result length = " << result.size() << "\n";
@@ -2,25 +2,82 @@
 #include "llama.h"
 #include "nlohmann/json.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
+// Người gọi một lần infer, gắn vào số liệu của lần gọi đó
+struct LLMCallTag {
+    std::string agent;      // Tên agent, hoặc nguồn khác ("soldier_summary"); rỗng = không rõ
+    int         turn = -1;
+};
+
+// Số liệu một lần infer (battle_config.llm_metrics). Thời gian tính từ lúc gọi infer, ms.
+//   queue_wait_ms : chờ tới khi bắt đầu sinh (local: chờ ctx_mutex; server: kết nối + gửi request)
+//   ttft_ms       : tới token đầu tiên (-1 nếu không có token nào)
+//   outcome       : Parsed = JSON hợp lệ; Repaired = không phải JSON, đã bọc thành {"content": ...};
+//                   Failed = trả về {"error": ...}
+// Server mode đếm mỗi delta stream là một token, trừ khi server gửi "usage"; không có usage thì
+// prompt_tokens là ước lượng (prompt_tokens_estimated).
+struct LLMCallMetrics {
+    enum class Outcome { Parsed, Repaired, Failed };
+
+    std::string agent;
+    int         turn                    = -1;
+    std::string endpoint;  // "local" hoặc URL server đã trả lời
+    int         prompt_tokens           = 0;
+    bool        prompt_tokens_estimated = false;
+    int         generated_tokens        = 0;
+    double      queue_wait_ms           = 0.0;
+    double      ttft_ms                 = -1.0;
+    double      total_ms                = 0.0;
+    Outcome     outcome                 = Outcome::Failed;
+    std::string error;
+
+    // Tốc độ decode: số token sau token đầu / thời gian từ token đầu tới khi xong (0 nếu < 2 token)
+    double tokensPerSecond() const;
+
+    static const char * outcomeName(Outcome outcome);
+};
+
 class LLMInference {
   public:
     LLMInference(const std::string & model, int ngl = 99, int n_ctx = 2048);
     ~LLMInference();
 
     std::string infer(const std::string & prompt);
-    std::string infer(const std::vector<nlohmann::json> & prompts,const nlohmann::json & response_format = "");
+    std::string infer(const std::vector<nlohmann::json> & prompts,const nlohmann::json & response_format = "",
+                      const LLMCallTag & tag = LLMCallTag());
 
     void setSamplerParams(float temperature, float min_p);
     void setLogPath(const std::string & path);
 
+    // Ngân sách thời gian cho một lượt: deadline_ms chia đều cho các request còn lại.
+    // deadline_ms <= 0 tắt ngân sách (dùng timeout mặc định của từng request).
+    void beginTurn(int deadline_ms, int expected_requests);
+    void endTurn();
+    bool deadlineExceeded() const;
+
+    // Circuit breaker cho từng endpoint: sau failure_threshold lần lỗi/chậm liên tiếp
+    // (chậm = lâu hơn slow_call_ms) endpoint bị ngắt trong cooldown_ms rồi thử lại một request.
+    void setCircuitBreaker(int failure_threshold, int slow_call_ms, int cooldown_ms);
+
+    // Số liệu từng lần infer (chỉ overload nhận danh sách prompt); tắt mặc định
+    void                        enableMetrics(bool enable);
+    std::vector<LLMCallMetrics> callMetrics() const;
+    // Ghi file JSON: tổng hợp cả lần chạy, theo agent, và từng lần gọi; false nếu không mở được file
+    bool                        writeMetrics(const std::string & path) const;
+
     bool isInitialized() const noexcept;
 
+    // Đếm token bằng tokenizer của model (local); server mode ước lượng ~4 byte/token.
+    int countTokens(const std::string & text) const;
+
     void reset();
 
   private:
@@ -54,6 +111,46 @@ class LLMInference {
     bool                                                is_server_mode = false;
     std::mutex                                          log_mutex;
 
+    struct EndpointBreaker {
+        int                                   consecutive_failures = 0;
+        bool                                  trial_in_flight      = false;
+        std::chrono::steady_clock::time_point open_until{};
+    };
+
+    std::map<std::string, EndpointBreaker>              breakers;
+    std::mutex                                          breaker_mutex;
+    int                                                 breaker_failure_threshold = 3;
+    int                                                 breaker_slow_call_ms      = 120000;
+    int                                                 breaker_cooldown_ms       = 60000;
+
+    std::chrono::steady_clock::time_point               turn_deadline{};
+    bool                                                has_turn_deadline = false;
+    int                                                 requests_remaining = 0;
+    mutable std::mutex                                  budget_mutex;
+    std::atomic<int>                                    in_flight_requests{ 0 };
+
+    // Số liệu thô của một request, điền dần trong các hàm response(); infer() quy đổi ra LLMCallMetrics
+    struct RequestStats {
+        std::string                           endpoint;
+        int                                   prompt_tokens           = 0;
+        bool                                  prompt_tokens_estimated = false;
+        int                                   generated_tokens        = 0;
+        std::chrono::steady_clock::time_point dispatched{};
+        std::chrono::steady_clock::time_point first_token{};
+        LLMCallMetrics::Outcome               outcome = LLMCallMetrics::Outcome::Failed;
+    };
+
+    std::atomic<bool>                                   metrics_enabled{ false };
+    std::vector<LLMCallMetrics>                         metrics;
+    mutable std::mutex                                  metrics_mutex;
+
+    void recordCall(const LLMCallTag & tag, std::chrono::steady_clock::time_point started,
+                    const RequestStats & stats, const std::string & result);
+
+    int  nextRequestTimeoutMs(int default_timeout_ms);
+    bool acquireEndpoint(const std::string & ip);
+    void releaseEndpoint(const std::string & ip);
+    void recordEndpointResult(const std::string & ip, bool ok, long long elapsed_ms);
 
     void initialize(const std::string & model_path, int ngl, int n_ctx);
 
@@ -61,15 +158,19 @@ class LLMInference {
 
     std::string response(const std::string &                 ip,
                          const std::vector<nlohmann::json> & prompts,
-                         const nlohmann::json & response_format = "",
-                         int timeout_ms = 16000000);
+                         const nlohmann::json &              response_format = "",
+                         int                                 timeout_ms      = 1600000,
+                         const std::atomic<bool> *           cancel          = nullptr,
+                         RequestStats *                      stats           = nullptr);
     std::string response(const std::vector<std::string> &    ips,
                          const std::vector<nlohmann::json> & prompts,
                          const nlohmann::json &              response_format = "",
-                         int                                 timeout_ms =1600000);
+                         int                                 timeout_ms =1600000,
+                         RequestStats *                      stats           = nullptr);
 
     std::string response(const std::string & prompt);
-    std::string response(const std::vector<nlohmann::json> & prompts);
+    std::string response(const std::vector<nlohmann::json> & prompts, int timeout_ms = 0,
+                         RequestStats * stats = nullptr);
 
     bool is_url(const std::string & str) const;  // Hàm kiểm tra URL
 
@@ -0,0 +1,417 @@
+#include "MockLLMServer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#    define NOMINMAX
+#    include <winsock2.h>
+#    include <ws2tcpip.h>
+using socket_t = SOCKET;
+static const socket_t kInvalidSocket = INVALID_SOCKET;
+static const int      kSendFlags     = 0;
+
+static void closeSocket(socket_t s) {
+    closesocket(s);
+}
+#else
+#    include <arpa/inet.h>
+#    include <netinet/in.h>
+#    include <netinet/tcp.h>
+#    include <sys/select.h>
+#    include <sys/socket.h>
+#    include <unistd.h>
+using socket_t = int;
+static const socket_t kInvalidSocket = -1;
+// Client huỷ stream giữa chừng không được làm chết process bằng SIGPIPE
+#    ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#    else
+static const int kSendFlags = 0;
+#    endif
+
+static void closeSocket(socket_t s) {
+    close(s);
+}
+#endif
+
+// ============================================================================
+// CONFIG
+// ============================================================================
+
+MockServerConfig MockServerConfig::fromJson(const nlohmann::json & config) {
+    MockServerConfig c;
+    c.port             = config.value("port", c.port);
+    c.ttft_ms          = config.value("ttft_ms", c.ttft_ms);
+    c.token_latency_ms = config.value("token_latency_ms", c.token_latency_ms);
+    c.chars_per_token  = std::max(1, config.value("chars_per_token", c.chars_per_token));
+    c.error_rate       = std::clamp(config.value("error_rate", c.error_rate), 0.0, 1.0);
+    c.stall_rate       = std::clamp(config.value("stall_rate", c.stall_rate), 0.0, 1.0);
+    c.stall_ms         = config.value("stall_ms", c.stall_ms);
+    c.seed             = config.value("seed", c.seed);
+    c.canned_response  = config.value("canned_response", "");
+    return c;
+}
+
+// ============================================================================
+// CONSTRUCTOR & DESTRUCTOR
+// ============================================================================
+
+MockLLMServer::MockLLMServer(const MockServerConfig & config) : config(config), rng(config.seed) {}
+
+MockLLMServer::~MockLLMServer() {
+    stop();
+}
+
+std::string MockLLMServer::url() const {
+    return "http://127.0.0.1:" + std::to_string(bound_port);
+}
+
+MockServerStats MockLLMServer::stats() const {
+    return { n_requests.load(), n_errors.load(), n_stalls.load() };
+}
+
+bool MockLLMServer::start() {
+    if (running.load()) {
+        return true;
+    }
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        std::cerr << "MockLLMServer: WSAStartup failed\n";
+        return false;
+    }
+#endif
+    socket_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == kInvalidSocket) {
+        std::cerr << "MockLLMServer: cannot create socket\n";
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons(static_cast<unsigned short>(config.port));
+    if (bind(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(s, 128) != 0) {
+        std::cerr << "MockLLMServer: cannot bind/listen on port " << config.port << "\n";
+        closeSocket(s);
+        return false;
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(s, reinterpret_cast<sockaddr *>(&addr), &len);
+    bound_port    = ntohs(addr.sin_port);
+    listen_socket = static_cast<long long>(s);
+
+    running.store(true);
+    accept_thread = std::thread(&MockLLMServer::acceptLoop, this);
+    return true;
+}
+
+void MockLLMServer::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    if (accept_thread.joinable()) {
+        accept_thread.join();
+    }
+    closeSocket(static_cast<socket_t>(listen_socket));
+    listen_socket = -1;
+
+    // Các connection đang stream sẽ thoát vòng lặp khi running = false
+    while (active_connections.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+// ============================================================================
+// NETWORK LOOP
+// ============================================================================
+
+void MockLLMServer::acceptLoop() {
+    socket_t s = static_cast<socket_t>(listen_socket);
+    while (running.load()) {
+        // select() với timeout để stop() không bị kẹt trong accept()
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(s, &readfds);
+        timeval tv{ 0, 100 * 1000 };
+        int     ready = select(static_cast<int>(s) + 1, &readfds, nullptr, nullptr, &tv);
+        if (ready <= 0) {
+            continue;
+        }
+        socket_t client = accept(s, nullptr, nullptr);
+        if (client == kInvalidSocket) {
+            continue;
+        }
+        int nodelay = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&nodelay), sizeof(nodelay));
+
+        active_connections.fetch_add(1);
+        std::thread([this, client]() {
+            handleConnection(static_cast<long long>(client));
+            active_connections.fetch_sub(1);
+        }).detach();
+    }
+}
+
+static bool sendAll(socket_t s, const std::string & data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = send(s, data.data() + sent, static_cast<int>(data.size() - sent), kSendFlags);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// recv() chờ dữ liệu bằng select() 100ms mỗi nhịp (như acceptLoop) để client kết nối rồi im lặng
+// không giữ active_connections mãi và làm stop() treo; <= 0 khi client đóng, lỗi hoặc server dừng
+static int recvWhileRunning(socket_t s, char * buf, size_t len, const std::atomic<bool> & running) {
+    while (running.load()) {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(s, &readfds);
+        timeval tv{ 0, 100 * 1000 };
+        int     ready = select(static_cast<int>(s) + 1, &readfds, nullptr, nullptr, &tv);
+        if (ready < 0) {
+            return -1;
+        }
+        if (ready > 0) {
+            return recv(s, buf, static_cast<int>(len), 0);
+        }
+    }
+    return -1;
+}
+
+void MockLLMServer::handleConnection(long long client_handle) {
+    socket_t    client = static_cast<socket_t>(client_handle);
+    std::string request;
+    char        buf[8192];
+
+    // Đọc header
+    size_t header_end = std::string::npos;
+    while (header_end == std::string::npos) {
+        int n = recvWhileRunning(client, buf, sizeof(buf), running);
+        if (n <= 0) {
+            closeSocket(client);
+            return;
+        }
+        request.append(buf, n);
+        header_end = request.find("\r\n\r\n");
+    }
+
+    size_t      content_length = 0;
+    std::string headers        = request.substr(0, header_end);
+    std::string lower          = headers;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    size_t cl = lower.find("content-length:");
+    if (cl != std::string::npos) {
+        content_length = std::strtoul(headers.c_str() + cl + 15, nullptr, 10);
+    }
+
+    // Đọc body
+    std::string body = request.substr(header_end + 4);
+    while (body.size() < content_length) {
+        int n = recvWhileRunning(client, buf, sizeof(buf), running);
+        if (n <= 0) {
+            break;
+        }
+        body.append(buf, n);
+    }
+    if (!running.load()) {
+        closeSocket(client);
+        return;
+    }
+
+    n_requests.fetch_add(1);
+
+    double error_roll, stall_roll;
+    size_t stall_at_fraction;
+    {
+        std::lock_guard<std::mutex>            lock(rng_mutex);
+        std::uniform_real_distribution<double> uni(0.0, 1.0);
+        error_roll        = uni(rng);
+        stall_roll        = uni(rng);
+        stall_at_fraction = static_cast<size_t>(uni(rng) * 100);
+    }
+
+    if (error_roll < config.error_rate) {
+        n_errors.fetch_add(1);
+        std::string err = R"({"error":{"message":"injected failure","type":"server_error"}})";
+        sendAll(client, "HTTP/1.1 500 Internal Server Error\r\nContent-Type: application/json\r\nContent-Length: " +
+                            std::to_string(err.size()) + "\r\nConnection: close\r\n\r\n" + err);
+        closeSocket(client);
+        return;
+    }
+
+    nlohmann::json req_json;
+    try {
+        req_json = nlohmann::json::parse(body);
+    } catch (...) {
+        std::string err = R"({"error":{"message":"invalid JSON body","type":"invalid_request_error"}})";
+        sendAll(client, "HTTP/1.1 400 Bad Request\r\nContent-Type: application/json\r\nContent-Length: " +
+                            std::to_string(err.size()) + "\r\nConnection: close\r\n\r\n" + err);
+        closeSocket(client);
+        return;
+    }
+
+    std::string content;
+    {
+        std::lock_guard<std::mutex> lock(rng_mutex);
+        content = buildContent(req_json, rng);
+    }
+
+    bool stream = req_json.value("stream", false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.ttft_ms));
+
+    if (!stream) {
+        nlohmann::json resp = {
+            {"id",       "mock-completion"                                                         },
+            { "object",  "chat.completion"                                                         },
+            { "choices", { { { "index", 0 }, { "message", { { "role", "assistant" }, { "content", content } } } } }}
+        };
+        std::string payload = resp.dump();
+        sendAll(client, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                            std::to_string(payload.size()) + "\r\nConnection: close\r\n\r\n" + payload);
+        closeSocket(client);
+        return;
+    }
+
+    if (!sendAll(client, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                         "Connection: close\r\n\r\n")) {
+        closeSocket(client);
+        return;
+    }
+
+    const size_t step     = static_cast<size_t>(config.chars_per_token);
+    const size_t n_chunks = (content.size() + step - 1) / step;
+    const bool   stall    = stall_roll < config.stall_rate;
+    const size_t stall_at = stall ? n_chunks * stall_at_fraction / 100 : n_chunks;
+    if (stall) {
+        n_stalls.fetch_add(1);
+    }
+
+    for (size_t i = 0; i < n_chunks && running.load(); ++i) {
+        if (i == stall_at) {
+            // Ngủ theo lát 50ms để stop() không phải chờ hết stall_ms
+            auto stall_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.stall_ms);
+            while (running.load() && std::chrono::steady_clock::now() < stall_end) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+        nlohmann::json chunk = {
+            {"object",   "chat.completion.chunk"                                                           },
+            { "choices", { { { "index", 0 }, { "delta", { { "content", content.substr(i * step, step) } } } } }}
+        };
+        if (!sendAll(client, "data: " + chunk.dump() + "\n\n")) {
+            closeSocket(client);
+            return;
+        }
+        if (config.token_latency_ms > 0 && i + 1 < n_chunks) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(config.token_latency_ms));
+        }
+    }
+    sendAll(client, "data: [DONE]\n\n");
+    closeSocket(client);
+}
+
+// ============================================================================
+// CONTENT GENERATION
+// ============================================================================
+
+std::string MockLLMServer::buildContent(const nlohmann::json & request, std::mt19937 & gen) const {
+    if (!config.canned_response.empty()) {
+        return config.canned_response;
+    }
+
+    // response_format dạng {"type":"json_schema","json_schema":{"schema":{...}}} hoặc schema trực tiếp
+    if (request.contains("response_format") && request["response_format"].is_object()) {
+        const auto & rf = request["response_format"];
+        if (rf.contains("json_schema") && rf["json_schema"].contains("schema")) {
+            return sampleFromSchema(rf["json_schema"]["schema"], gen).dump();
+        }
+        if (rf.contains("schema")) {
+            return sampleFromSchema(rf["schema"], gen).dump();
+        }
+        if (rf.contains("properties")) {
+            return sampleFromSchema(rf, gen).dump();
+        }
+    }
+
+    return nlohmann::json{
+        {"agentNextActionType", "Hold Position"             },
+        { "agentStage",         "Holding Position"          },
+        { "targetedAgentName",  "None"                      },
+        { "agentMoral",         "Medium"                    },
+        { "speed",              0                           },
+        { "remarks",            "Mock response."            },
+        { "SubAgentsRecall",    nlohmann::json::array()     },
+        { "actions",            nlohmann::json::array()     }
+    }.dump();
+}
+
+nlohmann::json MockLLMServer::sampleFromSchema(const nlohmann::json & schema, std::mt19937 & gen) {
+    if (!schema.is_object()) {
+        return nullptr;
+    }
+    if (schema.contains("enum") && schema["enum"].is_array() && !schema["enum"].empty()) {
+        std::uniform_int_distribution<size_t> pick(0, schema["enum"].size() - 1);
+        return schema["enum"][pick(gen)];
+    }
+
+    std::string type = "object";
+    if (schema.contains("type")) {
+        // "type" có thể là mảng, ví dụ ["string", "null"]
+        type = schema["type"].is_array() ? schema["type"][0].get<std::string>() : schema["type"].get<std::string>();
+    }
+
+    if (type == "object") {
+        nlohmann::json obj = nlohmann::json::object();
+        if (schema.contains("properties")) {
+            for (const auto & [key, sub] : schema["properties"].items()) {
+                obj[key] = sampleFromSchema(sub, gen);
+            }
+        }
+        return obj;
+    }
+    if (type == "array") {
+        nlohmann::json arr     = nlohmann::json::array();
+        size_t         min_len = schema.value("minItems", 0);
+        size_t         max_len = schema.value("maxItems", std::max<size_t>(min_len, 1));
+        std::uniform_int_distribution<size_t> len(min_len, std::max(min_len, max_len));
+        size_t                                n = len(gen);
+        for (size_t i = 0; i < n; ++i) {
+            arr.push_back(schema.contains("items") ? sampleFromSchema(schema["items"], gen) : nlohmann::json("mock"));
+        }
+        return arr;
+    }
+    if (type == "integer") {
+        int lo = schema.value("minimum", 0);
+        int hi = schema.value("maximum", std::max(lo, 100));
+        return std::uniform_int_distribution<int>(lo, std::max(lo, hi))(gen);
+    }
+    if (type == "number") {
+        double lo = schema.value("minimum", 0.0);
+        double hi = schema.value("maximum", std::max(lo, 1.0));
+        return std::uniform_real_distribution<double>(lo, std::max(lo, hi))(gen);
+    }
+    if (type == "boolean") {
+        return std::uniform_int_distribution<int>(0, 1)(gen) == 1;
+    }
+    if (type == "null") {
+        return nullptr;
+    }
+    return "mock";
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "nlohmann/json.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+// Cấu hình cho mock server OpenAI-compatible (/v1/chat/completions).
+// Tất cả độ trễ tính bằng millisecond, các tỉ lệ nằm trong [0, 1].
+struct MockServerConfig {
+    int         port             = 0;     // 0 = để hệ điều hành chọn cổng trống
+    int         ttft_ms          = 50;    // Thời gian tới token đầu tiên
+    int         token_latency_ms = 5;     // Độ trễ giữa các token
+    int         chars_per_token  = 4;     // Kích thước một "token" giả khi stream
+    double      error_rate       = 0.0;   // Tỉ lệ request trả về HTTP 500
+    double      stall_rate       = 0.0;   // Tỉ lệ stream bị treo giữa chừng
+    int         stall_ms         = 5000;  // Thời gian treo khi bị inject stall
+    unsigned    seed             = 42;
+    std::string canned_response;          // Rỗng = sinh nội dung hợp lệ theo response_format
+
+    static MockServerConfig fromJson(const nlohmann::json & config);
+};
+
+struct MockServerStats {
+    long long requests = 0;
+    long long errors   = 0;
+    long long stalls   = 0;
+};
+
+class MockLLMServer {
+  public:
+    explicit MockLLMServer(const MockServerConfig & config);
+    ~MockLLMServer();
+
+    bool start();
+    void stop();
+
+    int             port() const { return bound_port; }
+    std::string     url() const;
+    MockServerStats stats() const;
+
+    // Sinh một giá trị JSON hợp lệ theo JSON schema (object/array/string/enum/number/boolean).
+    static nlohmann::json sampleFromSchema(const nlohmann::json & schema, std::mt19937 & rng);
+
+  private:
+    MockLLMServer(const MockLLMServer &)             = delete;
+    MockLLMServer & operator=(const MockLLMServer &) = delete;
+
+    void        acceptLoop();
+    void        handleConnection(long long client);
+    std::string buildContent(const nlohmann::json & request, std::mt19937 & rng) const;
+
+    MockServerConfig         config;
+    long long                listen_socket = -1;
+    int                      bound_port    = 0;
+    std::atomic<bool>        running{ false };
+    std::thread              accept_thread;
+    std::atomic<int>         active_connections{ 0 };
+    std::mutex               rng_mutex;
+    std::mt19937             rng;
+
+    std::atomic<long long> n_requests{ 0 };
+    std::atomic<long long> n_errors{ 0 };
+    std::atomic<long long> n_stalls{ 0 };
+};
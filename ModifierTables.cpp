@@ -0,0 +1,136 @@
+#include "ModifierTables.h"
+
+namespace {
+// Giá trị cũ được code cứng trong estimateCasualties, dùng khi kịch bản không khai báo
+const std::vector<std::pair<std::string, double>> kDefaultActionCasualty = {
+    { "Launch Full Assault",  1.50 },
+    { "Launch Night Assault", 1.35 },
+    { "Human Wave Assault",   1.80 },
+    { "Hold Position",        0.70 },
+    { "Fortify Position",     0.65 },
+    { "Dig Assault Tunnel",   0.80 },
+    { "Move to Tunnel",       0.75 },
+};
+
+const std::vector<std::pair<std::string, double>> kDefaultTroopAttack = {
+    { "artillery", 1.3 },
+    { "scout",     0.8 },
+};
+
+struct TerrainDefault {
+    const char * name;
+    TerrainType  type;
+    double       attacker;
+    double       defender;
+};
+
+const TerrainDefault kTerrainDefaults[] = {
+    { "Flat",       TerrainType::Flat,       1.30, 1.00 },
+    { "Hills",      TerrainType::Hills,      1.20, 0.80 },
+    { "Valley",     TerrainType::Valley,     1.00, 1.00 },
+    { "River",      TerrainType::River,      1.00, 1.00 },
+    { "Forest",     TerrainType::Forest,     1.15, 0.85 },
+    { "Stronghold", TerrainType::Stronghold, 1.40, 0.65 },
+    { "Airfield",   TerrainType::Airfield,   1.00, 1.00 },
+    { "Tunnel",     TerrainType::Tunnel,     1.00, 1.00 },
+};
+}  // namespace
+
+ModifierTables::ModifierTables() {
+    load(nlohmann::json::object());
+}
+
+int ModifierTables::lookup(const std::unordered_map<std::string, int> & ids, const std::string & name) {
+    auto it = ids.find(name);
+    return it == ids.end() ? 0 : it->second;
+}
+
+int ModifierTables::intern(std::unordered_map<std::string, int> & ids, std::vector<std::string> & names,
+                           const std::string & name) {
+    auto [it, inserted] = ids.emplace(name, static_cast<int>(names.size()));
+    if (inserted) {
+        names.push_back(name);
+    }
+    return it->second;
+}
+
+void ModifierTables::load(const nlohmann::json & config) {
+    action_ids.clear();
+    stage_ids.clear();
+    troop_ids.clear();
+    action_names.assign(1, "");  // id 0: không rõ
+    stage_names.assign(1, "");
+    troop_names.assign(1, "");
+
+    // Actions: khai báo trong actionPropertyDefinition, actionList và các action có hệ số mặc định
+    const nlohmann::json action_defs = config.value("actionPropertyDefinition", nlohmann::json::object());
+    for (auto it = action_defs.begin(); it != action_defs.end(); ++it) {
+        intern(action_ids, action_names, it.key());
+    }
+    const size_t n_defined = action_names.size();
+    if (config.contains("actionList") && config["actionList"].is_array()) {
+        for (const auto & a : config["actionList"]) {
+            if (a.is_string()) {
+                intern(action_ids, action_names, a.get<std::string>());
+            }
+        }
+    }
+    for (const auto & [name, value] : kDefaultActionCasualty) {
+        intern(action_ids, action_names, name);
+    }
+    intern(action_ids, action_names, "Wait without Action");
+
+    action_defined.assign(action_names.size(), 0);
+    action_casualty.assign(action_names.size(), 1.0);
+    for (size_t id = 1; id < action_names.size(); ++id) {
+        action_defined[id] = id < n_defined;
+    }
+    for (const auto & [name, value] : kDefaultActionCasualty) {
+        action_casualty[actionId(name)] = value;
+    }
+    for (auto it = action_defs.begin(); it != action_defs.end(); ++it) {
+        if (it.value().is_object() && it.value().contains("casualty_modifier")) {
+            action_casualty[actionId(it.key())] = it.value()["casualty_modifier"].get<double>();
+        }
+    }
+    tunnel_buffer = 50.0;
+    if (action_defs.contains("Move to Tunnel") && action_defs["Move to Tunnel"].contains("tunnel_buffer")) {
+        tunnel_buffer = action_defs["Move to Tunnel"]["tunnel_buffer"].get<double>();
+    }
+
+    // Stages
+    const nlohmann::json stage_defs = config.value("stagePropertyDefinition", nlohmann::json::object());
+    for (auto it = stage_defs.begin(); it != stage_defs.end(); ++it) {
+        intern(stage_ids, stage_names, it.key());
+    }
+
+    // Troop types
+    for (const auto & [name, value] : kDefaultTroopAttack) {
+        intern(troop_ids, troop_names, name);
+    }
+    const nlohmann::json troop_defs = config.value("troopTypeDefinition", nlohmann::json::object());
+    for (auto it = troop_defs.begin(); it != troop_defs.end(); ++it) {
+        intern(troop_ids, troop_names, it.key());
+    }
+    troop_attack.assign(troop_names.size(), 1.0);
+    for (const auto & [name, value] : kDefaultTroopAttack) {
+        troop_attack[troopTypeId(name)] = value;
+    }
+    for (auto it = troop_defs.begin(); it != troop_defs.end(); ++it) {
+        if (it.value().is_object()) {
+            troop_attack[troopTypeId(it.key())] = it.value().value("attack_modifier", troop_attack[troopTypeId(it.key())]);
+        }
+    }
+
+    // Terrain
+    nlohmann::json terrain_mods = nlohmann::json::object();
+    if (config.contains("terrain_config") && config["terrain_config"].contains("combat_modifiers")) {
+        terrain_mods = config["terrain_config"]["combat_modifiers"];
+    }
+    for (const TerrainDefault & d : kTerrainDefaults) {
+        const size_t         t   = static_cast<size_t>(d.type);
+        const nlohmann::json mod = terrain_mods.value(d.name, nlohmann::json::object());
+        terrain_attacker[t]      = mod.value("attacker", d.attacker);
+        terrain_defender[t]      = mod.value("defender", d.defender);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "BattleField.h"
+#include "nlohmann/json.hpp"
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Bảng hệ số chiến đấu dựng một lần lúc nạp kịch bản:
+//  - Tên action / stage / troop type được intern thành id nhỏ (0 = không rõ, hệ số trung tính),
+//    Profile giữ sẵn actionId/troopTypeId nên công thức thương vong chỉ tra mảng, không so sánh chuỗi.
+//  - Hệ số đọc từ kịch bản, thiếu thì dùng giá trị mặc định cũ:
+//      actionPropertyDefinition.<action>.casualty_modifier
+//      troopTypeDefinition.<troop>.attack_modifier
+//      terrain_config.combat_modifiers.<TerrainType>.{attacker, defender}
+class ModifierTables {
+  public:
+    ModifierTables();
+
+    void load(const nlohmann::json & config);
+
+    int actionId(const std::string & name) const { return lookup(action_ids, name); }
+    int stageId(const std::string & name) const { return lookup(stage_ids, name); }
+    int troopTypeId(const std::string & name) const { return lookup(troop_ids, name); }
+
+    bool                isDefinedAction(int id) const { return action_defined[id] != 0; }  // Có trong actionPropertyDefinition
+    const std::string & actionName(int id) const { return action_names[id]; }
+    const std::string & stageName(int id) const { return stage_names[id]; }
+
+    double actionCasualty(int id) const { return action_casualty[id]; }
+    double troopAttack(int id) const { return troop_attack[id]; }
+    double terrainAttacker(TerrainType type) const { return terrain_attacker[static_cast<size_t>(type)]; }
+    double terrainDefender(TerrainType type) const { return terrain_defender[static_cast<size_t>(type)]; }
+    double tunnelBuffer() const { return tunnel_buffer; }  // actionPropertyDefinition["Move to Tunnel"].tunnel_buffer
+
+  private:
+    static constexpr size_t kTerrainTypes = static_cast<size_t>(TerrainType::Tunnel) + 1;
+
+    static int lookup(const std::unordered_map<std::string, int> & ids, const std::string & name);
+    static int intern(std::unordered_map<std::string, int> & ids, std::vector<std::string> & names,
+                      const std::string & name);
+
+    std::unordered_map<std::string, int> action_ids, stage_ids, troop_ids;
+    std::vector<std::string>             action_names, stage_names, troop_names;
+
+    std::vector<char>   action_defined;
+    std::vector<double> action_casualty;
+    std::vector<double> troop_attack;
+
+    std::array<double, kTerrainTypes> terrain_attacker;
+    std::array<double, kTerrainTypes> terrain_defender;
+    double                            tunnel_buffer = 50.0;
+};
@@ -0,0 +1,299 @@
+#include "MovementEngine.h"
+
+#include "BattleField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace {
+constexpr float kImpassable = std::numeric_limits<float>::infinity();
+
+// 8 hướng lân cận; kReverse[k] là hướng ngược của k
+constexpr int kDx[8]      = { 1, -1, 0, 0, 1, 1, -1, -1 };
+constexpr int kDy[8]      = { 0, 0, 1, -1, 1, -1, 1, -1 };
+constexpr int kReverse[8] = { 1, 0, 3, 2, 7, 6, 5, 4 };
+
+// Chi phí trên mỗi mét tại (x, y): nghịch đảo speed_multiplier của terrain gần nhất
+double costAt(const BattleField & field, double x, double y) {
+    const TerrainObject * terrain = field.getTerrainObject(x, y);
+    const double          mult    = terrain ? terrain->speed_multiplier : 1.0;
+    return 1.0 / std::max(mult, 0.05);
+}
+}  // namespace
+
+void MovementEngine::configure(const nlohmann::json & battle_config) {
+    is_enabled       = battle_config.value("movement_engine", is_enabled);
+    meters_per_speed = battle_config.value("movement_meters_per_speed", meters_per_speed);
+    max_per_turn     = battle_config.value("movement_max_per_turn", max_per_turn);
+    snap_radius      = battle_config.value("movement_snap_radius", snap_radius);
+
+    const double new_cell = battle_config.value("movement_cell", cell);
+    if (new_cell > 0 && new_cell != cell) {
+        cell = new_cell;
+        invalidate();
+    }
+}
+
+void MovementEngine::invalidate() {
+    grid_valid = false;
+    cost.clear();
+    edges.clear();
+    objectives.clear();
+    fields.clear();
+}
+
+double MovementEngine::budgetFor(double speed, double weather_speed) const {
+    if (speed <= 0) {
+        return 0.0;
+    }
+    return std::min(speed * meters_per_speed, max_per_turn) * std::max(weather_speed, 0.0);
+}
+
+int MovementEngine::cellIndex(const Position & p) const {
+    const int cx = std::min(cols - 1, std::max(0, static_cast<int>(std::lround((p.x - origin_x) / cell))));
+    const int cy = std::min(rows - 1, std::max(0, static_cast<int>(std::lround((p.y - origin_y) / cell))));
+    return cy * cols + cx;
+}
+
+Position MovementEngine::cellCenter(int index) const {
+    return { origin_x + (index % cols) * cell, origin_y + (index / cols) * cell };
+}
+
+void MovementEngine::ensureGrid(const BattleField & field) {
+    if (grid_valid && width == field.width && height == field.height) {
+        return;
+    }
+    invalidate();
+    width    = field.width;
+    height   = field.height;
+    origin_x = -width / 2;
+    origin_y = -height / 2;
+    cols     = std::max(1, static_cast<int>(std::floor(width / cell)) + 1);
+    rows     = std::max(1, static_cast<int>(std::floor(height / cell)) + 1);
+
+    cost.assign(static_cast<size_t>(cols) * rows, kImpassable);
+    for (int i = 0; i < cols * rows; ++i) {
+        const Position c = cellCenter(i);
+        if (field.isValidPosition(c.x, c.y)) {
+            cost[i] = static_cast<float>(costAt(field, c.x, c.y));
+        }
+    }
+
+    // Cạnh thông: cùng các điểm mẫu mà walkStraight sẽ đi, tránh cắt góc qua mép sông
+    edges.assign(cost.size(), 0);
+    for (int i = 0; i < cols * rows; ++i) {
+        if (std::isinf(cost[i])) {
+            continue;
+        }
+        const int cx = i % cols, cy = i / cols;
+        for (int k = 0; k < 8; ++k) {
+            const int nx = cx + kDx[k], ny = cy + kDy[k];
+            if (nx < 0 || ny < 0 || nx >= cols || ny >= rows) {
+                continue;
+            }
+            const int n = ny * cols + nx;
+            if (!std::isinf(cost[n]) && segmentClear(field, cellCenter(i), cellCenter(n))) {
+                edges[i] |= static_cast<unsigned char>(1u << k);
+            }
+        }
+    }
+
+    for (const auto & obj : field.getTerrainObjects()) {
+        if (obj.type == TerrainType::Stronghold) {
+            objectives.push_back(obj.position);
+        } else if (obj.type == TerrainType::Tunnel) {
+            objectives.push_back(obj.position);
+            objectives.push_back(obj.end_position);
+        }
+    }
+    fields.assign(objectives.size(), {});
+    grid_valid = true;
+}
+
+int MovementEngine::objectiveFor(const Position & desired) const {
+    int    best      = -1;
+    double best_dist = snap_radius;
+    for (size_t i = 0; i < objectives.size(); ++i) {
+        const double d = std::hypot(objectives[i].x - desired.x, objectives[i].y - desired.y);
+        if (d <= best_dist) {
+            best      = static_cast<int>(i);
+            best_dist = d;
+        }
+    }
+    return best;
+}
+
+// Dijkstra 8 hướng; cạnh a→b tốn độ dài × trung bình chi phí hai ô và chỉ dùng được khi đoạn b→a thông
+// (đơn vị đi ngược chiều relax). Ô objective không đi được thì gieo các ô hợp lệ quanh nó.
+const std::vector<float> & MovementEngine::flowField(int objective) {
+    std::vector<float> & dist = fields[objective];
+    if (!dist.empty()) {
+        return dist;
+    }
+    dist.assign(cost.size(), kImpassable);
+
+    using Entry = std::pair<float, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+    const Position & target = objectives[objective];
+    const int        goal   = cellIndex(target);
+    if (!std::isinf(cost[goal])) {
+        dist[goal] = 0.0f;
+        open.push({ 0.0f, goal });
+    } else {
+        const int gx = goal % cols, gy = goal / cols;
+        for (int ny = std::max(0, gy - 2); ny <= std::min(rows - 1, gy + 2); ++ny) {
+            for (int nx = std::max(0, gx - 2); nx <= std::min(cols - 1, gx + 2); ++nx) {
+                const int n = ny * cols + nx;
+                if (!std::isinf(cost[n])) {
+                    const Position c = cellCenter(n);
+                    dist[n]          = static_cast<float>(std::hypot(c.x - target.x, c.y - target.y));
+                    open.push({ dist[n], n });
+                }
+            }
+        }
+    }
+
+    const float diag = static_cast<float>(cell * std::sqrt(2.0));
+    const float side = static_cast<float>(cell);
+
+    while (!open.empty()) {
+        const auto [d, cur] = open.top();
+        open.pop();
+        if (d > dist[cur]) {
+            continue;
+        }
+        const int cx = cur % cols, cy = cur / cols;
+        for (int k = 0; k < 8; ++k) {
+            const int nx = cx + kDx[k], ny = cy + kDy[k];
+            if (nx < 0 || ny < 0 || nx >= cols || ny >= rows) {
+                continue;
+            }
+            const int next = ny * cols + nx;
+            if (!(edges[next] & (1u << kReverse[k]))) {
+                continue;
+            }
+            const float nd = d + (k < 4 ? side : diag) * 0.5f * (cost[cur] + cost[next]);
+            if (nd < dist[next]) {
+                dist[next] = nd;
+                open.push({ nd, next });
+            }
+        }
+    }
+    return dist;
+}
+
+// Điểm lấy mẫu của đoạn from→to: bước nửa ô, điểm cuối đúng bằng to
+int MovementEngine::sampleCount(double len) const {
+    return std::max(1, static_cast<int>(std::ceil(len / (cell * 0.5))));
+}
+
+bool MovementEngine::segmentClear(const BattleField & field, const Position & from, const Position & to) const {
+    const int steps = sampleCount(std::hypot(to.x - from.x, to.y - from.y));
+    for (int i = 1; i <= steps; ++i) {
+        const double   t = static_cast<double>(i) / steps;
+        const Position q = i == steps ? to : Position{ from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t };
+        if (!field.isValidPosition(q.x, q.y)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Đi thẳng, trừ budget theo chi phí terrain tại mỗi điểm mẫu; dừng trước vị trí không hợp lệ.
+// Trả về true khi tới được to (out = to), ngược lại out là điểm dừng.
+bool MovementEngine::walkStraight(const BattleField & field, const Position & from, const Position & to,
+                                  double & budget, Position & out) const {
+    out              = from;
+    const double len = std::hypot(to.x - from.x, to.y - from.y);
+    if (len < 1e-9) {
+        out = to;
+        return true;
+    }
+    const int    steps = sampleCount(len);
+    const double step  = len / steps;
+    for (int i = 1; i <= steps; ++i) {
+        if (budget <= 0) {
+            return false;
+        }
+        const double   t = static_cast<double>(i) / steps;
+        const Position q = i == steps ? to : Position{ from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t };
+        if (!field.isValidPosition(q.x, q.y)) {
+            return false;
+        }
+        const double need = step * costAt(field, q.x, q.y);
+        if (need > budget) {
+            const double   frac    = budget / need;
+            const Position partial = { out.x + (q.x - out.x) * frac, out.y + (q.y - out.y) * frac };
+            budget                 = 0;
+            if (field.isValidPosition(partial.x, partial.y)) {
+                out = partial;
+            }
+            return false;
+        }
+        budget -= need;
+        out = q;
+    }
+    return true;
+}
+
+Position MovementEngine::advance(const BattleField & field, const Position & from, const Position & desired,
+                                 double budget) {
+    if (budget <= 0) {
+        return from;
+    }
+    ensureGrid(field);
+
+    Position  pos       = from;
+    const int objective = objectiveFor(desired);
+    if (objective < 0) {
+        walkStraight(field, from, desired, budget, pos);
+        return pos;
+    }
+
+    const std::vector<float> & dist = flowField(objective);
+    int                        cur  = cellIndex(from);
+    if (std::isinf(dist[cur])) {
+        walkStraight(field, from, desired, budget, pos);  // Không có đường trên lưới
+        return pos;
+    }
+
+    // Lần theo ô lân cận (cạnh thông) có khoảng cách nhỏ nhất tới objective, tới khi hết budget
+    // hoặc tới đáy của field, rồi đi thẳng nốt tới điểm đến
+    while (budget > 0) {
+        const int cx = cur % cols, cy = cur / cols;
+        int       best = -1;
+        for (int k = 0; k < 8; ++k) {
+            const int nx = cx + kDx[k], ny = cy + kDy[k];
+            if (nx < 0 || ny < 0 || nx >= cols || ny >= rows || !(edges[cur] & (1u << k))) {
+                continue;
+            }
+            const int n = ny * cols + nx;
+            if (dist[n] < (best < 0 ? dist[cur] : dist[best])) {
+                best = n;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        Position next;
+        if (!walkStraight(field, pos, cellCenter(best), budget, next)) {
+            // Đang lệch khỏi nút lưới và đường chéo bị chặn: về nút hiện tại trước
+            const Position node = cellCenter(cur);
+            if (budget <= 0 || (next.x == node.x && next.y == node.y) || !walkStraight(field, next, node, budget, next)) {
+                return next;
+            }
+            pos = next;
+            continue;
+        }
+        pos = next;
+        cur = best;
+    }
+    if (budget > 0) {
+        walkStraight(field, pos, desired, budget, pos);
+    }
+    return pos;
+}
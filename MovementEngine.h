@@ -0,0 +1,58 @@
+#pragma once
+#include "nlohmann/json.hpp"
+#include "Profile.h"
+
+#include <vector>
+
+class BattleField;
+
+// Di chuyển theo lưới chi phí địa hình thay cho việc "dịch chuyển tức thời" tới agentNextPosition:
+//  - Lưới chi phí = 1 / speed_multiplier của terrain tại ô; ô không hợp lệ (sông, tunnel power <= 0,
+//    ngoài bản đồ) là không đi được.
+//  - Mỗi mục tiêu (stronghold, hai đầu tunnel) có một flow field (Dijkstra 8 hướng) tính lười một lần
+//    cho tới khi terrain đổi; mọi đơn vị hướng tới cùng mục tiêu dùng chung field đó.
+//  - Điểm đến không gần mục tiêu nào: đi thẳng, dừng trước ô không đi được.
+//  - Quãng đường mỗi lượt = min(speed × meters_per_speed, max_per_turn) × speedModifier của thời tiết,
+//    trừ dần theo chi phí từng ô đi qua.
+class MovementEngine {
+  public:
+    void configure(const nlohmann::json & battle_config);
+    void invalidate();  // Terrain / kích thước bản đồ đổi
+
+    bool enabled() const { return is_enabled; }
+
+    // Quãng đường (m) được đi trong lượt với speed của agent và speed_modifier của thời tiết
+    double budgetFor(double speed, double weather_speed) const;
+
+    // Vị trí sau khi đi từ from về phía desired với quãng đường budget
+    Position advance(const BattleField & field, const Position & from, const Position & desired, double budget);
+
+  private:
+    void                       ensureGrid(const BattleField & field);
+    int                        objectiveFor(const Position & desired) const;
+    const std::vector<float> & flowField(int objective);
+    int                        cellIndex(const Position & p) const;
+    Position                   cellCenter(int index) const;
+    int                        sampleCount(double len) const;
+    bool                       segmentClear(const BattleField & field, const Position & from, const Position & to) const;
+    bool                       walkStraight(const BattleField & field, const Position & from, const Position & to,
+                                            double & budget, Position & out) const;
+
+    bool   is_enabled       = false;
+    double cell             = 20.0;
+    double meters_per_speed = 25.0;
+    double max_per_turn     = 400.0;
+    double snap_radius      = 100.0;
+
+    bool                            grid_valid = false;
+    double                          width      = 0;
+    double                          height     = 0;
+    double                          origin_x   = 0;
+    double                          origin_y   = 0;
+    int                             cols       = 0;
+    int                             rows       = 0;
+    std::vector<float>              cost;        // Chi phí trên mỗi mét; +inf = không đi được
+    std::vector<unsigned char>      edges;       // Bit k: đi thẳng tới lân cận hướng k không bị chặn
+    std::vector<Position>           objectives;  // Stronghold, đầu tunnel
+    std::vector<std::vector<float>> fields;      // Khoảng cách có trọng số tới objective; rỗng = chưa tính
+};
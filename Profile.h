@@ -1,5 +1,6 @@
 #pragma once
 #include "nlohmann/json.hpp"
+#include "ScenarioText.h"
 #include <string>
 #include <iostream>
 #include <map>
@@ -24,19 +25,22 @@ public:
     std::string commander;
     std::string troopType;
 
-    std::string historySetting;
-    std::string armySetting;
-    std::string roleSetting;
+    // Văn bản kịch bản giống nhau giữa các agent: handle vào ScenarioTextStore, không copy theo từng Profile
+    SharedText historySetting;
+    SharedText armySetting;
+    SharedText roleSetting;
     std::string troopInformation;
     std::string currentBattlefieldSituation;
-    std::string actionList;
-    std::string actionPropertyDefinition;
-    std::string stagePropertyDefinition;
-    std::string actionInstructionBlock;
-    std::string jsonConstraintVariable;
+    SharedText actionList;
+    SharedText actionPropertyDefinition;
+    SharedText stagePropertyDefinition;
+    SharedText actionInstructionBlock;
+    SharedText jsonConstraintVariable;
     std::string initialMission;
 
     std::string currentAction;
+    int actionId = 0;     // Id đã intern trong ModifierTables (0 = không rõ)
+    int troopTypeId = 0;
     std::string currentStage;
     Position targetPosition;
     std::string targetedAgentName;
@@ -122,19 +126,19 @@ public:
                 }
             }
 
-            historySetting           = config.value("historySetting", "");
-            armySetting              = config.value("armySetting", "");
-            roleSetting              = config.value("roleSetting", "");
+            historySetting           = SharedText::intern(config.value("historySetting", ""));
+            armySetting              = SharedText::intern(config.value("armySetting", ""));
+            roleSetting              = SharedText::intern(config.value("roleSetting", ""));
             troopInformation         = config.value("troopInformation", "");
-            actionList               = config.value("actionList", "[]");
-            actionPropertyDefinition = config.value("actionPropertyDefinition", "{}");
-            stagePropertyDefinition  = config.value("stagePropertyDefinition", "{}");
+            actionList               = SharedText::intern(config.value("actionList", "[]"));
+            actionPropertyDefinition = SharedText::intern(config.value("actionPropertyDefinition", "{}"));
+            stagePropertyDefinition  = SharedText::intern(config.value("stagePropertyDefinition", "{}"));
             // Sửa actionInstructionBlock
-            actionInstructionBlock =
+            actionInstructionBlock = SharedText::intern(
                 config.contains("actionInstructionBlock") && config["actionInstructionBlock"].is_object() ?
                     config["actionInstructionBlock"].dump() :
-                    config.value("actionInstructionBlock", "");
-            jsonConstraintVariable      = config.value("jsonConstraintVariable", "{}");
+                    config.value("actionInstructionBlock", ""));
+            jsonConstraintVariable      = SharedText::intern(config.value("jsonConstraintVariable", "{}"));
             initialMission              = config.value("initialMission", "");
             currentBattlefieldSituation = config.value("currentBattlefieldSituation", "");
         } catch (const std::exception & e) {
@@ -149,6 +153,18 @@ public:
 
     bool operator!=(const Profile & other) const noexcept { return !(*this == other); }
 
+    // Dùng chung văn bản kịch bản của profile khác (sub-agent nhận từ agent cha): chỉ copy handle
+    void shareScenarioText(const Profile & other) {
+        historySetting           = other.historySetting;
+        armySetting              = other.armySetting;
+        roleSetting              = other.roleSetting;
+        actionList               = other.actionList;
+        actionPropertyDefinition = other.actionPropertyDefinition;
+        stagePropertyDefinition  = other.stagePropertyDefinition;
+        actionInstructionBlock   = other.actionInstructionBlock;
+        jsonConstraintVariable   = other.jsonConstraintVariable;
+    }
+
     int remainingNumOfTroops() const {
         return std::max(0, initialNumOfTroops - deployedNumOfTroops - lostNumOfTroops);
     }
@@ -0,0 +1,150 @@
+#include "Profiler.h"
+
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+void Profiler::Histogram::add(double us) {
+    ++count;
+    total_us += us;
+    max_us = std::max(max_us, us);
+    size_t bucket = 0;
+    for (double bound = 1.0; us >= bound && bucket + 1 < kBuckets; bound *= 2.0) {
+        ++bucket;
+    }
+    ++buckets[bucket];
+}
+
+void Profiler::Histogram::merge(const Histogram & other) {
+    count += other.count;
+    total_us += other.total_us;
+    max_us = std::max(max_us, other.max_us);
+    for (size_t i = 0; i < kBuckets; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+double Profiler::Histogram::percentile(double q) const {
+    if (count == 0) {
+        return 0.0;
+    }
+    const uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    uint64_t       seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= std::max<uint64_t>(rank, 1)) {
+            return std::min(std::ldexp(1.0, static_cast<int>(i)), max_us);
+        }
+    }
+    return max_us;
+}
+
+Profiler & Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::configure(bool enable, const std::string & chrome_trace_path, size_t max_events) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    origin_     = std::chrono::steady_clock::now();
+    trace_path_ = enable ? chrome_trace_path : "";
+    max_events_ = trace_path_.empty() ? 0 : max_events;
+    dropped_    = 0;
+    events_.clear();
+    events_.reserve(std::min<size_t>(max_events_, 65536));
+    turn_phases_.clear();
+    run_phases_.clear();
+    threads_.clear();
+    enabled_.store(enable, std::memory_order_relaxed);
+}
+
+uint32_t Profiler::threadIndex(std::thread::id id) {
+    auto it = threads_.find(id);
+    if (it == threads_.end()) {
+        it = threads_.emplace(id, static_cast<uint32_t>(threads_.size() + 1)).first;
+    }
+    return it->second;
+}
+
+void Profiler::record(const char * name, std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point end) {
+    const double dur_us = std::chrono::duration<double, std::micro>(end - start).count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    turn_phases_[name].add(dur_us);
+    run_phases_[name].add(dur_us);
+    if (max_events_ == 0) {
+        return;
+    }
+    if (events_.size() >= max_events_) {
+        ++dropped_;
+        return;
+    }
+    const double ts_us = std::chrono::duration<double, std::micro>(start - origin_).count();
+    events_.push_back({ name, ts_us, dur_us, threadIndex(std::this_thread::get_id()),
+                        turn_.load(std::memory_order_relaxed) });
+}
+
+std::vector<std::string> Profiler::describe(const PhaseMap & phases) {
+    std::map<std::string, Histogram> by_name;
+    for (const auto & [name, hist] : phases) {
+        by_name[name].merge(hist);
+    }
+    std::vector<std::pair<std::string, const Histogram *>> order;
+    for (const auto & [name, hist] : by_name) {
+        order.emplace_back(name, &hist);
+    }
+    std::sort(order.begin(), order.end(),
+              [](const auto & a, const auto & b) { return a.second->total_us > b.second->total_us; });
+
+    std::vector<std::string> lines;
+    for (const auto & [name, hist] : order) {
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(3) << name << ": n=" << hist->count
+             << " total=" << hist->total_us / 1000.0 << "ms mean=" << hist->total_us / hist->count / 1000.0
+             << "ms p50<=" << hist->percentile(0.5) / 1000.0 << "ms p95<=" << hist->percentile(0.95) / 1000.0
+             << "ms max=" << hist->max_us / 1000.0 << "ms";
+        lines.push_back(line.str());
+    }
+    return lines;
+}
+
+std::vector<std::string> Profiler::endTurn() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> lines = describe(turn_phases_);
+    turn_phases_.clear();
+    return lines;
+}
+
+std::vector<std::string> Profiler::summary() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return describe(run_phases_);
+}
+
+bool Profiler::writeChromeTrace() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (trace_path_.empty()) {
+        return false;
+    }
+    std::ofstream out(trace_path_);
+    if (!out.is_open()) {
+        return false;
+    }
+    // Định dạng trace-event: mỗi span là một event "X" (complete), ts/dur tính bằng µs
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"BattleAgent\"}}";
+    for (const auto & [id, index] : threads_) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << index
+            << ",\"args\":{\"name\":\"thread " << index << "\"}}";
+    }
+    out << std::fixed << std::setprecision(3);
+    for (const auto & e : events_) {
+        out << ",\n{\"name\":" << nlohmann::json(e.name).dump() << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+            << ",\"ts\":" << e.ts_us << ",\"dur\":" << e.dur_us << ",\"args\":{\"turn\":" << e.turn << "}}";
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
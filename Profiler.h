@@ -0,0 +1,112 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Đo thời gian theo pha (battle_config.profile): ScopedTimer ghi thời lượng của một scope vào Profiler,
+// Profiler gom thành histogram theo lượt + tổng cả lần chạy, và (tuỳ chọn) ghi từng span ra file
+// Chrome trace-event JSON (battle_config.profile_chrome_trace) để mở bằng chrome://tracing hoặc Perfetto.
+//
+// Một instance cho cả tiến trình vì LLMInference không có con trỏ Simulation và chạy trên nhiều luồng;
+// record() khoá mutex. Tắt profile thì ScopedTimer chỉ đọc một cờ atomic, không gọi đồng hồ.
+// Pha lồng nhau (agent.execute chứa llm.infer...) được tính bao hàm, mỗi pha một histogram riêng.
+// Tên pha phải là chuỗi hằng (const char* sống hết chương trình): histogram khoá theo con trỏ, record() không
+// tạo std::string; cùng một tên ở nhiều translation unit có thể khác con trỏ nên describe() gộp lại theo nội dung.
+class Profiler {
+  public:
+    // Bucket i chứa thời lượng trong [2^(i-1), 2^i) µs; bucket 0 là < 1 µs, bucket cuối gom phần còn lại
+    static constexpr size_t kBuckets = 32;
+
+    struct Histogram {
+        uint64_t                       count    = 0;
+        double                         total_us = 0.0;
+        double                         max_us   = 0.0;
+        std::array<uint64_t, kBuckets> buckets{};
+
+        void   add(double us);
+        void   merge(const Histogram & other);
+        // Cận trên của bucket chứa phân vị q (0..1), µs
+        double percentile(double q) const;
+    };
+
+    static Profiler & instance();
+
+    // max_events: số span tối đa giữ cho Chrome trace (quá thì bỏ, đếm lại); path rỗng = không ghi trace
+    void configure(bool enable, const std::string & chrome_trace_path = "", size_t max_events = 1000000);
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Lượt hiện tại: span ghi sau lời gọi này được gắn vào lượt đó
+    void setTurn(int turn) { turn_.store(turn, std::memory_order_relaxed); }
+
+    void record(const char * name, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end);
+
+    // Tóm tắt histogram của lượt hiện tại (một dòng mỗi pha, sắp theo tổng thời gian) rồi xoá để sang lượt mới
+    std::vector<std::string> endTurn();
+    // Tóm tắt tổng cả lần chạy
+    std::vector<std::string> summary() const;
+
+    // Ghi các span đã giữ ra chrome_trace_path; false nếu không bật trace hoặc không mở được file
+    bool writeChromeTrace();
+    size_t droppedEvents() const { return dropped_; }
+
+  private:
+    struct Event {
+        const char * name;
+        double       ts_us;
+        double       dur_us;
+        uint32_t     tid;
+        int          turn;
+    };
+
+    Profiler() = default;
+
+    using PhaseMap = std::unordered_map<const char *, Histogram>;
+
+    static std::vector<std::string> describe(const PhaseMap & phases);
+    uint32_t                        threadIndex(std::thread::id id);
+
+    std::atomic<bool> enabled_{ false };
+    std::atomic<int>  turn_{ 0 };
+
+    mutable std::mutex                    mutex_;
+    std::chrono::steady_clock::time_point origin_ = std::chrono::steady_clock::now();
+    PhaseMap                              turn_phases_;
+    PhaseMap                              run_phases_;
+    std::string                           trace_path_;
+    std::vector<Event>                    events_;
+    size_t                                max_events_ = 0;
+    size_t                                dropped_    = 0;
+    std::map<std::thread::id, uint32_t>   threads_;
+};
+
+// Đo từ lúc khởi tạo đến khi ra khỏi scope:
+//   ScopedTimer timer("llm.decode");
+class ScopedTimer {
+  public:
+    explicit ScopedTimer(const char * name) : name_(Profiler::instance().enabled() ? name : nullptr) {
+        if (name_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer() {
+        if (name_) {
+            Profiler::instance().record(name_, start_, std::chrono::steady_clock::now());
+        }
+    }
+
+    ScopedTimer(const ScopedTimer &)             = delete;
+    ScopedTimer & operator=(const ScopedTimer &) = delete;
+
+  private:
+    const char *                          name_;
+    std::chrono::steady_clock::time_point start_;
+};
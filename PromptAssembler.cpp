@@ -0,0 +1,140 @@
+#include "PromptAssembler.h"
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+
+// Section còn ít hơn ngần này token thì bỏ hẳn thay vì cắt vụn
+static const int kMinTruncatedSectionTokens = 32;
+
+PromptAssembler::PromptAssembler(const nlohmann::json & config) {
+    auto compact = [&](const char * key) -> std::string {
+        return config.contains(key) ? config[key].dump() : std::string("{}");
+    };
+
+    system_prompt = config.contains("prompt") ? config["prompt"].get<std::string>() : std::string();
+
+    std::ostringstream oss;
+    oss << "\n--- ACTION & STAGE DEFINITIONS ---\n";
+    oss << "actionList:\n" << compact("actionList") << "\n";
+    oss << "actionPropertyDefinition:\n" << compact("actionPropertyDefinition") << "\n";
+    oss << "stagePropertyDefinition:\n" << compact("stagePropertyDefinition") << "\n";
+
+    oss << "\n!!! CRITICAL: FOLLOW ALL RULES IN definitionOfJsonKeys !!!\n";
+    oss << "definitionOfJsonKeys:\n" << compact("definitionOfJsonKeys") << "\n";
+
+    oss << "\n--- ACTION INSTRUCTION BLOCK ---\n";
+    oss << "actionInstructionBlock:\n" << compact("actionInstructionBlock") << "\n";
+    static_definitions = oss.str();
+}
+
+void PromptAssembler::setTokenCounter(TokenCounter counter) {
+    token_counter = std::move(counter);
+}
+
+int PromptAssembler::countTokens(const std::string & text) const {
+    if (token_counter) {
+        return token_counter(text);
+    }
+    return static_cast<int>((text.size() + 3) / 4);  // Ước lượng ~4 byte/token
+}
+
+const std::string & PromptAssembler::systemBlock(const std::string & historySetting,
+                                                 const std::string & armySetting,
+                                                 const std::string & roleSetting) {
+    std::string key = historySetting;
+    key.append(1, '\x1f').append(armySetting).append(1, '\x1f').append(roleSetting);
+
+    std::lock_guard<std::mutex> lock(system_mutex);
+    auto                        it = system_blocks.find(key);
+    if (it != system_blocks.end()) {
+        return it->second;
+    }
+
+    std::ostringstream oss;
+    oss << "### SYSTEM INSTRUCTION & GLOBAL CONTEXT ###\n\n";
+    oss << "--- GLOBAL SETTINGS ---\n";
+    oss << "SystemPrompt: " << system_prompt << "\n";
+    oss << "HistorySetting: " << historySetting << "\n";
+    oss << "ArmySetting: " << armySetting << "\n";
+    oss << "RoleSetting: " << roleSetting << "\n";
+    oss << static_definitions;
+
+    return system_blocks.emplace(std::move(key), oss.str()).first->second;
+}
+
+std::string PromptAssembler::assemble(const std::vector<PromptSection> & sections, int budget_tokens,
+                                      int * used_tokens) const {
+    std::vector<int>         tokens(sections.size(), 0);
+    std::vector<std::string> chosen(sections.size());
+
+    int used = 0;
+    for (size_t i = 0; i < sections.size(); ++i) {
+        tokens[i] = countTokens(sections[i].text);
+        if (sections[i].required || budget_tokens <= 0) {
+            chosen[i] = sections[i].text;
+            used += tokens[i];
+        }
+    }
+
+    if (budget_tokens > 0) {
+        // Lấp phần còn lại theo priority (ổn định theo thứ tự xuất hiện)
+        std::vector<size_t> order(sections.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return sections[a].priority < sections[b].priority; });
+
+        for (size_t i : order) {
+            const PromptSection & s = sections[i];
+            if (s.required || s.text.empty()) {
+                continue;
+            }
+            const int remaining = budget_tokens - used;
+            if (tokens[i] <= remaining) {
+                chosen[i] = s.text;
+                used += tokens[i];
+                continue;
+            }
+            if (remaining < kMinTruncatedSectionTokens) {
+                continue;
+            }
+
+            // Cắt theo tỉ lệ token rồi lùi về ranh giới dòng gần nhất
+            const std::string marker = "[... truncated to fit prompt budget]\n";
+            const int         room   = std::max(0, remaining - countTokens(marker));
+            size_t            keep   = s.text.size() * static_cast<size_t>(room) / static_cast<size_t>(tokens[i]);
+            std::string       cut    = s.text.substr(0, keep);
+            size_t            nl     = cut.find_last_of('\n');
+            if (nl != std::string::npos && nl > 0) {
+                cut.resize(nl + 1);
+            }
+            cut += marker;
+            int cut_tokens = countTokens(cut);
+            while (cut_tokens > remaining && cut.size() > marker.size() + 1) {
+                size_t prev = cut.find_last_of('\n', cut.size() - marker.size() - 2);
+                if (prev == std::string::npos) {
+                    cut.clear();
+                    break;
+                }
+                cut.resize(prev + 1);
+                cut += marker;
+                cut_tokens = countTokens(cut);
+            }
+            if (!cut.empty() && cut_tokens <= remaining) {
+                chosen[i] = std::move(cut);
+                used += cut_tokens;
+            }
+        }
+    }
+
+    std::string out;
+    out.reserve(std::accumulate(chosen.begin(), chosen.end(), size_t(0),
+                                [](size_t n, const std::string & s) { return n + s.size(); }));
+    for (const auto & c : chosen) {
+        out += c;
+    }
+    if (used_tokens) {
+        *used_tokens = used;
+    }
+    return out;
+}
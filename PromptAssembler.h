@@ -0,0 +1,45 @@
+#pragma once
+#include "nlohmann/json.hpp"
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Một phần của user prompt. priority nhỏ = quan trọng hơn; required luôn được giữ nguyên.
+struct PromptSection {
+    int         priority = 0;
+    bool        required = false;
+    std::string text;
+};
+
+// Dựng prompt cho agent:
+//  - System block (định nghĩa action/stage/json keys...) được dump compact đúng một lần và cache theo
+//    bộ (historySetting, armySetting, roleSetting), nên các agent cùng setting dùng chung một prefix.
+//  - User block được lấp theo priority trong ngân sách token (battle_config.prompt_token_budget).
+class PromptAssembler {
+  public:
+    using TokenCounter = std::function<int(const std::string &)>;
+
+    explicit PromptAssembler(const nlohmann::json & config);
+
+    void setTokenCounter(TokenCounter counter);
+    int  countTokens(const std::string & text) const;
+
+    const std::string & systemBlock(const std::string & historySetting,
+                                    const std::string & armySetting,
+                                    const std::string & roleSetting);
+
+    // Ghép các section theo thứ tự ban đầu; section không vừa ngân sách bị cắt theo dòng hoặc bỏ.
+    // budget_tokens <= 0: không giới hạn. used_tokens (nếu có) nhận tổng token của user block.
+    std::string assemble(const std::vector<PromptSection> & sections, int budget_tokens,
+                         int * used_tokens = nullptr) const;
+
+  private:
+    std::string                        static_definitions;  // Phần không phụ thuộc agent, dump compact
+    std::string                        system_prompt;
+    std::map<std::string, std::string> system_blocks;
+    std::mutex                         system_mutex;
+    TokenCounter                       token_counter;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Bộ đệm vòng dung lượng cố định: push khi đầy sẽ ghi đè phần tử cũ nhất.
+// Bộ nhớ cấp phát một lần lúc khởi tạo; chỉ số 0 là phần tử cũ nhất.
+template <typename T> class RingBuffer {
+  public:
+    explicit RingBuffer(size_t capacity = 1) : storage(std::max<size_t>(1, capacity)) {}
+
+    void push(const T & value) {
+        storage[(head + count) % storage.size()] = value;
+        if (count < storage.size()) {
+            ++count;
+        } else {
+            head = (head + 1) % storage.size();
+        }
+    }
+
+    void push(T && value) {
+        storage[(head + count) % storage.size()] = std::move(value);
+        if (count < storage.size()) {
+            ++count;
+        } else {
+            head = (head + 1) % storage.size();
+        }
+    }
+
+    T &       operator[](size_t i) { return storage[(head + i) % storage.size()]; }
+    const T & operator[](size_t i) const { return storage[(head + i) % storage.size()]; }
+
+    T &       back() { return (*this)[count - 1]; }
+    const T & back() const { return (*this)[count - 1]; }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return storage.size(); }
+    bool   empty() const { return count == 0; }
+    bool   full() const { return count == storage.size(); }
+
+    void clear() {
+        head  = 0;
+        count = 0;
+    }
+
+  private:
+    std::vector<T> storage;
+    size_t         head  = 0;
+    size_t         count = 0;
+};
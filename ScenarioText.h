@@ -0,0 +1,81 @@
+#pragma once
+#include "nlohmann/json.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Kho chuỗi kịch bản bất biến dùng chung cho cả tiến trình (actionList, định nghĩa action/stage,
+// historySetting...): mỗi nội dung chỉ lưu một bản, Profile giữ SharedText trỏ vào đó.
+// Chuỗi không bao giờ bị xoá hay sửa nên đọc qua handle không cần khoá; chỉ intern() khoá mutex.
+class ScenarioTextStore {
+  public:
+    static ScenarioTextStore & instance() {
+        static ScenarioTextStore store;
+        return store;
+    }
+
+    // Chuỗi nằm trong unique_ptr nên con trỏ trả về ổn định suốt chương trình; tra theo string_view, không copy
+    const std::string * intern(std::string_view text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto                        it = texts.find(text);
+        if (it == texts.end()) {
+            auto owned = std::make_unique<const std::string>(text);
+            it         = texts.emplace(std::string_view(*owned), std::move(owned)).first;
+            total_bytes += text.size();
+        }
+        return it->second.get();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return texts.size();
+    }
+
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return total_bytes;
+    }
+
+  private:
+    ScenarioTextStore() = default;
+
+    mutable std::mutex                                                      mutex;
+    std::unordered_map<std::string_view, std::unique_ptr<const std::string>> texts;
+    size_t                                                                  total_bytes = 0;
+};
+
+// Handle tới một chuỗi trong ScenarioTextStore: copy chỉ copy con trỏ, đọc như const std::string &.
+class SharedText {
+  public:
+    SharedText() : text(emptyText()) {}
+
+    static SharedText intern(std::string_view value) { return SharedText(ScenarioTextStore::instance().intern(value)); }
+
+    const std::string & str() const { return *text; }
+    operator const std::string &() const { return *text; }
+
+    bool   empty() const { return text->empty(); }
+    size_t size() const { return text->size(); }
+
+    // Cùng nội dung thì cùng con trỏ (đã intern)
+    bool operator==(const SharedText & other) const { return text == other.text; }
+    bool operator!=(const SharedText & other) const { return text != other.text; }
+
+  private:
+    explicit SharedText(const std::string * interned) : text(interned) {}
+
+    static const std::string * emptyText() {
+        static const std::string * const empty = ScenarioTextStore::instance().intern("");
+        return empty;
+    }
+
+    const std::string * text;
+};
+
+inline void to_json(nlohmann::json & j, const SharedText & value) {
+    j = value.str();
+}
@@ -3,6 +3,8 @@
 #include "Agent.h"
 
 #include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <iomanip>
@@ -12,71 +14,202 @@
 #include <string>
 #include <vector>
 
-Logger::Logger(const std::string& filename, bool log_to_console, LogLevel min_level)
-    : log_to_console_(log_to_console), min_level_(min_level) {
+Logger::Logger(const std::string& filename, bool log_to_console, LogLevel min_level, const LoggerOptions& options)
+    : log_to_console_(log_to_console), min_level_(min_level), overflow_(options.overflow), queue_(options.queue_capacity) {
     file_.open(filename, std::ios::app);
     if (!file_.is_open()) {
         std::cerr << "❌ Cannot open log file: " << filename << std::endl;
     }
+    writer_ = std::thread(&Logger::writerLoop, this);
 }
 
 Logger::~Logger() {
+    stop_.store(true, std::memory_order_release);
+    wake_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
     if (file_.is_open()) {
         file_.close();
     }
 }
 
 Logger::LogStream::LogStream(Logger& logger, LogLevel level, int turn)
-    : logger_(logger), level_(level), turn_(turn) {}
+    : logger_(logger), level_(level), turn_(turn) {
+    if (logger.enabled(level)) {
+        stream_.emplace();
+    }
+}
 
 Logger::LogStream::~LogStream() {
-    logger_.log(level_, stream_.str(), turn_);
+    if (stream_) {
+        logger_.log(level_, stream_->str(), turn_);
+    }
+}
+
+// Luồng gọi: chỉ dựng bản ghi và đẩy vào hàng đợi, không định dạng thời gian, không I/O
+void Logger::log(LogLevel level, std::string&& message, int turn) {
+    if (!enabled(level)) return;
+
+    Record record;
+    record.level   = level;
+    record.turn    = turn;
+    record.time    = std::time(nullptr);
+    record.message = std::move(message);
+
+    const bool must_deliver = level == LogLevel::ERROR || overflow_ == LogOverflow::Block;
+    while (!queue_.tryPush(std::move(record))) {
+        if (!must_deliver || stop_.load(std::memory_order_acquire)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        wake_.notify_one();
+        std::this_thread::yield();
+    }
+    pushed_.fetch_add(1, std::memory_order_release);
+
+    if (level == LogLevel::ERROR || queue_.size() > queue_.capacity() / 2) {
+        wake_.notify_one();
+    }
+}
+
+void Logger::flush() {
+    const size_t                 target = pushed_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (flushed_.load(std::memory_order_acquire) < target && writer_.joinable()) {
+        flush_requested_.store(true, std::memory_order_release);
+        wake_.notify_one();
+        drained_.wait_for(lock, std::chrono::milliseconds(5));
+    }
 }
 
-void Logger::log(LogLevel level, const std::string& message, int turn) {
-    if (level < min_level_) return;
+void Logger::writerLoop() {
+    Record record;
+    size_t reported_drops = 0;
+    for (;;) {
+        // Lấy hết những gì đang có trong hàng đợi thành một lô
+        bool   saw_error = false;
+        size_t batch     = 0;
+        while (queue_.tryPop(record)) {
+            write(record);
+            saw_error = saw_error || record.level == LogLevel::ERROR;
+            written_.fetch_add(1, std::memory_order_release);
+            ++batch;
+        }
+
+        const size_t drops = dropped_.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            Record note;
+            note.level   = LogLevel::WARN;
+            note.time    = std::time(nullptr);
+            note.message = "Logger queue full: dropped " + std::to_string(drops - reported_drops) + " messages";
+            write(note);
+            reported_drops = drops;
+        }
+
+        const bool stopping  = stop_.load(std::memory_order_acquire) && queue_.size() == 0;
+        const bool requested = flush_requested_.exchange(false, std::memory_order_acq_rel);
+        if (saw_error || requested || stopping) {
+            if (file_.is_open()) {
+                file_.flush();
+            }
+            std::cout.flush();
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex_);
+                flushed_.store(written_.load(std::memory_order_acquire), std::memory_order_release);
+            }
+            drained_.notify_all();
+        }
+        if (stopping) {
+            return;
+        }
+
+        if (batch == 0) {
+            // Ngủ ngắn để gom lô; producer đánh thức sớm khi có ERROR hoặc hàng đợi quá nửa
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(5), [this] {
+                return stop_.load(std::memory_order_acquire) || flush_requested_.load(std::memory_order_acquire) ||
+                       queue_.size() > 0;
+            });
+        }
+    }
+}
 
+void Logger::write(const Record& record) {
     // Tạo timestamp
-    std::time_t now = std::time(nullptr);
+    std::tm local {};
+#ifdef _WIN32
+    localtime_s(&local, &record.time);
+#else
+    localtime_r(&record.time, &local);
+#endif
     char time_str[20];
-    std::strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    std::strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &local);
 
     // Tạo chuỗi log
     std::ostringstream log_line;
     log_line << "[" << time_str << "][";
-    switch (level) {
+    switch (record.level) {
     case LogLevel::INFO:  log_line << "INFO"; break;
     case LogLevel::DEBUG: log_line << "DEBUG"; break;
     case LogLevel::WARN:  log_line << "WARN"; break;
     case LogLevel::ERROR: log_line << "ERROR"; break;
     }
     log_line << "]";
-    if (turn >= 0) {
-        log_line << "[Turn " << turn << "]";
+    if (record.turn >= 0) {
+        log_line << "[Turn " << record.turn << "]";
     }
-    log_line << " " << message;
+    log_line << " " << record.message << '\n';
 
-    // Ghi vào file
+    // Ghi vào file (flush theo lô ở writerLoop)
     if (file_.is_open()) {
-        file_ << log_line.str() << std::endl;
+        file_ << log_line.str();
     }
 
     // Ghi ra console nếu bật
-    if (log_to_console_) {
-        if (level == LogLevel::ERROR) {
-            std::cerr << log_line.str() << std::endl;
+    if (log_to_console_.load(std::memory_order_relaxed)) {
+        if (record.level == LogLevel::ERROR) {
+            std::cerr << log_line.str();
         }
         else {
-            std::cout << log_line.str() << std::endl;
+            std::cout << log_line.str();
         }
     }
 }
+
+namespace {
+// battle_config.log_queue_capacity / log_overflow ("block" mặc định | "drop")
+LoggerOptions loggerOptions(const nlohmann::json & config) {
+    LoggerOptions options;
+    if (config.contains("battle_config")) {
+        const auto & bc        = config["battle_config"];
+        options.queue_capacity = bc.value("log_queue_capacity", options.queue_capacity);
+        options.overflow       = bc.value("log_overflow", "block") == "drop" ? LogOverflow::Drop : LogOverflow::Block;
+    }
+    return options;
+}
+
+// battle_config.log_level: "debug" | "info" | "warn" | "error" (DEBUG bị loại khi build NDEBUG)
+LogLevel loggerLevel(const nlohmann::json & config) {
+    const std::string level =
+        config.contains("battle_config") ? config["battle_config"].value("log_level", "info") : std::string("info");
+    return level == "debug" ? LogLevel::DEBUG
+         : level == "warn"  ? LogLevel::WARN
+         : level == "error" ? LogLevel::ERROR
+                            : LogLevel::INFO;
+}
+}  // namespace
+
 Simulation::Simulation(const nlohmann::json & config) :
     field(2000, 2000),
+    soldierCollectorA(nullptr),
+    soldierCollectorB(nullptr),
     config(config),
     unique_id_counter(0),
     llm(NULL),
-    logger("simulation_log.txt", true, LogLevel::INFO) {
+    logger("simulation_log.txt", true, loggerLevel(config), loggerOptions(config)),
+    prompts(config),
+    scheduler(config) {
 
     model_path = config["lla_modle_path"].get<std::string>();
     // Khởi tạo địa hình
@@ -161,17 +294,60 @@ Simulation::Simulation(const nlohmann::json & config) :
         }
     }
 
+    modifiers.load(config);
+
+    if (config.contains("soldier_summary_config")) {
+        soldierSummaries.configure(config["soldier_summary_config"]);
+    }
+
+    // Giới hạn báo cáo tình hình (k đơn vị gần nhất / tầm phát hiện)
+    if (config.contains("battle_config")) {
+        const auto & bc                        = config["battle_config"];
+        field.situationConfig.max_allies      = bc.value("situation_max_allies", field.situationConfig.max_allies);
+        field.situationConfig.max_enemies     = bc.value("situation_max_enemies", field.situationConfig.max_enemies);
+        field.situationConfig.detection_range = bc.value("detection_range", field.situationConfig.detection_range);
+        field.configureTacticalRaster(bc.value("tactical_raster_cell", 10.0), bc.value("tactical_raster_validate", false),
+                                      bc.value("tactical_raster_tolerance", 0.1));
+        field.movement.configure(bc);
+
+        const std::string resolver = bc.value("combat_resolver", "ratio");
+        if (resolver != "ratio" && resolver != "lanchester") {
+            logger.warn() << "Unknown combat_resolver '" << resolver << "' → ratio";
+        }
+        combat.configure(resolver == "lanchester" ? CombatBatch::Resolver::Lanchester : CombatBatch::Resolver::Ratio,
+                         bc.value("lanchester_steps", 8));
+
+        const std::string trace_path = bc.value("event_trace", "");
+        if (!trace_path.empty()) {
+            if (trace.open(trace_path, static_cast<size_t>(bc.value("event_trace_buffer_kb", 64)) * 1024)) {
+                logger.info() << "Event trace: " << trace_path;
+            } else {
+                logger.warn() << "Cannot open event trace " << trace_path;
+            }
+        }
+
+        const std::string chrome_trace = bc.value("profile_chrome_trace", "");
+        Profiler::instance().configure(bc.value("profile", false) || !chrome_trace.empty(), chrome_trace,
+                                       bc.value("profile_max_events", static_cast<size_t>(1000000)));
+    }
+    field.ensureTacticalRaster();
+
+    // Văn bản kịch bản dump một lần; Profile intern vào ScenarioTextStore nên mọi agent dùng chung một bản
+    const nlohmann::json scenario_text = {
+        { "actionList",               config["actionList"].dump()               },
+        { "actionPropertyDefinition", config["actionPropertyDefinition"].dump() },
+        { "stagePropertyDefinition",  config["stagePropertyDefinition"].dump()  },
+        { "actionInstructionBlock",   config["actionInstructionBlock"]          },
+        { "jsonConstraintVariable",   config["jsonConstraintVariable"].dump()   }
+    };
+
     // Khởi tạo countryA (Vietnamese)
-    nlohmann::json viet_config              = config["red_configs"];   
-    viet_config["actionList"]               = config["actionList"].dump();
-    viet_config["actionPropertyDefinition"] = config["actionPropertyDefinition"].dump();
-    viet_config["stagePropertyDefinition"]  = config["stagePropertyDefinition"].dump();
-    viet_config["actionInstructionBlock"]   = config["actionInstructionBlock"];
-    viet_config["jsonConstraintVariable"]   = config["jsonConstraintVariable"].dump();
+    nlohmann::json viet_config = config["red_configs"];
+    viet_config.update(scenario_text);
 
     Profile viet(viet_config);
     viet.updateTroopInformation();
-    countryA = new Agent(viet, this);
+    countryA = createAgent(viet);
     agents.push_back(countryA);
 
     if (config["red_configs"].contains("individual_profiles")) {
@@ -196,15 +372,11 @@ Simulation::Simulation(const nlohmann::json & config) :
         }
     }
     // Khởi tạo countryB (French)
-    nlohmann::json french_config              = config["green_configs"];   
-    french_config["actionList"]               = config["actionList"].dump();
-    french_config["actionPropertyDefinition"] = config["actionPropertyDefinition"].dump();
-    french_config["stagePropertyDefinition"]  = config["stagePropertyDefinition"].dump();
-    french_config["actionInstructionBlock"]   = config["actionInstructionBlock"];
-    french_config["jsonConstraintVariable"] = config["jsonConstraintVariable"].dump();  
+    nlohmann::json french_config = config["green_configs"];
+    french_config.update(scenario_text);
     Profile french(french_config);
     french.updateTroopInformation();
-    countryB = new Agent(french, this);
+    countryB = createAgent(french);
     agents.push_back(countryB);   
 
     // Khởi tạo SoldierCollector cho Phe B (French)
@@ -243,12 +415,8 @@ Simulation::Simulation(const nlohmann::json & config) :
                 sub_config["AmySetting"]                  = config[side].value("AmySetting", "");
                 sub_config["roleSetting"]                 = config[side].value("roleSetting", "");
                 sub_config["troopInformation"]            = config[side].value("troopInformation", "");
-                sub_config["actionList"]                  = config["actionList"].dump();
-                sub_config["actionPropertyDefinition"]    = config["actionPropertyDefinition"].dump();
-                sub_config["stagePropertyDefinition"]     = config["stagePropertyDefinition"].dump();
-                sub_config["actionInstructionBlock"]      = config["actionInstructionBlock"];
-                sub_config["jsonConstraintVariable"]      = config["jsonConstraintVariable"].dump();
-                Agent * sub                               = new Agent(Profile(sub_config), this);
+                sub_config.update(scenario_text);
+                Agent * sub                               = createAgent(Profile(sub_config));
                 sub->setParent(side == "red_configs" ? countryA : countryB);
                 sub->setTarget(side == "red_configs" ? countryB : countryA);
                 sub->profile.updateTroopInformation();
@@ -258,6 +426,10 @@ Simulation::Simulation(const nlohmann::json & config) :
         }
     }
 
+    field.agentIndex.rebuild(agents);
+    logger.info() << "Scenario text store: " << ScenarioTextStore::instance().size() << " strings, "
+                  << ScenarioTextStore::instance().bytes() << " bytes shared by " << agents.size() << " agents";
+
     countryA->setTarget(countryB);
     for (auto agent : countryA->getChildren()) {
         agent->setTarget(countryA->getTarget());
@@ -282,6 +454,13 @@ Simulation::Simulation(const nlohmann::json & config) :
     if (!llm) {
         llm = std::make_shared<LLMInference>(model_path, 99, 8192);
     }
+    prompts.setTokenCounter([this](const std::string & text) { return llm->countTokens(text); });
+    if (config.contains("battle_config")) {
+        const nlohmann::json & bc = config["battle_config"];
+        llm->setCircuitBreaker(bc.value("llm_breaker_failures", 3), bc.value("llm_slow_call_ms", 120000),
+                               bc.value("llm_breaker_cooldown_ms", 60000));
+        llm->enableMetrics(!bc.value("llm_metrics", "").empty());
+    }
     
     std::time_t now = std::time(nullptr);
     char time_str[20];
@@ -292,11 +471,16 @@ Simulation::Simulation(const nlohmann::json & config) :
 }
 
 Simulation::~Simulation() {
-   
-    delete countryA;
+    agentPool.clear();  // countryA/countryB và mọi sub-agent
+    delete soldierCollectorA;
+    delete soldierCollectorB;
+}
 
-    delete countryB;
-  
+Agent * Simulation::createAgent(const Profile & profile) {
+    PoolHandle handle = agentPool.create(profile, this);
+    Agent *    agent  = agentPool.get(handle);
+    agent->self       = handle;
+    return agent;
 }
 
 bool Simulation::addAgent(Agent * child) {
@@ -313,6 +497,7 @@ bool Simulation::insertAgent(unsigned int index, Agent * child) {
     } else {
         agents.insert(agents.begin() + index, child);
     }
+    field.onAgentAdded(child);
     return true;
 }
 
@@ -340,7 +525,23 @@ bool Simulation::removeAgents(unsigned int pos, unsigned int numChildrenToRemove
             logger.info() << "[Simulation] Removing agent: " << agent->profile.name
                 << " (faction=" << agent->getFaction()
                 << ", troops=" << agent->profile.initialNumOfTroops << ")\n";
-            delete agent;  // ✅ Giải phóng bộ nhớ thật
+            field.onAgentRemoved(agent);
+            settleCombat(agent);  // Không bỏ thương vong đang chờ của cả hai phía
+            engagements.remove(agent);
+            // Lính và báo cáo binh sĩ của agent không được để lại cho agent mới nhận cùng ô trong agentPool
+            if (soldierCollectorA) {
+                soldierCollectorA->recallSoldiers(agent);
+            }
+            if (soldierCollectorB) {
+                soldierCollectorB->recallSoldiers(agent);
+            }
+            soldierSummaries.forget(agent->profile.name);
+            // Mọi agent đều tạo qua createAgent: destroy thất bại nghĩa là handle cũ / xoá hai lần, không được delete
+            if (!agentPool.destroy(agent->self)) {
+                logger.error() << "[Simulation] Agent " << agent->profile.name
+                               << " is not a live agentPool entry (stale handle or double removal)\n";
+                assert(false && "removeAgents: agent not owned by agentPool");
+            }
             agents[i] = nullptr; // tránh dùng nhầm
         }
     }
@@ -363,7 +564,10 @@ bool Simulation::replaceAgent(Agent * origAgent, Agent * newAgent) {
 
 bool Simulation::setAgent(unsigned int i, Agent * newAgent) {
     if (i < agents.size() && newAgent) {
+        field.onAgentRemoved(agents[i]);
+        engagements.remove(agents[i]);
         agents[i]     = newAgent;
+        field.onAgentAdded(newAgent);
         return true;
     }
     return false;
@@ -384,7 +588,9 @@ int Simulation::generateUniqueId() {
 }
 
 bool Simulation::isTerrainObjectCaptured(const TerrainObject & obj) {
-    for (auto * agent : agents) {
+    std::vector<Agent *> nearby;
+    field.agentIndex.within(obj.position, 50.0 * std::sqrt(2.0), nearby);
+    for (auto * agent : nearby) {
         if (!agent->mergedOrPruned && agent->profile.currentStage != "Crushing Defeat") {
             if (std::abs(agent->profile.position.x - obj.position.x) < 50 &&
                 std::abs(agent->profile.position.y - obj.position.y) < 50) {
@@ -399,55 +605,29 @@ bool Simulation::isTerrainObjectCaptured(const TerrainObject & obj) {
 bool Simulation::isTerrainObjectEncircled(const TerrainObject& obj) {
     int encircling_units = 0;
 
-    // Giả định đối tượng địa hình thuộc countryB (French) để kiểm tra bao vây bởi countryA (Vietnamese)
-    for (auto* agent : agents) {
-        // Chỉ xem xét agent bộ binh, không bị hợp nhất, và không ở trạng thái thất bại
-        if (agent->profile.troopType == "infantry" && !agent->mergedOrPruned &&
-            agent->profile.currentStage != "Crushing Defeat" &&
-            agent->profile.currentStage != "fleeing Off the Map") {
-            
-            // Xác định phe của agent
-            bool is_country_a = (countryA && (agent == countryA || agent->getParent() == countryA || 
-                               agent->profile.name.find("Vietnamese") != std::string::npos));
-            
-            // Chỉ tính agent từ countryA (phe đối lập với countryB)
-            if (is_country_a) {
-                // Tính khoảng cách đến đối tượng địa hình
-                double dist = std::sqrt(std::pow(agent->profile.position.x - obj.position.x, 2) +
-                                        std::pow(agent->profile.position.y - obj.position.y, 2));
-                
-                // Kiểm tra xem agent có nhắm vào một agent của countryB gần đối tượng địa hình
-                if (dist < 150 && !agent->profile.targetedAgentName.empty()) {
-                    Agent* target_agent = nullptr;
-                    for (auto* other : agents) {
-                        if (other->profile.name == agent->profile.targetedAgentName &&
-                            !other->mergedOrPruned &&
-                            other->profile.currentStage != "Crushing Defeat" &&
-                            other->profile.currentStage != "fleeing Off the Map") {
-                            target_agent = other;
-                            break;
-                        }
-                    }
-                    
-                    // Kiểm tra xem target_agent thuộc countryB và gần đối tượng địa hình
-                    if (target_agent) {
-                        bool target_is_country_b =
-                            (countryB && (target_agent == countryB || target_agent->getParent() == countryB || 
-                                                  target_agent->profile.name.find("French") != std::string::npos));
-                        if (target_is_country_b) {
-                            double target_dist = std::sqrt(std::pow(target_agent->profile.position.x - obj.position.x, 2) +
-                                                           std::pow(target_agent->profile.position.y - obj.position.y, 2));
-                            if (target_dist < 50) {
-                                encircling_units++;
-                            }
-                        }
-                    }
-                }
+    // Giả định đối tượng địa hình thuộc countryB (French): đếm agent countryA đang nhắm vào
+    // một agent countryB đứng gần đối tượng, duyệt cạnh vào của engagements thay vì quét mọi agent
+    auto active = [](const Agent* a) {
+        return !a->mergedOrPruned && a->profile.currentStage != "Crushing Defeat" &&
+               a->profile.currentStage != "fleeing Off the Map";
+    };
+    std::vector<Agent*> defenders;
+    field.agentIndex.within(obj.position, 50.0, defenders);
+    for (auto* defender : defenders) {
+        if (!active(defender) || defender->isCountryA() ||
+            std::hypot(defender->profile.position.x - obj.position.x, defender->profile.position.y - obj.position.y) >= 50) {
+            continue;
+        }
+        for (auto* agent : engagements.attackersOf(defender)) {
+            // Chỉ xem xét agent bộ binh countryA, không bị hợp nhất, và không ở trạng thái thất bại
+            if (agent->profile.troopType == "infantry" && active(agent) && agent->isCountryA() &&
+                std::hypot(agent->profile.position.x - obj.position.x, agent->profile.position.y - obj.position.y) < 150) {
+                encircling_units++;
             }
         }
     }
 
-    logger.debug() << "Terrain object " << obj.name << " has " << encircling_units << " encircling units\n";
+    LOG_DEBUG(logger) << "Terrain object " << obj.name << " has " << encircling_units << " encircling units\n";
     return encircling_units >= 2;
 }
 
@@ -467,35 +647,27 @@ std::string Simulation::checkSupplyLine(Agent * agent) {
     double dist = std::sqrt(std::pow(agent->profile.position.x - supply_point.x, 2) +
                             std::pow(agent->profile.position.y - supply_point.y, 2));
 
-    // Kiểm tra xem agent mục tiêu có cắt tuyến tiếp tế không
-    if (!agent->profile.targetedAgentName.empty()) {
-        Agent * target_agent = nullptr;
-        for (auto * other : agents) {
-            if (other->profile.name == agent->profile.targetedAgentName && !other->mergedOrPruned &&
-                other->profile.currentStage != "Crushing Defeat" &&
-                other->profile.currentStage != "fleeing Off the Map") {
-                target_agent = other;
-                break;
-            }
-        }
-
-        if (target_agent) {
-            // Xác định phe của target_agent
-            bool target_is_country_a = target_agent->isCountryA();                
-
-            // Đảm bảo target_agent thuộc phe đối phương
-            if (is_country_a != target_is_country_a) {
-                // Tính khoảng cách từ target_agent đến điểm tiếp tế
-                double enemy_dist = std::sqrt(std::pow(target_agent->profile.position.x - supply_point.x, 2) +
-                                              std::pow(target_agent->profile.position.y - supply_point.y, 2));
-
-                // Kiểm tra xem target_agent có ở gần tuyến tiếp tế không
-                if (enemy_dist < 200) {
-                    logger.warn() << "Agent " << agent->profile.name << " supply line severed by "
-                           << target_agent->profile.name << " at distance " << static_cast<int>(enemy_dist) << "\n";
-                    return "Severed";
-                }
-            }
+    // Kẻ thù đang giao chiến với agent (mục tiêu của nó và các agent đang nhắm vào nó) có cắt tuyến tiếp tế không
+    auto threatens = [&](Agent * enemy) {
+        if (!enemy || enemy->mergedOrPruned || enemy->profile.currentStage == "Crushing Defeat" ||
+            enemy->profile.currentStage == "fleeing Off the Map") {
+            return false;
+        }
+        // Đảm bảo enemy thuộc phe đối phương và ở gần tuyến tiếp tế
+        double enemy_dist = std::hypot(enemy->profile.position.x - supply_point.x, enemy->profile.position.y - supply_point.y);
+        if (enemy->isCountryA() == is_country_a || enemy_dist >= 200) {
+            return false;
+        }
+        logger.warn() << "Agent " << agent->profile.name << " supply line severed by " << enemy->profile.name
+                      << " at distance " << static_cast<int>(enemy_dist) << "\n";
+        return true;
+    };
+    if (threatens(engagements.targetOf(agent))) {
+        return "Severed";
+    }
+    for (Agent * attacker : engagements.attackersOf(agent)) {
+        if (threatens(attacker)) {
+            return "Severed";
         }
     }
 
@@ -515,8 +687,11 @@ void Simulation::applyMoraleEffect(Agent * agent) {
         agent->profile.takeDamage(50);
         logger.warn() << "Agent " << agent->profile.name << " morale Low, lost 50 troops\n";
         if (!agent->profile.targetedAgentName.empty()) {
-            bool near_terrain = false;
-            for (const auto & obj : field.getTerrainObjects()) {
+            bool                near_terrain = false;
+            std::vector<size_t> nearby;
+            field.queryTerrain(agent->profile.position.x, agent->profile.position.y, 100.0, nearby);
+            for (size_t i : nearby) {
+                const TerrainObject & obj = field.getTerrainObjects()[i];
                 double dist = std::sqrt(std::pow(agent->profile.position.x - obj.position.x, 2) +
                                         std::pow(agent->profile.position.y - obj.position.y, 2));
                 if (dist < 100) {
@@ -537,13 +712,13 @@ void Simulation::applyMoraleEffect(Agent * agent) {
 }
 
 
-void Simulation::applyActionEffects(Agent* agent, double& anti_aircraft_modifier) {
+// sync_results: kết quả execute()/carryForward() của lượt này (không gọi execute() lần nữa)
+void Simulation::applyActionEffects(Agent* agent, const nlohmann::json& sync_results, double& anti_aircraft_modifier) {
     nlohmann::json last_action;
     last_action["targetedAgentName"] = agent->profile.targetedAgentName;
     last_action["ownPotentialLostNum"] = 0;
     last_action["enemyPotentialLostNum"] = 0;
 
-    auto sync_results = agent->execute();
     for (const auto& result : sync_results) {
         if (result.contains("error")) {
             logger.error() << "Error for Agent " << agent->profile.name << ": " << result["error"].get<std::string>();
@@ -560,8 +735,12 @@ void Simulation::applyActionEffects(Agent* agent, double& anti_aircraft_modifier
             continue;
         }
         if (action.contains("ownPotentialLostNum") && action["ownPotentialLostNum"].is_number_integer()) {
-            int own_loss = action["ownPotentialLostNum"].get<int>();
-            agent->profile.takeDamage(own_loss);
+            int                     own_loss = action["ownPotentialLostNum"].get<int>();
+            CombatBatch::Engagement e;
+            e.owner     = agent;
+            e.attacker  = agent;
+            e.fixed_own = own_loss;
+            combat.add(e);
             logger.warn() << "Agent " << agent->profile.name << " took " << own_loss << " damage from action.";
         }
         if (action.contains("enemyPotentialLostNum") && action["enemyPotentialLostNum"].is_number_integer() &&
@@ -577,8 +756,12 @@ void Simulation::applyActionEffects(Agent* agent, double& anti_aircraft_modifier
                 }
             }
             if (target_agent) {
-                int enemy_loss = action["enemyPotentialLostNum"].get<int>();
-                target_agent->profile.takeDamage(enemy_loss);
+                int                     enemy_loss = action["enemyPotentialLostNum"].get<int>();
+                CombatBatch::Engagement e;
+                e.owner       = agent;
+                e.victim      = target_agent;
+                e.fixed_enemy = enemy_loss;
+                combat.add(e);
                 logger.info() << "Agent " << agent->profile.name << " dealt " << enemy_loss << " damage to target "
                     << target_agent->profile.name << ".";
             }
@@ -586,6 +769,77 @@ void Simulation::applyActionEffects(Agent* agent, double& anti_aircraft_modifier
     }
 }
 
+// Giải toàn bộ giao chiến của lượt một lần: thương vong tính trên trạng thái đã gom, không phụ thuộc thứ tự
+// agent hành động; lịch sử quyết định của owner được cộng thương vong đã chốt.
+void Simulation::resolveCombat(int turn) {
+    if (combat.empty()) {
+        return;
+    }
+    applyCombat(combat, turn);
+    logger.info(turn) << "Combat resolved: " << combat.size() << " engagements";
+    combat.clear();
+}
+
+void Simulation::settleCombat(Agent * agent) {
+    CombatBatch part = combat.extract(agent);
+    if (part.empty()) {
+        return;
+    }
+    applyCombat(part, agent->profile.roundNb);
+    logger.info(agent->profile.roundNb) << "Combat settled early for " << agent->profile.name << ": " << part.size()
+                                        << " engagements";
+}
+
+void Simulation::applyCombat(CombatBatch & batch, int turn) {
+    batch.resolve();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        Agent* owner = batch.ownerOf(i);
+        Agent* attacker = batch.attackerOf(i);
+        Agent* victim = batch.victimOf(i);
+        if (batch.estimated(i)) {
+            logCombatRow(batch, i);
+        }
+        if (attacker && batch.ownLoss(i) > 0) {
+            logger.info(turn) << "Agent " << attacker->profile.name << ": lost " << batch.ownLoss(i);
+        }
+        if (victim && batch.enemyLoss(i) > 0) {
+            logger.info(turn) << "Target " << victim->profile.name << ": Lost " << batch.enemyLoss(i) << " by "
+                << (attacker ? attacker->profile.name : owner ? owner->profile.name : "action");
+        }
+        if (owner) {
+            owner->history.addLosses(turn, batch.ownLoss(i), batch.enemyLoss(i));
+        }
+        trace.casualty(turn, attacker ? attacker->profile.name : owner ? owner->profile.name : "",
+                       victim ? victim->profile.name : "", batch.deployedOf(i), batch.ownLoss(i),
+                       batch.enemyLoss(i), batch.ratioOf(i));
+    }
+    batch.commit();
+}
+
+void Simulation::logCombatRow(const CombatBatch& batch, size_t i) {
+    Agent* attacker = batch.attackerOf(i);
+    Agent* victim = batch.victimOf(i);
+    if (!attacker) {
+        return;
+    }
+    const int round = attacker->profile.roundNb;
+    const int deployed = batch.deployedOf(i);
+    const int defender_avail = batch.defenderAvailOf(i);
+    // VN average ~410/round, French ~41/round; major battles: 5-10× higher
+    if (deployed > 0 && batch.ownLoss(i) > deployed * 0.5) {
+        logger.warn(round) << "WARNING: " << attacker->profile.name << " casualties very high: " << batch.ownLoss(i)
+            << " (" << (batch.ownLoss(i) * 100 / deployed) << "%)";
+    }
+    if (victim && defender_avail > 0 && batch.enemyLoss(i) > defender_avail * 0.5) {
+        logger.warn(round) << "WARNING: " << victim->profile.name << " casualties very high: " << batch.enemyLoss(i)
+            << " (" << (batch.enemyLoss(i) * 100 / defender_avail) << "%)";
+    }
+    LOG_DEBUG(logger, round) << "CASUALTY CALCULATION: " << attacker->profile.name << " vs "
+        << (victim ? victim->profile.name : "None") << " | Deployed: " << deployed << " vs " << defender_avail
+        << " | Ratio: " << batch.ratioOf(i) << " | Own Loss = " << batch.ownLoss(i)
+        << " | Enemy Loss = " << batch.enemyLoss(i);
+}
+
 void Simulation::logState(int turn, const std::string& /*agent_name*/, Agent* agent) {
     logger.info(turn) << "Agent " << agent->profile.name << " (" << agent->profile.troopType
         << ") state: " << agent->profile.currentStage << ", Troops: " << agent->profile.remainingNumOfTroops()
@@ -597,11 +851,14 @@ void Simulation::visualizeDeployment(int turn, bool output_to_console) {
     int grid_width = static_cast<int>(std::ceil(field.width / grid_size));
     int grid_height = static_cast<int>(std::ceil(field.height / grid_size));
     std::vector<std::vector<std::string>> map(grid_height, std::vector<std::string>(grid_width, "."));
+    std::vector<size_t> nearby;
     for (int i = 0; i < grid_height; ++i) {
         for (int j = 0; j < grid_width; ++j) {
             double x = j * grid_size - field.width / 2.0;
             double y = i * grid_size - field.height / 2.0;
-            for (const auto& obj : field.getTerrainObjects()) {
+            field.queryTerrain(x, y, grid_size / 2.0, nearby);
+            for (size_t k : nearby) {
+                const TerrainObject& obj = field.getTerrainObjects()[k];
                 if (std::abs(x - obj.position.x) < grid_size / 2.0 && std::abs(y - obj.position.y) < grid_size / 2.0) {
                     map[i][j] = obj.name.substr(0, 1) + (isTerrainObjectEncircled(obj) ? "*" : "");
                     continue;
@@ -626,7 +883,7 @@ void Simulation::visualizeDeployment(int turn, bool output_to_console) {
             agent->profile.currentStage == "fleeing Off the Map") {
             continue;
         }
-        logger.debug(turn) << "Agent " << agent->profile.name << ": stage=" << agent->profile.currentStage
+        LOG_DEBUG(logger, turn) << "Agent " << agent->profile.name << ": stage=" << agent->profile.currentStage
             << ", mergedOrPruned=" << agent->mergedOrPruned
             << ", inTunnel=" << field.isInTunnel(agent) << ", position=["
             << agent->profile.position.x << "," << agent->profile.position.y << "]";
@@ -665,7 +922,7 @@ void Simulation::visualizeDeployment(int turn, bool output_to_console) {
         }
         std::string troops_str = std::to_string(std::min(max_troops, 999));
         map[y][x] = sym + troops_str;
-        logger.debug(turn) << "Mapped agent " << selected_agent->profile.name << " to grid [" << x << "," << y
+        LOG_DEBUG(logger, turn) << "Mapped agent " << selected_agent->profile.name << " to grid [" << x << "," << y
             << "] with symbol " << map[y][x] << (agent_list.size() > 1 ? " (multiple agents)" : "");
     }
     logger.info(turn) << "Battlefield Deployment:";
@@ -696,46 +953,40 @@ void Simulation::updateTargetList() {
                 logger.info() << "Agent " << agent->profile.name << " retains target: " << current_target->profile.name;
                 continue;
             }
-            agent->profile.targetedAgentName = "";
+            agent->clearTarget();
             Agent* selected_target = nullptr;
             double  min_distance = std::numeric_limits<double>::max();
             bool    is_country_a = agent->isCountryA();
+            // Ứng viên lấy từ field.agentIndex thay vì quét mọi agent cho từng terrain
+            auto alive_of = [&](bool want_country_a) {
+                return [=](Agent* other, double) {
+                    return other != agent && !other->mergedOrPruned &&
+                        other->profile.currentStage != "Crushing Defeat" &&
+                        other->profile.currentStage != "fleeing Off the Map" &&
+                        other->isCountryA() == want_country_a;
+                };
+            };
+            auto consider = [&](const Position& from, double max_range, bool want_country_a) {
+                for (auto* other_agent : field.agentIndex.nearest(from, 1, max_range, alive_of(want_country_a))) {
+                    double distance = std::hypot(other_agent->profile.position.x - from.x,
+                        other_agent->profile.position.y - from.y);
+                    if (distance < max_range && distance < min_distance) {
+                        min_distance = distance;
+                        selected_target = other_agent;
+                    }
+                }
+            };
+            const double unbounded = std::numeric_limits<double>::max();
             if (is_country_a) {
                 for (const auto& terrain : field.getTerrainObjects()) {
                     if (terrain.type == TerrainType::Stronghold) {
-                        for (auto* other_agent : agents) {
-                            if (other_agent != agent && !other_agent->mergedOrPruned &&
-                                other_agent->profile.currentStage != "Crushing Defeat" &&
-                                other_agent->profile.currentStage != "fleeing Off the Map" &&
-                                !other_agent->isCountryA()) {
-                                double distance =
-                                    std::sqrt(std::pow(other_agent->profile.position.x - terrain.position.x, 2) +
-                                        std::pow(other_agent->profile.position.y - terrain.position.y, 2));
-                                if (distance < 100 && distance < min_distance) {
-                                    min_distance = distance;
-                                    selected_target = other_agent;
-                                }
-                            }
-                        }
+                        consider(terrain.position, 100.0, false);
                     }
                 }
                 if (field.isInTunnel(agent) && !selected_target) {
                     for (const auto& terrain : field.getTerrainObjects()) {
                         if (terrain.type == TerrainType::Tunnel) {
-                            for (auto* other_agent : agents) {
-                                if (other_agent != agent && !other_agent->mergedOrPruned &&
-                                    other_agent->profile.currentStage != "Crushing Defeat" &&
-                                    other_agent->profile.currentStage != "fleeing Off the Map" &&
-                                    !other_agent->isCountryA()) {
-                                    double distance = std::sqrt(
-                                        std::pow(other_agent->profile.position.x - terrain.end_position.x, 2) +
-                                        std::pow(other_agent->profile.position.y - terrain.end_position.y, 2));
-                                    if (distance < min_distance) {
-                                        min_distance = distance;
-                                        selected_target = other_agent;
-                                    }
-                                }
-                            }
+                            consider(terrain.end_position, unbounded, false);
                         }
                     }
                 }
@@ -744,38 +995,12 @@ void Simulation::updateTargetList() {
                 for (const auto& terrain : field.getTerrainObjects()) {
                     if (terrain.type == TerrainType::Stronghold && std::abs(terrain.position.x - 0) < 1e-6 &&
                         std::abs(terrain.position.y + 200) < 1e-6) {
-                        for (auto* other_agent : agents) {
-                            if (other_agent != agent && !other_agent->mergedOrPruned &&
-                                other_agent->profile.currentStage != "Crushing Defeat" &&
-                                other_agent->profile.currentStage != "fleeing Off the Map" &&
-                                other_agent->isCountryA()) {
-                                double distance =
-                                    std::sqrt(std::pow(other_agent->profile.position.x - terrain.position.x, 2) +
-                                        std::pow(other_agent->profile.position.y - terrain.position.y, 2));
-                                if (distance < min_distance) {
-                                    min_distance = distance;
-                                    selected_target = other_agent;
-                                }
-                            }
-                        }
+                        consider(terrain.position, unbounded, true);
                     }
                 }
             }
             if (!selected_target) {
-                for (auto* other_agent : agents) {
-                    if (other_agent != agent && !other_agent->mergedOrPruned &&
-                        other_agent->profile.currentStage != "Crushing Defeat" &&
-                        other_agent->profile.currentStage != "fleeing Off the Map" &&
-                        is_country_a != other_agent->isCountryA()) {
-                        double distance =
-                            std::sqrt(std::pow(agent->profile.position.x - other_agent->profile.position.x, 2) +
-                                std::pow(agent->profile.position.y - other_agent->profile.position.y, 2));
-                        if (distance < min_distance) {
-                            min_distance = distance;
-                            selected_target = other_agent;
-                        }
-                    }
-                }
+                consider(agent->profile.position, unbounded, !is_country_a);
             }
             if (selected_target) {
                 agent->profile.targetedAgentName = selected_target->profile.name;
@@ -790,6 +1015,112 @@ void Simulation::updateTargetList() {
     }
 }
 
+// Làm mới báo cáo tình báo binh sĩ: chỉ agent có trạng thái binh sĩ thay đổi vượt ngưỡng,
+// gộp tất cả vào một request LLM duy nhất cho cả lượt.
+void Simulation::refreshSoldierSummaries(const std::vector<Agent *> & roster, int turn) {
+    if (!config.contains("soldier_summary_config")) {
+        return;
+    }
+    const nlohmann::json & ssc = config["soldier_summary_config"];
+    if (!ssc.value("enabled", true)) {
+        return;
+    }
+
+    std::vector<std::pair<Agent *, SoldierFingerprint>> misses;
+    nlohmann::json                                      units      = nlohmann::json::object();
+    nlohmann::json                                      properties = nlohmann::json::object();
+    nlohmann::json                                      unit_schema = {
+        {"type",        "object"                                                   },
+        { "properties", ssc.value("soldier_summary_schema", nlohmann::json::object())}
+    };
+
+    for (Agent * agent : roster) {
+        if (!agent || agent->mergedOrPruned || agent->profile.currentStage == "Crushing Defeat" ||
+            agent->profile.currentStage == "Fleeing Off the Map") {
+            continue;
+        }
+        std::vector<SoldierAgent *> soldiers = agent->getSoldiers();
+        if (soldiers.empty()) {
+            continue;
+        }
+        SoldierFingerprint fp = SoldierFingerprint::of(soldiers, agent->profile.lostNumOfTroops,
+                                                       agent->profile.initialNumOfTroops);
+        if (!soldierSummaries.needsRefresh(agent->profile.name, fp)) {
+            continue;
+        }
+        misses.emplace_back(agent, fp);
+        units[agent->profile.name]      = agent->soldierReportInput();
+        properties[agent->profile.name] = unit_schema;
+    }
+
+    if (misses.empty()) {
+        return;
+    }
+
+    std::stringstream prompt_system;
+    prompt_system << "### SYSTEM INSTRUCTION: INTELLIGENCE OFFICER ROLE ###\n";
+    prompt_system << "You are a highly experienced Intelligence Officer. ";
+    prompt_system << "For EACH unit in 'UNITS', analyze its soldiers and situation and produce ONE consolidated "
+                     "tactical report.\n";
+    prompt_system << "\n--- JSON OUTPUT CONSTRAINT ---\n";
+    prompt_system << "Return one JSON object keyed by unit name; each value follows the Output Schema.\n";
+    if (ssc.contains("soldier_summary_schema")) {
+        prompt_system << "Output Schema: " << ssc["soldier_summary_schema"].dump() << "\n";
+    }
+    if (ssc.contains("analysis_guidance")) {
+        prompt_system << "Analysis Guidance: " << ssc["analysis_guidance"].dump() << "\n";
+    }
+    prompt_system << "Output pure JSON only. No explanation.\n";
+
+    std::vector<nlohmann::json> prompts = {
+        { { "role", "system" }, { "content", prompt_system.str() } },
+        { { "role", "user" }, { "content", "[UNITS]\n" + units.dump() + "\n\n[JSON REPORT START]\n" } }
+    };
+    nlohmann::json response_format = {
+        {"type",         "json_schema"},
+        { "json_schema",
+         { { "schema", { { "type", "object" }, { "properties", properties } } } }}
+    };
+
+    nlohmann::json reports;
+    try {
+        reports = nlohmann::json::parse(llm->infer(prompts, response_format, { "soldier_summary", turn }));
+    } catch (const std::exception & e) {
+        logger.error() << "Failed to parse batched soldier summary: " << e.what();
+        return;
+    }
+    if (!reports.is_object() || reports.contains("error")) {
+        logger.warn() << "Batched soldier summary unavailable, keeping cached reports";
+        return;
+    }
+
+    int refreshed = 0;
+    for (const auto & [agent, fp] : misses) {
+        if (!reports.contains(agent->profile.name) || !reports[agent->profile.name].is_object()) {
+            continue;  // Giữ báo cáo cũ, thử lại lượt sau
+        }
+        const nlohmann::json & report = reports[agent->profile.name];
+
+        std::stringstream formatted_summary;
+        formatted_summary << "=== UNIT MORALE & INTELLIGENCE SUMMARY ===\n";
+        formatted_summary << "MORALE: " << report.value("agent_morale_assessment", "N/A") << "\n";
+        formatted_summary << "OBSERVATIONS: " << report.value("key_observations_summary", "None") << "\n";
+        formatted_summary << "SENTIMENT: " << report.value("overall_sentiment_summary", "Stable") << "\n";
+        if (report.contains("physical_condition_trend") && report["physical_condition_trend"].is_string()) {
+            formatted_summary << "PHYSICAL: " << report["physical_condition_trend"].get<std::string>() << "\n";
+        }
+        if (report.contains("combat_effectiveness_estimate") && report["combat_effectiveness_estimate"].is_number()) {
+            double effectiveness = report["combat_effectiveness_estimate"].get<double>();
+            formatted_summary << "EFFECTIVENESS: " << static_cast<int>(effectiveness * 100) << "%\n";
+        }
+        formatted_summary << "==========================================\n";
+
+        soldierSummaries.store(agent->profile.name, fp, formatted_summary.str());
+        ++refreshed;
+    }
+    logger.info() << "Soldier summaries: " << refreshed << "/" << misses.size() << " refreshed in one batched request";
+}
+
 void Simulation::run(int num_rounds) {
     chart_data = {
     {"data",
@@ -804,7 +1135,36 @@ void Simulation::run(int num_rounds) {
     std::string last_weather_type = "Clear";
     double      last_visibility_modifier = 1.0;
     double      last_artillery_modifier = 1.0;
+    const double tunnel_buffer = modifiers.tunnelBuffer();
+    Profiler &   profiler      = Profiler::instance();
+    std::optional<ScopedTimer> run_timer(std::in_place, "run");
+
+    // Quân số / số agent còn chiến đấu của hai phe
+    int  viet_total = 0, french_total = 0, viet_agents = 0, french_agents = 0;
+    auto tally      = [&]() {
+        viet_total = french_total = viet_agents = french_agents = 0;
+        for (auto* agent : agents) {
+            if (!agent->mergedOrPruned && agent->profile.currentStage != "Crushing Defeat" &&
+                agent->profile.currentStage != "fleeing Off the Map") {
+                if (agent->isCountryA()) {
+                    viet_total += agent->profile.remainingNumOfTroops();
+                    viet_agents++;
+                }
+                else {
+                    french_total += agent->profile.remainingNumOfTroops();
+                    french_agents++;
+                }
+            }
+        }
+    };
     for (int turn = 0; turn < num_rounds; ++turn) {
+        profiler.setTurn(turn + 1);
+        std::optional<ScopedTimer> turn_timer(std::in_place, "turn");
+        std::optional<ScopedTimer> setup_timer(std::in_place, "turn.setup");
+        if (trace.enabled()) {
+            tally();
+            trace.turnStart(turn + 1, viet_total, french_total, viet_agents, french_agents);
+        }
         if (config.contains("historical_events")) {
             for (const auto & event : config["historical_events"]) {
                 if (event.contains("round") && event["round"].get<int>() == turn + 1) {
@@ -822,6 +1182,7 @@ void Simulation::run(int num_rounds) {
                         double      visibilityModifier = weather["visibilityModifier"].get<double>();
                         double      artilleryModifier = weather.value("artilleryModifier", 1.0);
                         field.setWeather(weather_type, visibilityModifier, artilleryModifier);
+                        trace.weather(turn + 1, weather_type, visibilityModifier, artilleryModifier);
                         anti_aircraft_modifier = artilleryModifier;
                         last_weather_type = weather_type;
                         last_visibility_modifier = visibilityModifier;
@@ -839,32 +1200,73 @@ void Simulation::run(int num_rounds) {
         else {
             logger.info(turn + 1) << "No weather config, using " << last_weather_type;
         }
-        std::map<std::string, int> tunnel_troops;
-        for (const auto& terrain : field.getTerrainObjects()) {
-            if (terrain.type == TerrainType::Tunnel) {
-                tunnel_troops[terrain.name] = 0;
+        field.ensureTacticalRaster();  // No-op trừ khi terrain đã đổi
+
+        // Sổ chiếm dụng tunnel của lượt: luật sức chứa áp dụng tại BattleField::admitTunnel
+        field.refreshTunnelOccupancy(agents, turn + 1, tunnel_buffer);
+        for (auto* agent : agents) {
+            if (agent->mergedOrPruned) {
+                continue;
+            }
+            if (const TerrainObject* tunnel = field.overflowTunnel(agent)) {
+                logger.warn(turn + 1) << "Agent " << agent->profile.name << " exceeds tunnel capacity (" << tunnel->power
+                    << ") in " << tunnel->name;
+                agent->profile.currentAction = "Wait without Action";
+                agent->profile.actionId      = modifiers.actionId(agent->profile.currentAction);
+            }
+            else if (const TerrainObject* tunnel = field.occupiedTunnel(agent)) {
+                agent->profile.tactics["stealth"] =
+                    std::max(agent->profile.tactics["stealth"], tunnel->stealth_bonus);
+                logger.info(turn + 1) << "Agent " << agent->profile.name << " in tunnel " << tunnel->name
+                    << ", stealth=" << agent->profile.tactics["stealth"];
             }
         }
-        for (auto* agent : agents) {
-            if (!agent->mergedOrPruned && field.isInTunnel(agent)) {
-                TerrainObject* tunnel = field.getTerrainObject(agent->profile.position.x, agent->profile.position.y);
-                if (tunnel && tunnel->type == TerrainType::Tunnel) {
-                    tunnel_troops[tunnel->name] += agent->profile.remainingNumOfTroops();
-                    if (tunnel_troops[tunnel->name] > tunnel->power) {
-                        logger.warn(turn + 1) << "Agent " << agent->profile.name << " exceeds tunnel capacity (" << tunnel->power
-                            << ") in " << tunnel->name;
-                        agent->profile.currentAction = "Wait without Action";
-                    }
-                    else {
-                        agent->profile.tactics["stealth"] =
-                            std::max(agent->profile.tactics["stealth"], tunnel->stealth_bonus);
-                        logger.info(turn + 1) << "Agent " << agent->profile.name << " in tunnel " << tunnel->name
-                            << ", stealth=" << agent->profile.tactics["stealth"];
-                    }
-                }
+        // Ảnh chụp thế giới đầu lượt: mọi báo cáo tình hình trong lượt chiếu từ đây.
+        // Duyệt theo danh sách đầu lượt vì execute() có thể spawn/recall agent (thay đổi agents);
+        // agent mới spawn hành động từ lượt sau, agent đã bị xoá thì bỏ qua.
+        field.buildSnapshot(agents, turn + 1);
+        const std::vector<Agent *> roster = agents;
+        std::vector<AgentHandle>   roster_handles;
+        roster_handles.reserve(roster.size());
+        for (auto* agent : roster) {
+            roster_handles.push_back(agent->self);
+        }
+
+        // Ngân sách LLM call của lượt: agent khẩn cấp nhất được execute(), còn lại carryForward()
+        std::vector<Agent *> active;
+        for (auto* agent : roster) {
+            if (!agent->mergedOrPruned && agent->profile.currentStage != "Crushing Defeat" &&
+                agent->profile.currentStage != "fleeing Off the Map") {
+                active.push_back(agent);
             }
         }
-        for (auto* agent : agents) {
+        const std::unordered_set<Agent *> scheduled = scheduler.plan(active, field, turn + 1);
+        if (scheduled.size() < active.size()) {
+            logger.info(turn + 1) << "LLM budget: " << scheduled.size() << "/" << active.size()
+                                  << " agents re-plan, others carry forward";
+        }
+
+        // Ngân sách thời gian của lượt, chia cho các request LLM dự kiến
+        const int soldier_requests = config.contains("soldier_summary_config") ? 1 : 0;
+        llm->beginTurn(config["battle_config"].value("turn_deadline_ms", 0),
+                       static_cast<int>(scheduled.size()) + soldier_requests);
+        std::vector<Agent *> planned;
+        for (auto* agent : active) {
+            if (scheduled.count(agent)) {
+                planned.push_back(agent);
+            }
+        }
+        setup_timer.reset();
+        {
+            ScopedTimer timer("soldier_summaries");
+            refreshSoldierSummaries(planned, turn + 1);  // Chỉ agent re-plan mới dùng báo cáo binh sĩ trong prompt
+        }
+        combat.clear();
+        for (const AgentHandle & handle : roster_handles) {
+            Agent * agent = agentPool.get(handle);  // nullptr nếu agent đã bị xoá trong lượt
+            if (!agent) {
+                continue;
+            }
             if (!agent->mergedOrPruned && agent->profile.currentStage != "Crushing Defeat" &&
                 agent->profile.currentStage != "fleeing Off the Map") {
                 try {
@@ -878,9 +1280,20 @@ void Simulation::run(int num_rounds) {
                         logger.info(turn + 1) << "Agent " << agent->profile.name << " increased stealth to "
                             << agent->profile.tactics["stealth"] << " due to low visibility";
                     }
-                    agent->execute();
+                    nlohmann::json result;
+                    if (scheduled.count(agent)) {
+                        result = agent->execute();
+                        scheduler.markDecided(agent, turn + 1);
+                    } else {
+                        ScopedTimer timer("agent.carry_forward");
+                        result = agent->carryForward(scheduler.engageRange());
+                    }
+                    trace.decision(turn + 1, agent->profile.name, result.value("agentNextActionType", ""),
+                                   result.value("agentStage", ""), result.value("targetedAgentName", ""),
+                                   static_cast<int>(agent->profile.moral), !scheduled.count(agent));
+                    ScopedTimer timer("effects");
                     applyMoraleEffect(agent);
-                    applyActionEffects(agent, anti_aircraft_modifier);
+                    applyActionEffects(agent, result, anti_aircraft_modifier);
                     checkSupplyLine(agent);
                 }
                 catch (const std::exception& e) {
@@ -888,22 +1301,24 @@ void Simulation::run(int num_rounds) {
                 }
             }
         }
-        updateTargetList();
-        visualizeDeployment(turn + 1, true);
-        int viet_total = 0, french_total = 0, viet_agents = 0, french_agents = 0;
-        for (auto* agent : agents) {
-            if (!agent->mergedOrPruned && agent->profile.currentStage != "Crushing Defeat" &&
-                agent->profile.currentStage != "fleeing Off the Map") {
-                if (agent->isCountryA()) {
-                    viet_total += agent->profile.remainingNumOfTroops();
-                    viet_agents++;
-                }
-                else {
-                    french_total += agent->profile.remainingNumOfTroops();
-                    french_agents++;
-                }
-            }
+        {
+            ScopedTimer timer("combat.resolve");
+            resolveCombat(turn + 1);
         }
+        field.invalidateSnapshot();
+        if (llm->deadlineExceeded()) {
+            logger.warn(turn + 1) << "Turn deadline exceeded, late decisions used fallback action";
+        }
+        llm->endTurn();
+        {
+            ScopedTimer timer("update_targets");
+            updateTargetList();
+        }
+        {
+            ScopedTimer timer("visualize");
+            visualizeDeployment(turn + 1, true);
+        }
+        tally();
         chart_data["data"]["labels"].push_back(turn + 1);
         chart_data["data"]["datasets"][0]["data"].push_back(viet_total);
         chart_data["data"]["datasets"][1]["data"].push_back(french_total);
@@ -912,15 +1327,42 @@ void Simulation::run(int num_rounds) {
 
         logger.info(turn + 1) << countryA->profile.name<< " troops = " << viet_total <<", "<< countryB->profile.name << " troops = " << french_total
             << ", "<< countryA->profile.name <<" agents = " << viet_agents << ", "<< countryB->profile.name <<" agents = " << french_agents;
+        turn_timer.reset();
+        if (profiler.enabled()) {
+            for (const auto & line : profiler.endTurn()) {
+                logger.info(turn + 1) << "Profile " << line;
+            }
+        }
         if (french_total < 600) {
             logger.info(turn + 1) << countryA->profile.name << " wins!";
+            trace.victory(turn + 1, countryA->profile.name, viet_total, french_total);
             break;
         }
         if (viet_total < 1200) {
             logger.info(turn + 1) << countryB->profile.name << " wins!";          
+            trace.victory(turn + 1, countryB->profile.name, viet_total, french_total);
             break;
         }
     }
+    trace.close();
+    run_timer.reset();
+    const std::string metrics_path =
+        config.contains("battle_config") ? config["battle_config"].value("llm_metrics", "") : "";
+    if (!metrics_path.empty()) {
+        if (llm->writeMetrics(metrics_path)) {
+            logger.info() << "LLM call metrics written to " << metrics_path;
+        } else {
+            logger.warn() << "Cannot write LLM call metrics to " << metrics_path;
+        }
+    }
+    if (profiler.enabled()) {
+        for (const auto & line : profiler.summary()) {
+            logger.info() << "Profile total " << line;
+        }
+        if (profiler.writeChromeTrace()) {
+            logger.info() << "Chrome trace written (" << profiler.droppedEvents() << " spans dropped)";
+        }
+    }
     try {
         std::ofstream chart_out("troop_loss_chart.json");
         chart_out << chart_data.dump(2);
@@ -931,6 +1373,9 @@ void Simulation::run(int num_rounds) {
     }
 
     logger.info() << "Simulation ended.";
+    if (config.contains("battle_config") && config["battle_config"].value("tactical_raster_validate", false)) {
+        logger.info() << "Tactical raster max error vs exact: " << field.tacticalRasterMaxError();
+    }
     for (auto* agent : agents) {
         if (!agent->mergedOrPruned && agent->profile.currentStage != "Crushing Defeat") {
             logger.info() << "Agent " << agent->profile.name << " final state: " << agent->profile.currentStage;
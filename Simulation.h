@@ -1,20 +1,47 @@
 #pragma once
 #include "Agent.h"
+#include "BoundedQueue.h"
+#include "DecisionScheduler.h"
+#include "EngagementGraph.h"
+#include "EventTrace.h"
+#include "ModifierTables.h"
+#include "Profiler.h"
 #include "Soldier.h"
 #include "BattleField.h"
 #include "LLMInference.h"
 #include "nlohmann/json.hpp"
 #include "Profile.h"
+#include "PromptAssembler.h"
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
-enum class LogLevel { INFO, DEBUG, WARN, ERROR };
+// Thứ tự tăng dần theo mức nghiêm trọng: ghi khi level >= min_level
+enum class LogLevel { DEBUG, INFO, WARN, ERROR };
 
+enum class LogOverflow { Drop, Block };
+
+struct LoggerOptions {
+    size_t      queue_capacity = 8192;
+    LogOverflow overflow       = LogOverflow::Block;  // Drop: opt-in cho benchmark, chấp nhận mất INFO/WARN
+};
+
+// Logger bất đồng bộ: log() chỉ đẩy bản ghi vào BoundedQueue (không khoá, gọi được từ nhiều luồng),
+// một luồng nền lấy theo lô, định dạng timestamp và ghi file/console. Chỉ flush khi gặp ERROR,
+// khi gọi flush() hoặc lúc huỷ Logger.
+// Hàng đợi đầy: LogOverflow::Drop bỏ bản ghi (đếm lại, báo trong log), LogOverflow::Block chờ luồng ghi;
+// ERROR luôn chờ, không bao giờ bị bỏ.
 class Logger {
 public:
-    Logger(const std::string& filename = "simulation_log.txt", bool log_to_console = true, LogLevel min_level = LogLevel::INFO);
+    Logger(const std::string& filename = "simulation_log.txt", bool log_to_console = true, LogLevel min_level = LogLevel::INFO,
+           const LoggerOptions& options = LoggerOptions());
     ~Logger();
 
     // Lớp tạm để hỗ trợ cú pháp << cho mỗi mức log
@@ -23,25 +50,33 @@ public:
         LogStream(Logger& logger, LogLevel level, int turn = -1);
         ~LogStream();
 
+        // Mức log bị tắt: không dựng ostringstream, << không làm gì (toán hạng vẫn được tính, xem LOG_DEBUG)
         template<typename T>
         LogStream& operator<<(const T& value) {
-            stream_ << value;
+            if (stream_) *stream_ << value;
             return *this;
         }
 
         // Hỗ trợ cho std::endl và các manipulator khác
         LogStream& operator<<(std::ostream& (*manip)(std::ostream&)) {
-            stream_ << manip;
+            if (stream_) *stream_ << manip;
             return *this;
         }
 
     private:
         Logger& logger_;
         LogLevel level_;
-        std::ostringstream stream_;
+        std::optional<std::ostringstream> stream_;
         int turn_;
     };
 
+    bool enabled(LogLevel level) const {
+#ifdef NDEBUG
+        if (level == LogLevel::DEBUG) return false;
+#endif
+        return level >= min_level_.load(std::memory_order_relaxed);
+    }
+
     LogStream info(int turn = -1) { return LogStream(*this, LogLevel::INFO, turn); }
     LogStream debug(int turn = -1) { return LogStream(*this, LogLevel::DEBUG, turn); }
     LogStream warn(int turn = -1) { return LogStream(*this, LogLevel::WARN, turn); }
@@ -50,13 +85,52 @@ public:
     void setLogToConsole(bool enable) { log_to_console_ = enable; }
     void setMinLogLevel(LogLevel level) { min_level_ = level; }
 
+    // Chờ luồng nền ghi và flush hết các bản ghi đã log trước lời gọi này
+    void flush();
+
+    size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
 private:
-    void log(LogLevel level, const std::string& message, int turn);
+    struct Record {
+        LogLevel    level = LogLevel::INFO;
+        int         turn  = -1;
+        std::time_t time  = 0;
+        std::string message;
+    };
 
-    std::ofstream file_;
-    bool log_to_console_;
-    LogLevel min_level_;
+    void log(LogLevel level, std::string&& message, int turn);
+    void writerLoop();
+    void write(const Record& record);
+
+    std::ofstream         file_;
+    std::atomic<bool>     log_to_console_;
+    std::atomic<LogLevel> min_level_;
+    LogOverflow           overflow_;
+
+    BoundedQueue<Record> queue_;
+    std::atomic<size_t>  pushed_{ 0 };
+    std::atomic<size_t>  written_{ 0 };
+    std::atomic<size_t>  flushed_{ 0 };
+    std::atomic<size_t>  dropped_{ 0 };
+    std::atomic<bool>    flush_requested_{ false };
+    std::atomic<bool>    stop_{ false };
+
+    std::mutex              wake_mutex_;
+    std::condition_variable wake_;     // Đánh thức luồng ghi (ERROR, flush, hàng đợi quá nửa)
+    std::condition_variable drained_;  // Báo cho flush() khi đã ghi xong
+    std::thread             writer_;
 };
+
+// Kiểm tra mức log trước khi đánh giá bất kỳ toán hạng << nào (dump JSON, isInTunnel...):
+//   LOG_DEBUG(logger, turn) << "..." << j.dump(2);
+// Bản build NDEBUG loại hẳn LOG_DEBUG (nhánh hằng false, vẫn được kiểm tra kiểu).
+#define LOG_AT(lg, level, ...) if (!(lg).enabled(level)) {} else Logger::LogStream((lg), (level), ##__VA_ARGS__)
+#ifdef NDEBUG
+#define LOG_DEBUG(lg, ...) if (true) {} else (lg).debug(__VA_ARGS__)
+#else
+#define LOG_DEBUG(lg, ...) LOG_AT(lg, LogLevel::DEBUG, ##__VA_ARGS__)
+#endif
+
 class Simulation {
   public:
     BattleField                   field;
@@ -65,6 +139,7 @@ class Simulation {
     SoldierCollector*             soldierCollectorA;
 
     SoldierCollector*             soldierCollectorB;
+    GenerationalPool<Agent>       agentPool;  // Sở hữu mọi Agent; agents chỉ giữ thứ tự duyệt
     std::vector<Agent *>          agents;
     nlohmann::json                config, chart_data;
   
@@ -73,10 +148,20 @@ class Simulation {
     std::string                   model_path;
     int                           unique_id_counter;
     Logger                        logger;
+    PromptAssembler               prompts;
+    SoldierSummaryCache           soldierSummaries;
+    DecisionScheduler             scheduler;
+    EngagementGraph               engagements;  // attacker → target, cập nhật qua Agent::setTarget
+    EventTrace                    trace;  // Luồng sự kiện nhị phân (battle_config.event_trace)
+    ModifierTables                modifiers;  // Id action/stage/troop type + bảng hệ số thương vong
+    CombatBatch                   combat;  // Giao chiến của lượt hiện tại, resolve + commit ở resolveCombat()
 
     Simulation(const nlohmann::json & config);
     ~Simulation();
 
+    // Tạo agent trong agentPool và gán handle self; chưa thêm vào agents
+    Agent * createAgent(const Profile & profile);
+
     bool addAgent(Agent * child);
 
     bool insertAgent(unsigned int index, Agent * child);
@@ -130,10 +215,15 @@ class Simulation {
     bool        isTerrainObjectEncircled(const TerrainObject & obj);
     void        applyMoraleEffect(Agent * agent);
     std::string checkSupplyLine(Agent * agent);
-    void        applyActionEffects(Agent * agent, double & anti_aircraft_modifier);
+    void        applyActionEffects(Agent * agent, const nlohmann::json & sync_results, double & anti_aircraft_modifier);
  
     void        logState(int turn, const std::string & team, Agent * commander);
     void        visualizeDeployment(int turn, bool output_to_console);
     void        updateTargetList();
+    void        refreshSoldierSummaries(const std::vector<Agent *> & roster, int turn);
+    void        resolveCombat(int turn);
+    void        settleCombat(Agent * agent);  // Áp ngay thương vong đang chờ của agent trước khi xoá nó
+    void        applyCombat(CombatBatch & batch, int turn);
+    void        logCombatRow(const CombatBatch & batch, size_t i);
     void        run(int num_rounds);
 };
@@ -1,6 +1,7 @@
 #include "Soldier.h"
 #include "Agent.h"
 #include "Simulation.h"
+#include <cmath>
 #include <sstream>
 
 SoldierAgent::SoldierAgent(const nlohmann::json & json_data) {
@@ -181,3 +182,68 @@ void SoldierCollector::deploySoldier(SoldierAgent * soldier, Agent * owner) {
         throw std::runtime_error("Soldier not found in available list.");
     }
 }
+
+void SoldierCollector::recallSoldiers(Agent * owner) {
+    auto it = deployedSoldiers.find(owner);
+    if (it == deployedSoldiers.end()) {
+        return;
+    }
+    for (SoldierAgent * soldier : it->second) {
+        delete soldier;
+    }
+    deployedSoldiers.erase(it);
+}
+
+// ============================================================================
+// SOLDIER SUMMARY CACHE
+// ============================================================================
+
+SoldierFingerprint SoldierFingerprint::of(const std::vector<SoldierAgent *> & soldiers, int losses, int troops) {
+    SoldierFingerprint fp;
+    fp.soldiers = soldiers.size();
+    fp.losses   = losses;
+    fp.troops   = troops;
+    for (const SoldierAgent * s : soldiers) {
+        fp.morale += static_cast<int>(s->current_morale);
+        fp.fatigue += s->current_fatigue_level == "High" ? 2.0 : s->current_fatigue_level == "Low" ? 0.0 : 1.0;
+    }
+    if (!soldiers.empty()) {
+        fp.morale /= soldiers.size();
+        fp.fatigue /= soldiers.size();
+    }
+    return fp;
+}
+
+void SoldierSummaryCache::configure(const nlohmann::json & config) {
+    morale_delta  = config.value("cache_morale_delta", morale_delta);
+    fatigue_delta = config.value("cache_fatigue_delta", fatigue_delta);
+    loss_ratio    = config.value("cache_loss_ratio", loss_ratio);
+}
+
+bool SoldierSummaryCache::needsRefresh(const std::string & agent, const SoldierFingerprint & fp) const {
+    auto it = entries.find(agent);
+    if (it == entries.end()) {
+        return true;
+    }
+    const SoldierFingerprint & old = it->second.fp;
+    if (old.soldiers != fp.soldiers) {
+        return true;
+    }
+    if (std::abs(fp.morale - old.morale) >= morale_delta || std::abs(fp.fatigue - old.fatigue) >= fatigue_delta) {
+        return true;
+    }
+    return std::abs(fp.losses - old.losses) >= loss_ratio * std::max(1, fp.troops);
+}
+
+void SoldierSummaryCache::store(const std::string & agent, const SoldierFingerprint & fp, const std::string & summary) {
+    entries[agent] = { fp, summary };
+}
+
+std::string SoldierSummaryCache::get(const std::string & agent) const {
+    auto it = entries.find(agent);
+    return it == entries.end() ? std::string() : it->second.summary;
+}
+
+void SoldierSummaryCache::forget(const std::string & agent) {
+    entries.erase(agent);
+}
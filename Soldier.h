@@ -113,6 +113,9 @@ public:
 
     void deploySoldier(SoldierAgent * soldier, Agent * owner);
 
+    // Huỷ lính đã triển khai cho owner khi owner bị xoá khỏi simulation (ô của agent sẽ được dùng lại)
+    void recallSoldiers(Agent * owner);
+
     unsigned int getNumAvailableSoldiers() {
         return  availableSoldiers.size();
     }
@@ -130,3 +133,36 @@ private:
     std::mt19937 rng;
 
 };
+
+// Dấu vân tay trạng thái binh sĩ của một agent: chỉ khi thay đổi vượt ngưỡng mới cần tóm tắt lại bằng LLM
+struct SoldierFingerprint {
+    size_t soldiers = 0;
+    double morale   = 0.0;  // Trung bình current_morale (VeryLow=0 .. VeryHigh=4)
+    double fatigue  = 0.0;  // Trung bình fatigue (Low=0, Medium=1, High=2)
+    int    losses   = 0;    // lostNumOfTroops của agent
+    int    troops   = 0;    // initialNumOfTroops, dùng quy đổi ngưỡng tổn thất
+
+    static SoldierFingerprint of(const std::vector<SoldierAgent *> & soldiers, int losses, int troops);
+};
+
+// Cache báo cáo tình báo binh sĩ theo agent (theo tên)
+class SoldierSummaryCache {
+  public:
+    void configure(const nlohmann::json & soldier_summary_config);
+
+    bool        needsRefresh(const std::string & agent, const SoldierFingerprint & fp) const;
+    void        store(const std::string & agent, const SoldierFingerprint & fp, const std::string & summary);
+    std::string get(const std::string & agent) const;
+    void        forget(const std::string & agent);
+
+  private:
+    struct Entry {
+        SoldierFingerprint fp;
+        std::string        summary;
+    };
+
+    std::map<std::string, Entry> entries;
+    double                       morale_delta  = 0.5;   // Chênh lệch morale trung bình
+    double                       fatigue_delta = 0.5;   // Chênh lệch fatigue trung bình
+    double                       loss_ratio    = 0.05;  // Tổn thất mới / quân số ban đầu
+};
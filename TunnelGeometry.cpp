@@ -0,0 +1,70 @@
+#include "TunnelGeometry.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define TUNNEL_GEOMETRY_SSE2 1
+#endif
+
+void TunnelGeometry::add(const Position & start, const Position & end, size_t index) {
+    const double ddx  = end.x - start.x;
+    const double ddy  = end.y - start.y;
+    const double len2 = ddx * ddx + ddy * ddy;
+    sx.push_back(start.x);
+    sy.push_back(start.y);
+    dx.push_back(ddx);
+    dy.push_back(ddy);
+    inv_len2.push_back(len2 < 1e-12 ? 0.0 : 1.0 / len2);
+    terrain_index.push_back(index);
+}
+
+void TunnelGeometry::clear() {
+    sx.clear();
+    sy.clear();
+    dx.clear();
+    dy.clear();
+    inv_len2.clear();
+    terrain_index.clear();
+}
+
+double TunnelGeometry::distanceSq(size_t k, double px, double py) const {
+    const double rx = px - sx[k];
+    const double ry = py - sy[k];
+    const double t  = std::min(1.0, std::max(0.0, (rx * dx[k] + ry * dy[k]) * inv_len2[k]));
+    const double ex = rx - t * dx[k];
+    const double ey = ry - t * dy[k];
+    return ex * ex + ey * ey;
+}
+
+void TunnelGeometry::distanceSqRow(double px, double py, double * out) const {
+    const size_t n = size();
+    size_t       k = 0;
+#ifdef TUNNEL_GEOMETRY_SSE2
+    const __m128d vpx  = _mm_set1_pd(px);
+    const __m128d vpy  = _mm_set1_pd(py);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one  = _mm_set1_pd(1.0);
+    for (; k + 2 <= n; k += 2) {
+        const __m128d rx  = _mm_sub_pd(vpx, _mm_loadu_pd(&sx[k]));
+        const __m128d ry  = _mm_sub_pd(vpy, _mm_loadu_pd(&sy[k]));
+        const __m128d vdx = _mm_loadu_pd(&dx[k]);
+        const __m128d vdy = _mm_loadu_pd(&dy[k]);
+        __m128d       t   = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(rx, vdx), _mm_mul_pd(ry, vdy)), _mm_loadu_pd(&inv_len2[k]));
+        t                 = _mm_min_pd(one, _mm_max_pd(zero, t));
+        const __m128d ex  = _mm_sub_pd(rx, _mm_mul_pd(t, vdx));
+        const __m128d ey  = _mm_sub_pd(ry, _mm_mul_pd(t, vdy));
+        _mm_storeu_pd(out + k, _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey)));
+    }
+#endif
+    for (; k < n; ++k) {
+        out[k] = distanceSq(k, px, py);
+    }
+}
+
+void TunnelGeometry::distanceSqBatch(const double * px, const double * py, size_t n_points, double * out) const {
+    const size_t n = size();
+    for (size_t i = 0; i < n_points; ++i) {
+        distanceSqRow(px[i], py[i], out + i * n);
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Profile.h"
+
+#include <cstddef>
+#include <vector>
+
+// Hình học tunnel dạng structure-of-arrays: điểm đầu, vector hướng và 1/|d|² tính sẵn khi thêm tunnel.
+// Kernel khoảng cách điểm-đoạn chạy SSE2 (2 tunnel/lệnh) khi có, ngược lại vòng lặp vô hướng;
+// hai nhánh dùng cùng công thức nên cho cùng kết quả.
+class TunnelGeometry {
+  public:
+    void add(const Position & start, const Position & end, size_t index);
+    void clear();
+
+    size_t size() const { return terrain_index.size(); }
+    size_t terrainIndex(size_t k) const { return terrain_index[k]; }
+
+    // Bình phương khoảng cách từ (px, py) tới tunnel k
+    double distanceSq(size_t k, double px, double py) const;
+
+    // out[i * size() + k] = bình phương khoảng cách từ điểm i tới tunnel k, với i < n_points
+    void distanceSqBatch(const double * px, const double * py, size_t n_points, double * out) const;
+
+  private:
+    void distanceSqRow(double px, double py, double * out) const;
+
+    std::vector<double> sx, sy;      // Điểm đầu
+    std::vector<double> dx, dy;      // end - start
+    std::vector<double> inv_len2;    // 1 / |d|², 0 nếu tunnel suy biến thành điểm
+    std::vector<size_t> terrain_index;
+};
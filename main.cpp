@@ -245,11 +245,11 @@ int main(int argc, char ** argv) {
         prompt_system << "\n--- GLOBAL SETTINGS ---\n";
         add_field(prompt_system, "System Setting", sim.config["prompt"].dump());
         add_field(prompt_system, "History Setting",
-                  sim.countryA->profile.historySetting + ". " + sim.countryB->profile.historySetting);
+                  sim.countryA->profile.historySetting.str() + ". " + sim.countryB->profile.historySetting.str());
         add_field(prompt_system, "Army Setting",
-                  sim.countryA->profile.armySetting + ". " + sim.countryB->profile.armySetting);
+                  sim.countryA->profile.armySetting.str() + ". " + sim.countryB->profile.armySetting.str());
         add_field(prompt_system, "Role Setting",
-                  sim.countryA->profile.roleSetting + ". " + sim.countryB->profile.roleSetting);
+                  sim.countryA->profile.roleSetting.str() + ". " + sim.countryB->profile.roleSetting.str());
 
         prompt_system << "\n--- ACTION INSTRUCTION BLOCK ---\n";
         prompt_system << sim.config["actionInstructionBlock"].dump() << "\n";